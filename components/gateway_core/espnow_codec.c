@@ -0,0 +1,103 @@
+/* ESPNOW_CODEC.C
+   Compact on-air payload codec
+
+   Decodes the TLV payloads carried in ESPNOW_DATA_COMPACT frames and renders
+   them as the same JSON lines the text clients send, so the host side does
+   not need to know which encoding a node uses.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "espnow_codec.h"
+
+static const char *TAG = "espnow_codec";
+
+/* Append formatted text. On overflow *pos is left at or past out_size. */
+static void __attribute__((format(printf, 4, 5))) append(char *out, size_t out_size, size_t *pos, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (*pos >= out_size) {
+        return;
+    }
+    va_start(ap, fmt);
+    n = vsnprintf(out + *pos, out_size - *pos, fmt, ap);
+    va_end(ap);
+    *pos = (n < 0) ? out_size : *pos + n;
+}
+
+int espnow_codec_to_json(const uint8_t *mac, const uint8_t *data, size_t len,
+                         char *out, size_t out_size, uint8_t *msg_type) {
+    const char *name;
+    size_t pos = 0;
+    size_t i;
+
+    // The message type record leads so the envelope can be written first
+    if (len < 3 || data[0] != ESPNOW_TLV_MSG_TYPE || data[1] != 1) {
+        ESP_LOGW(TAG, "Compact payload without message type");
+        return -1;
+    }
+    *msg_type = data[2];
+    switch (*msg_type) {
+        case ESPNOW_MSG_SENSOR:          name = "sensor"; break;
+        case ESPNOW_MSG_HEARTBEAT:       name = "heartbeat"; break;
+        case ESPNOW_MSG_REGISTER:        name = "register"; break;
+        case ESPNOW_MSG_CONFIG_RESPONSE: name = "config_response"; break;
+        default:
+            ESP_LOGW(TAG, "Unknown compact message type %d", *msg_type);
+            return -1;
+    }
+
+    if (*msg_type == ESPNOW_MSG_REGISTER) {
+        // espnow_register_cmd_handler reads the MAC at the top level
+        append(out, out_size, &pos, "{\"type\":\"register\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"}",
+               mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return pos < out_size ? (int)pos : -1;
+    }
+
+    append(out, out_size, &pos, "{\"type\":\"%s\",\"payload\":{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"",
+           name, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    for (i = 3; i + 2 <= len; ) {
+        uint8_t tag = data[i];
+        uint8_t vlen = data[i + 1];
+        const uint8_t *v = &data[i + 2];
+
+        if (i + 2 + vlen > len) {
+            ESP_LOGW(TAG, "Truncated compact record, tag %d", tag);
+            return -1;
+        }
+        switch (tag) {
+            case ESPNOW_TLV_STATUS:
+                if (vlen == 1) {
+                    append(out, out_size, &pos, ",\"status\":%s", v[0] ? "true" : "false");
+                }
+                break;
+            case ESPNOW_TLV_CFG:
+                if (vlen == 5) {
+                    int32_t value = (int32_t)((uint32_t)v[1] | ((uint32_t)v[2] << 8) |
+                                              ((uint32_t)v[3] << 16) | ((uint32_t)v[4] << 24));
+                    append(out, out_size, &pos, ",\"cfg%u\":%ld", v[0], (long)value);
+                }
+                break;
+            default:
+                break; // unknown tags are skipped
+        }
+        i += 2 + vlen;
+    }
+    if (i != len) {
+        ESP_LOGW(TAG, "Trailing bytes in compact payload");
+        return -1;
+    }
+
+    append(out, out_size, &pos, "}}");
+    return pos < out_size ? (int)pos : -1;
+}
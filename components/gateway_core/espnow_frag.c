@@ -0,0 +1,174 @@
+/* ESPNOW_FRAG.C
+   Reassembly of fragmented node messages
+
+   With CONFIG_GATEWAY_FRAGMENTATION a message longer than one frame travels
+   as up to 255 v2 fragments sharing a msg_id. Each partial message takes one
+   of ESPNOW_FRAG_SLOTS fixed buffers, keyed by sender MAC and msg_id, so no
+   heap is used. Fragment i goes to offset i * frag_len, the length of any
+   fragment but the last; the last one, which may arrive before that length is
+   known, is kept at the end of the buffer and moved behind the others once
+   the message is complete. Fragments may arrive in any order and duplicates
+   are ignored. A partial message is dropped when it is older than
+   ESPNOW_FRAG_TIMEOUT_MS, or when a new message needs its slot and it is the
+   oldest one. Everything runs in espnow_task.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "espnow_frag.h"
+
+#if CONFIG_GATEWAY_FRAGMENTATION
+
+static const char *TAG = "espnow_frag";
+
+#define FRAG_TIMEOUT_US           ((int64_t)ESPNOW_FRAG_TIMEOUT_MS * 1000)
+
+typedef struct {
+    bool used;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t msg_id;
+    uint8_t type;                         // Data type of the message, without ESPNOW_DATA_EXT.
+    uint8_t count;
+    uint8_t received;
+    uint16_t frag_len;                    // Length of every fragment but the last, 0 until known.
+    uint16_t last_len;                    // Length of the last fragment, 0 until received.
+    int64_t started_us;                   // First fragment received.
+    uint8_t seen[256 / 8];                // Received fragment indexes.
+    uint8_t data[ESPNOW_MESSAGE_MAX];
+} frag_slot_t;
+
+static frag_slot_t s_slots[ESPNOW_FRAG_SLOTS];
+static espnow_frag_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void stats_add(uint32_t *counter, uint32_t n) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *counter += n;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Slot of the message mac/msg_id, or a fresh one for it. Expired messages
+   are dropped on the way; with no free slot the oldest one is reused. */
+static frag_slot_t *slot_find(const uint8_t *mac, uint16_t msg_id, int64_t now) {
+    frag_slot_t *free_slot = NULL;
+    frag_slot_t *oldest = NULL;
+
+    for (int i = 0; i < ESPNOW_FRAG_SLOTS; i++) {
+        frag_slot_t *s = &s_slots[i];
+        if (s->used && now - s->started_us >= FRAG_TIMEOUT_US) {
+            ESP_LOGD(TAG, "Message %u from "MACSTR" timed out", s->msg_id, MAC2STR(s->mac));
+            s->used = false;
+            stats_add(&s_stats.rx_timeouts, 1);
+        }
+        if (!s->used) {
+            if (free_slot == NULL) {
+                free_slot = s;
+            }
+        } else if (s->msg_id == msg_id && memcmp(s->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return s;
+        } else if (oldest == NULL || s->started_us < oldest->started_us) {
+            oldest = s;
+        }
+    }
+    if (free_slot == NULL) {
+        ESP_LOGD(TAG, "Message %u from "MACSTR" evicted", oldest->msg_id, MAC2STR(oldest->mac));
+        stats_add(&s_stats.rx_evicted, 1);
+        free_slot = oldest;
+    }
+    return free_slot;
+}
+
+const uint8_t *espnow_frag_add(const uint8_t *mac, const espnow_data_v2_t *hdr, const uint8_t *payload,
+                               size_t len, size_t *msg_len) {
+    uint8_t type = hdr->type & ~ESPNOW_DATA_EXT;
+    uint8_t idx = hdr->frag_idx;
+    uint8_t count = hdr->frag_count;
+    uint8_t bit = 1u << (idx % 8);
+    int64_t now = esp_timer_get_time();
+
+    stats_add(&s_stats.rx_fragments, 1);
+    if (count == 0 || idx >= count || len == 0 || len > ESPNOW_MESSAGE_MAX) {
+        ESP_LOGI(TAG, "Bad fragment %u/%u from "MACSTR"", idx, count, MAC2STR(mac));
+        stats_add(&s_stats.rx_invalid, 1);
+        return NULL;
+    }
+
+    frag_slot_t *s = slot_find(mac, hdr->msg_id, now);
+    if (!s->used || s->msg_id != hdr->msg_id || memcmp(s->mac, mac, ESP_NOW_ETH_ALEN) != 0) {
+        memset(s, 0, offsetof(frag_slot_t, data));
+        s->used = true;
+        memcpy(s->mac, mac, ESP_NOW_ETH_ALEN);
+        s->msg_id = hdr->msg_id;
+        s->type = type;
+        s->count = count;
+        s->started_us = now;
+    } else if (s->type != type || s->count != count) {
+        goto invalid;
+    }
+    if (s->seen[idx / 8] & bit) {
+        return NULL; // resent fragment
+    }
+
+    // The fragments before the last fill [0, (count - 1) * frag_len), the
+    // last one sits at the end of the buffer; they must not overlap
+    if (idx + 1 < count) {
+        if (s->frag_len == 0) {
+            s->frag_len = len;
+        } else if (len != s->frag_len) {
+            goto invalid;
+        }
+        if ((size_t)(count - 1) * s->frag_len + s->last_len > sizeof(s->data)) {
+            goto invalid;
+        }
+        memcpy(s->data + (size_t)idx * s->frag_len, payload, len);
+    } else {
+        if ((size_t)(count - 1) * s->frag_len + len > sizeof(s->data)) {
+            goto invalid;
+        }
+        s->last_len = len;
+        memcpy(s->data + sizeof(s->data) - len, payload, len);
+    }
+    s->seen[idx / 8] |= bit;
+    if (++s->received < count) {
+        return NULL;
+    }
+
+    size_t head = (size_t)(count - 1) * s->frag_len;
+    memmove(s->data + head, s->data + sizeof(s->data) - s->last_len, s->last_len);
+    *msg_len = head + s->last_len;
+    s->used = false;
+    stats_add(&s_stats.rx_messages, 1);
+    ESP_LOGD(TAG, "Message %u from "MACSTR" complete, %d bytes", hdr->msg_id, MAC2STR(mac), (int)*msg_len);
+    return s->data;
+
+invalid:
+    ESP_LOGI(TAG, "Fragment %u/%u does not fit message %u from "MACSTR"", idx, count, hdr->msg_id, MAC2STR(mac));
+    s->used = false;
+    stats_add(&s_stats.rx_invalid, 1);
+    return NULL;
+}
+
+void espnow_frag_sent(uint32_t count) {
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.tx_messages++;
+    s_stats.tx_fragments += count;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void espnow_frag_get_stats(espnow_frag_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#endif // CONFIG_GATEWAY_FRAGMENTATION
@@ -0,0 +1,388 @@
+/* ESPNOW_RELIABLE.C
+   Reliable unicast to client nodes
+
+   Unicast frames from the host are kept until the ESP-NOW send callback
+   reports that the peer acknowledged them at the MAC layer. A failed attempt
+   is retried after an exponential backoff; after the last attempt, or on
+   success, one delivery report is sent to the host:
+
+       {"type":"delivery","mac":"AA:BB:CC:DD:EE:FF","id":7,"status":"ok","attempts":1}
+
+   "id" is the "id" of the host command. Frames without one, such as commands
+   without an id and the gateway's own register_ack, are not reported. A
+   message sent as fragments gets the report of its last fragment; the others
+   only report failures. OTA relay frames are never reported, the relay has
+   acks of its own. Up to
+   GATEWAY_RELIABLE_INFLIGHT frames per peer are handed to the driver at once.
+   The driver reports send results per peer in the order the frames were
+   sent, so callbacks are matched to the oldest in-flight frame for that MAC.
+   A frame whose callback has not come within GATEWAY_RELIABLE_SEND_TIMEOUT_MS,
+   for example because the event was lost, counts as a failed attempt, so a
+   lost callback can never hold a peer's window or a table entry for good.
+   Its callback may still arrive late, and would then be matched to the next
+   frame in flight. So after a timeout nothing new is sent to that peer until
+   the owed callbacks have arrived and been discarded, or for one more
+   timeout period if they never do.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "host_proto.h"
+#include "espnow_example.h"
+#include "peer_registry.h"
+#include "espnow_reliable.h"
+#include "gateway_stats.h"
+
+static const char *TAG = "espnow_reliable";
+
+#define RELIABLE_MAX_FRAMES       CONFIG_GATEWAY_RELIABLE_MAX_FRAMES
+#define RELIABLE_INFLIGHT         CONFIG_GATEWAY_RELIABLE_INFLIGHT
+#define RELIABLE_MAX_ATTEMPTS     CONFIG_GATEWAY_RELIABLE_MAX_ATTEMPTS
+#define RELIABLE_BACKOFF_US       (CONFIG_GATEWAY_RELIABLE_BACKOFF_MS * 1000LL)
+#define RELIABLE_BACKOFF_MAX_US   (CONFIG_GATEWAY_RELIABLE_BACKOFF_MAX_MS * 1000LL)
+#define RELIABLE_SEND_TIMEOUT_US  (CONFIG_GATEWAY_RELIABLE_SEND_TIMEOUT_MS * 1000LL)
+
+typedef enum {
+    FRAME_FREE,
+    FRAME_READY,                          // Waiting for an in-flight slot or its retry time.
+    FRAME_INFLIGHT,                       // Handed to esp_now_send, waiting for the send callback.
+} frame_state_t;
+
+typedef struct {
+    frame_state_t state;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t attempts;
+    uint16_t len;
+    uint8_t *data;
+    uint32_t ref;
+    uint32_t queued_seq;                  // Submission order, keeps per-peer FIFO.
+    uint32_t sent_seq;                    // Driver hand-off order, matches callbacks.
+    int64_t due_us;                       // Earliest time of the next attempt.
+    int64_t sent_us;                      // Hand-off time of the attempt in flight.
+} rel_frame_t;
+
+/* Send callbacks still to come for timed-out attempts to one peer. */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t count;
+    int64_t expire_us;                    // Stop waiting for them after this.
+} rel_owed_t;
+
+static rel_frame_t s_frames[RELIABLE_MAX_FRAMES];
+static rel_owed_t s_owed[RELIABLE_MAX_FRAMES];
+static uint32_t s_queued_seq;
+static uint32_t s_sent_seq;
+static espnow_reliable_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_retry_timer = NULL;
+static void (*s_release_cb)(void) = NULL;
+
+/* True for a fragment other than the last one of its message. */
+static bool is_inner_fragment(const rel_frame_t *f) {
+    const espnow_data_v2_t *hdr = (const espnow_data_v2_t *)f->data;
+
+    return f->len >= sizeof(espnow_data_v2_t) && (hdr->type & ESPNOW_DATA_EXT) && hdr->version >= ESPNOW_HDR_V2 &&
+           (hdr->flags & ESPNOW_FLAG_FRAGMENT) && hdr->frag_idx + 1 < hdr->frag_count;
+}
+
+static void report(const rel_frame_t *f, bool ok) {
+    char reply[128];
+    int n;
+
+    if (f->ref == 0 || (ok && is_inner_fragment(f)) || (f->len > 0 && f->data[0] == ESPNOW_DATA_OTA)) {
+        return;
+    }
+    n = snprintf(reply, sizeof(reply),
+                 "{\"type\":\"delivery\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"id\":%" PRIu32 ",\"status\":\"%s\",\"attempts\":%u}",
+                 MAC2STR(f->mac), f->ref, ok ? "ok" : "failed", f->attempts);
+    host_proto_emit_status(reply, n);
+}
+
+static void frame_release(rel_frame_t *f) {
+    free(f->data);
+    f->data = NULL;
+    f->state = FRAME_FREE;
+    s_stats.pending--;
+    if (s_release_cb) {
+        s_release_cb();
+    }
+}
+
+/* Called after a failed attempt: schedule a retry or give up. */
+static void frame_failed(rel_frame_t *f, int64_t now) {
+    if (f->attempts >= RELIABLE_MAX_ATTEMPTS) {
+        ESP_LOGW(TAG, "Delivery to "MACSTR" failed after %u attempts", MAC2STR(f->mac), f->attempts);
+        s_stats.failed++;
+        report(f, false);
+        frame_release(f);
+        return;
+    }
+    int64_t backoff = RELIABLE_BACKOFF_US << (f->attempts - 1);
+    if (backoff > RELIABLE_BACKOFF_MAX_US) {
+        backoff = RELIABLE_BACKOFF_MAX_US;
+    }
+    f->state = FRAME_READY;
+    f->due_us = now + backoff;
+}
+
+static bool owed_active(const rel_owed_t *o, int64_t now) {
+    return o->count > 0 && o->expire_us > now;
+}
+
+static rel_owed_t *owed_find(const uint8_t *mac, int64_t now) {
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        if (owed_active(&s_owed[i], now) && memcmp(s_owed[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return &s_owed[i];
+        }
+    }
+    return NULL;
+}
+
+static void owed_add(const uint8_t *mac, int64_t now) {
+    rel_owed_t *o = owed_find(mac, now);
+
+    if (o == NULL) {
+        // An idle entry, or else the one closest to giving up
+        o = &s_owed[0];
+        for (int i = 1; i < RELIABLE_MAX_FRAMES && owed_active(o, now); i++) {
+            if (!owed_active(&s_owed[i], now) || s_owed[i].expire_us < o->expire_us) {
+                o = &s_owed[i];
+            }
+        }
+        memcpy(o->mac, mac, ESP_NOW_ETH_ALEN);
+        o->count = 0;
+    }
+    if (o->count < UINT8_MAX) {
+        o->count++;
+    }
+    o->expire_us = now + RELIABLE_SEND_TIMEOUT_US;
+}
+
+static int count_frames(const uint8_t *mac, bool inflight_only) {
+    int n = 0;
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        const rel_frame_t *f = &s_frames[i];
+        if (f->state == FRAME_FREE || (inflight_only && f->state != FRAME_INFLIGHT)) {
+            continue;
+        }
+        if (memcmp(f->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Oldest submitted frame that is ready to go now, honouring the per-peer
+   limit and holding peers that still owe callbacks. */
+static rel_frame_t *next_ready(int64_t now) {
+    rel_frame_t *best = NULL;
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        rel_frame_t *f = &s_frames[i];
+        if (f->state != FRAME_READY || f->due_us > now) {
+            continue;
+        }
+        if (best && (int32_t)(f->queued_seq - best->queued_seq) >= 0) {
+            continue;
+        }
+        if (count_frames(f->mac, true) >= RELIABLE_INFLIGHT || owed_find(f->mac, now) != NULL) {
+            continue;
+        }
+        best = f;
+    }
+    return best;
+}
+
+/* Hand every sendable frame to the driver and re-arm the retry timer for the
+   earliest backoff. Called with s_lock held. */
+static void pump_locked(void) {
+    int64_t now = esp_timer_get_time();
+    int64_t next_due = INT64_MAX;
+    rel_frame_t *f;
+
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        f = &s_frames[i];
+        if (f->state == FRAME_INFLIGHT && now - f->sent_us >= RELIABLE_SEND_TIMEOUT_US) {
+            ESP_LOGW(TAG, "No send result for "MACSTR", attempt %u", MAC2STR(f->mac), f->attempts);
+            s_stats.timeouts++;
+            owed_add(f->mac, now);
+            frame_failed(f, now);
+        }
+    }
+
+    while ((f = next_ready(now)) != NULL) {
+        esp_err_t err = peer_registry_acquire_slot(f->mac);
+        f->attempts++;
+        if (f->attempts > 1) {
+            s_stats.retries++;
+        }
+        if (err == ESP_OK) {
+            f->state = FRAME_INFLIGHT;
+            f->sent_seq = s_sent_seq++;
+            f->sent_us = now;
+            err = esp_now_send(f->mac, f->data, f->len);
+            if (err != ESP_OK) {
+                f->state = FRAME_READY;
+            }
+        }
+        if (err == ESP_OK) {
+            gateway_stats_inc(GATEWAY_STAT_TX_FRAMES);
+            gateway_stats_add(GATEWAY_STAT_TX_BYTES, f->len);
+        } else {
+            ESP_LOGD(TAG, "Send to "MACSTR" failed: %s", MAC2STR(f->mac), esp_err_to_name(err));
+            gateway_stats_inc(GATEWAY_STAT_TX_FAIL);
+            frame_failed(f, now);
+        }
+    }
+
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        f = &s_frames[i];
+        int64_t due = f->state == FRAME_READY ? f->due_us :
+                      f->state == FRAME_INFLIGHT ? f->sent_us + RELIABLE_SEND_TIMEOUT_US : INT64_MAX;
+        // Frames blocked only by the in-flight limit are due already; the send
+        // callback or the timeout of the frame blocking them pumps those.
+        if (due > now && due < next_due) {
+            next_due = due;
+        }
+    }
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        // Held peers resume when their owed callbacks are given up on
+        if (owed_active(&s_owed[i], now) && s_owed[i].expire_us < next_due) {
+            next_due = s_owed[i].expire_us;
+        }
+    }
+    esp_timer_stop(s_retry_timer);
+    if (next_due != INT64_MAX) {
+        esp_timer_start_once(s_retry_timer, next_due - now);
+    }
+}
+
+static void retry_timer_cb(void *arg) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    pump_locked();
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t espnow_reliable_init(void) {
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_timer_cb,
+        .name = "espnow_retry",
+    };
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_frames, 0, sizeof(s_frames));
+    memset(s_owed, 0, sizeof(s_owed));
+    memset(&s_stats, 0, sizeof(s_stats));
+    return esp_timer_create(&timer_args, &s_retry_timer);
+}
+
+esp_err_t espnow_reliable_send(const uint8_t *mac, uint8_t *frame, size_t len, uint32_t ref) {
+    rel_frame_t *f = NULL;
+
+    if (len > ESP_NOW_MAX_DATA_LEN_V2) {
+        free(frame);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        if (s_frames[i].state == FRAME_FREE) {
+            f = &s_frames[i];
+            break;
+        }
+    }
+    if (f == NULL) {
+        s_stats.rejected++;
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "No free reliable frame for "MACSTR, MAC2STR(mac));
+        free(frame);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(f->mac, mac, ESP_NOW_ETH_ALEN);
+    f->data = frame;
+    f->len = len;
+    f->ref = ref;
+    f->attempts = 0;
+    f->queued_seq = s_queued_seq++;
+    f->due_us = 0;
+    f->state = FRAME_READY;
+    s_stats.submitted++;
+    s_stats.pending++;
+    pump_locked();
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+bool espnow_reliable_has_room(const uint8_t *mac) {
+    bool room;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    room = s_stats.pending < RELIABLE_MAX_FRAMES && count_frames(mac, false) < RELIABLE_INFLIGHT &&
+           owed_find(mac, esp_timer_get_time()) == NULL;
+    xSemaphoreGive(s_lock);
+    return room;
+}
+
+void espnow_reliable_set_release_cb(void (*cb)(void)) {
+    s_release_cb = cb;
+}
+
+void espnow_reliable_on_send_cb(const uint8_t *mac, esp_now_send_status_t status) {
+    rel_frame_t *f = NULL;
+    rel_owed_t *o;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    o = owed_find(mac, esp_timer_get_time());
+    if (o != NULL) {
+        // Late result of a timed-out attempt: it belongs to no frame in flight
+        o->count--;
+        s_stats.late_results++;
+        if (o->count == 0) {
+            pump_locked();
+        }
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    for (int i = 0; i < RELIABLE_MAX_FRAMES; i++) {
+        rel_frame_t *c = &s_frames[i];
+        if (c->state != FRAME_INFLIGHT || memcmp(c->mac, mac, ESP_NOW_ETH_ALEN) != 0) {
+            continue;
+        }
+        if (f == NULL || (int32_t)(c->sent_seq - f->sent_seq) < 0) {
+            f = c;
+        }
+    }
+    if (f != NULL) {
+        if (status == ESP_NOW_SEND_SUCCESS) {
+            s_stats.delivered++;
+            report(f, true);
+            frame_release(f);
+        } else {
+            frame_failed(f, esp_timer_get_time());
+        }
+        pump_locked();
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void espnow_reliable_get_stats(espnow_reliable_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,360 @@
+/* ESPNOW_SCHED.C
+   Outbound scheduler
+
+   Frames for client nodes are queued per peer in three priority lanes
+   (control, config, bulk) and sent by one scheduler task instead of the
+   caller. The highest non-empty class always goes first; within a class peers
+   are served round robin, so one busy node cannot starve the others. Sends
+   are spaced by a fixed gap plus the frame's airtime at the configured PHY
+   rate. Queued frames are bounded both in count and in bytes.
+
+   With reliable unicast a peer is only served while its reliable window has
+   room, so the backlog stays here where it can still be reordered by class.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "peer_registry.h"
+#include "espnow_reliable.h"
+#include "espnow_sched.h"
+#include "gateway_stats.h"
+#include "gateway_pipeline.h"
+
+static const char *TAG = "espnow_sched";
+
+#define SCHED_QUEUE_FRAMES        CONFIG_GATEWAY_TX_QUEUE_FRAMES
+#define SCHED_QUEUE_BYTES         CONFIG_GATEWAY_TX_QUEUE_BYTES
+#define SCHED_PEERS               CONFIG_GATEWAY_TX_SCHED_PEERS
+#define SCHED_PACING_US           CONFIG_GATEWAY_TX_PACING_US
+#define SCHED_AIRTIME_KBPS        CONFIG_GATEWAY_TX_AIRTIME_KBPS
+
+typedef struct {
+    int16_t next;
+    uint16_t len;
+    uint8_t *data;
+    uint32_t ref;
+    int64_t queued_us;
+} tx_node_t;
+
+typedef struct {
+    bool in_use;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t queued;
+    int16_t head[ESPNOW_TX_CLASS_MAX];
+    int16_t tail[ESPNOW_TX_CLASS_MAX];
+} tx_peer_t;
+
+static const uint8_t s_bcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static tx_node_t s_nodes[SCHED_QUEUE_FRAMES];
+static int16_t s_free_node;
+static tx_peer_t s_peers[SCHED_PEERS];
+static int s_rr;
+static espnow_sched_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+static esp_timer_handle_t s_pace_timer = NULL;
+
+static bool is_broadcast(const uint8_t *mac) {
+    return memcmp(mac, s_bcast, ESP_NOW_ETH_ALEN) == 0;
+}
+
+static tx_peer_t *peer_find(const uint8_t *mac, bool create) {
+    tx_peer_t *empty = NULL;
+    for (int i = 0; i < SCHED_PEERS; i++) {
+        if (!s_peers[i].in_use) {
+            if (empty == NULL) {
+                empty = &s_peers[i];
+            }
+        } else if (memcmp(s_peers[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return &s_peers[i];
+        }
+    }
+    if (!create || empty == NULL) {
+        return NULL;
+    }
+    empty->in_use = true;
+    memcpy(empty->mac, mac, ESP_NOW_ETH_ALEN);
+    empty->queued = 0;
+    for (int c = 0; c < ESPNOW_TX_CLASS_MAX; c++) {
+        empty->head[c] = -1;
+        empty->tail[c] = -1;
+    }
+    s_stats.peers++;
+    return empty;
+}
+
+/* Whether the head of a lane may be sent now. */
+static bool peer_can_send(const tx_peer_t *p) {
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+    if (!is_broadcast(p->mac)) {
+        return espnow_reliable_has_room(p->mac);
+    }
+#endif
+    return true;
+}
+
+/* Take the next frame to send, or return false if nothing can go now.
+   Called with s_lock held. */
+static bool sched_pop(uint8_t *mac, tx_node_t *out) {
+    for (int c = 0; c < ESPNOW_TX_CLASS_MAX; c++) {
+        for (int k = 1; k <= SCHED_PEERS; k++) {
+            int i = (s_rr + k) % SCHED_PEERS;
+            tx_peer_t *p = &s_peers[i];
+            if (!p->in_use || p->head[c] < 0 || !peer_can_send(p)) {
+                continue;
+            }
+
+            int16_t n = p->head[c];
+            p->head[c] = s_nodes[n].next;
+            if (p->head[c] < 0) {
+                p->tail[c] = -1;
+            }
+            *out = s_nodes[n];
+            memcpy(mac, p->mac, ESP_NOW_ETH_ALEN);
+            s_nodes[n].data = NULL;
+            s_nodes[n].next = s_free_node;
+            s_free_node = n;
+            s_rr = i;
+
+            uint32_t wait = (uint32_t)(esp_timer_get_time() - out->queued_us);
+            espnow_sched_class_stats_t *cs = &s_stats.cls[c];
+            cs->depth--;
+            cs->sent++;
+            cs->wait_total_us += wait;
+            if (wait > cs->wait_max_us) {
+                cs->wait_max_us = wait;
+            }
+            s_stats.queued_bytes -= out->len;
+            if (--p->queued == 0) {
+                p->in_use = false;
+                s_stats.peers--;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sched_dispatch(const uint8_t *mac, uint8_t *data, size_t len, uint32_t ref) {
+    esp_err_t err = ESP_OK;
+
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+    if (!is_broadcast(mac)) {
+        // The reliable queue owns the buffer from here on
+        espnow_reliable_send(mac, data, len, ref);
+        return;
+    }
+#else
+    (void)ref;
+#endif
+    if (!is_broadcast(mac)) {
+        err = peer_registry_acquire_slot(mac);
+    }
+    if (err == ESP_OK) {
+        err = esp_now_send(mac, data, len);
+    }
+    if (err == ESP_OK) {
+        gateway_stats_inc(GATEWAY_STAT_TX_FRAMES);
+        gateway_stats_add(GATEWAY_STAT_TX_BYTES, len);
+    } else {
+        ESP_LOGE(TAG, "Send to "MACSTR" failed: %s", MAC2STR(mac), esp_err_to_name(err));
+        gateway_stats_inc(GATEWAY_STAT_TX_FAIL);
+    }
+    free(data);
+}
+
+static void pace_timer_cb(void *arg) {
+    xTaskNotifyGive(s_task);
+}
+
+static void sched_task(void *arg) {
+    int64_t next_send_us = 0;
+
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        tx_node_t node;
+        bool have;
+
+        if (now < next_send_us) {
+            esp_timer_stop(s_pace_timer);
+            esp_timer_start_once(s_pace_timer, next_send_us - now);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        have = sched_pop(mac, &node);
+        xSemaphoreGive(s_lock);
+        if (!have) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        sched_dispatch(mac, node.data, node.len, node.ref);
+        next_send_us = esp_timer_get_time() + SCHED_PACING_US +
+                       (int64_t)node.len * 8000 / SCHED_AIRTIME_KBPS;
+    }
+}
+
+esp_err_t espnow_sched_init(void) {
+    const esp_timer_create_args_t timer_args = {
+        .callback = pace_timer_cb,
+        .name = "espnow_pace",
+    };
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < SCHED_QUEUE_FRAMES; i++) {
+        s_nodes[i].data = NULL;
+        s_nodes[i].next = (i + 1 < SCHED_QUEUE_FRAMES) ? i + 1 : -1;
+    }
+    s_free_node = 0;
+    memset(s_peers, 0, sizeof(s_peers));
+    memset(&s_stats, 0, sizeof(s_stats));
+    esp_err_t err = esp_timer_create(&timer_args, &s_pace_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (GATEWAY_TASK_CREATE(sched_task, "espnow_sched", CONFIG_EXAMPLE_TASK_STACK_SIZE, GATEWAY_SCHED_TASK_PRIO,
+                            &s_task, GATEWAY_RADIO_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Create task fail");
+        return ESP_FAIL;
+    }
+    gateway_stats_watch_task(s_task);
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+    espnow_reliable_set_release_cb(espnow_sched_kick);
+#endif
+    return ESP_OK;
+}
+
+esp_err_t espnow_sched_submit(const uint8_t *mac, uint8_t *frame, size_t len, espnow_tx_class_t cls, uint32_t ref) {
+    uint16_t len16 = len;
+
+    if (len > UINT16_MAX) {
+        free(frame);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return espnow_sched_submit_all(mac, &frame, &len16, 1, cls, ref);
+}
+
+esp_err_t espnow_sched_submit_all(const uint8_t *mac, uint8_t *const *frames, const uint16_t *lens, size_t count,
+                                  espnow_tx_class_t cls, uint32_t ref) {
+    esp_err_t ret = ESP_OK;
+    tx_peer_t *p = NULL;
+    size_t bytes = 0;
+    size_t free_nodes = 0;
+
+    if (cls >= ESPNOW_TX_CLASS_MAX) {
+        cls = ESPNOW_TX_BULK;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bytes += lens[i];
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int16_t n = s_free_node; n >= 0 && free_nodes < count; n = s_nodes[n].next) {
+        free_nodes++;
+    }
+    if (free_nodes < count || s_stats.queued_bytes + bytes > SCHED_QUEUE_BYTES ||
+        (p = peer_find(mac, true)) == NULL) {
+        s_stats.cls[cls].dropped += count;
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            int16_t n = s_free_node;
+            s_free_node = s_nodes[n].next;
+            s_nodes[n].next = -1;
+            s_nodes[n].data = frames[i];
+            s_nodes[n].len = lens[i];
+            s_nodes[n].ref = ref;
+            s_nodes[n].queued_us = esp_timer_get_time();
+            if (p->tail[cls] >= 0) {
+                s_nodes[p->tail[cls]].next = n;
+            } else {
+                p->head[cls] = n;
+            }
+            p->tail[cls] = n;
+            p->queued++;
+            s_stats.queued_bytes += lens[i];
+            if (++s_stats.cls[cls].depth > s_stats.cls[cls].high_water) {
+                s_stats.cls[cls].high_water = s_stats.cls[cls].depth;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "TX queue full, dropped %u frame(s) for "MACSTR, (unsigned)count, MAC2STR(mac));
+        for (size_t i = 0; i < count; i++) {
+            free(frames[i]);
+        }
+        return ret;
+    }
+    espnow_sched_kick();
+    return ESP_OK;
+}
+
+void espnow_sched_kick(void) {
+    if (s_task) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+void espnow_sched_get_stats(espnow_sched_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+int espnow_sched_stats_json(char *out, size_t out_size) {
+    static const char *const names[ESPNOW_TX_CLASS_MAX] = {"control", "config", "bulk"};
+    espnow_sched_stats_t st;
+    size_t pos;
+    int n;
+
+    espnow_sched_get_stats(&st);
+    n = snprintf(out, out_size, "{\"type\":\"sched_stats\",\"queued_bytes\":%" PRIu32 ",\"peers\":%" PRIu32 ",\"classes\":[",
+                 st.queued_bytes, st.peers);
+    if (n < 0 || (size_t)n >= out_size) {
+        return -1;
+    }
+    pos = n;
+    for (int c = 0; c < ESPNOW_TX_CLASS_MAX; c++) {
+        const espnow_sched_class_stats_t *cs = &st.cls[c];
+        uint32_t avg = cs->sent ? (uint32_t)(cs->wait_total_us / cs->sent) : 0;
+        n = snprintf(out + pos, out_size - pos,
+                     "%s{\"class\":\"%s\",\"depth\":%" PRIu32 ",\"high_water\":%" PRIu32 ",\"sent\":%" PRIu32
+                     ",\"dropped\":%" PRIu32 ",\"wait_avg_us\":%" PRIu32 ",\"wait_max_us\":%" PRIu32 "}",
+                     c ? "," : "", names[c], cs->depth, cs->high_water, cs->sent,
+                     cs->dropped, avg, cs->wait_max_us);
+        if (n < 0 || (size_t)n >= out_size - pos) {
+            return -1;
+        }
+        pos += n;
+    }
+    n = snprintf(out + pos, out_size - pos, "]}");
+    if (n < 0 || (size_t)n >= out_size - pos) {
+        return -1;
+    }
+    return pos + n;
+}
@@ -0,0 +1,167 @@
+/* ESPNOW_SEQ.C
+   Per-node sequence tracking
+
+   Clients that send the extended header number their frames. For every node
+   the gateway remembers the newest sequence number and a bitmap of the
+   ESPNOW_SEQ_WINDOW numbers before it. A number already in the window is a
+   MAC-layer retransmit or client retry and is dropped before it reaches the
+   host; a number that skips ahead counts the skipped ones as lost until they
+   turn up late, which then counts as reordering. A number far behind the
+   window, or more than ESPNOW_SEQ_MAX_GAP ahead of it, means the node
+   restarted from a new random number, and its state is reset rather than
+   the jump being counted as loss.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "host_proto.h"
+#include "espnow_seq.h"
+
+static const char *TAG = "espnow_seq";
+
+typedef struct {
+    bool in_use;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t top;                         // Newest sequence number seen.
+    uint32_t window;                      // Bit n set: top - n was received.
+    uint32_t last_used;                   // Value of s_clock at the last frame.
+    uint32_t received;
+    uint32_t duplicates;
+    uint32_t lost;                        // Skipped numbers not (yet) received.
+    uint32_t reordered;                   // Numbers received after a newer one.
+    uint32_t resets;                      // Sequence restarts, e.g. node reboot.
+} seq_node_t;
+
+static seq_node_t s_nodes[ESPNOW_SEQ_PEERS];
+static uint32_t s_clock;
+static espnow_seq_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+
+static void node_start(seq_node_t *n, uint16_t seq) {
+    n->top = seq;
+    n->window = 1;
+}
+
+/* Node entry for mac, taking over the least recently used one if needed. */
+static seq_node_t *node_get(const uint8_t *mac) {
+    seq_node_t *lru = &s_nodes[0];
+
+    for (int i = 0; i < ESPNOW_SEQ_PEERS; i++) {
+        seq_node_t *n = &s_nodes[i];
+        if (n->in_use && memcmp(n->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return n;
+        }
+        if (!n->in_use) {
+            if (lru->in_use) {
+                lru = n;
+            }
+        } else if (lru->in_use && n->last_used < lru->last_used) {
+            lru = n;
+        }
+    }
+    if (lru->in_use) {
+        ESP_LOGD(TAG, "Evict node "MACSTR, MAC2STR(lru->mac));
+        s_stats.evictions++;
+    } else {
+        s_stats.tracked++;
+    }
+    memset(lru, 0, sizeof(*lru));
+    lru->in_use = true;
+    memcpy(lru->mac, mac, ESP_NOW_ETH_ALEN);
+    return lru;
+}
+
+esp_err_t espnow_seq_init(void) {
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_nodes, 0, sizeof(s_nodes));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_clock = 0;
+    return ESP_OK;
+}
+
+bool espnow_seq_check(const uint8_t *mac, uint16_t seq) {
+    bool fresh = true;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    seq_node_t *n = node_get(mac);
+    n->last_used = ++s_clock;
+
+    if (n->received == 0 && n->duplicates == 0) {
+        node_start(n, seq);
+    } else {
+        int16_t diff = (int16_t)(seq - n->top);
+        if (diff > 0 && diff <= ESPNOW_SEQ_MAX_GAP) {
+            n->lost += diff - 1;
+            n->window = (diff < ESPNOW_SEQ_WINDOW) ? (n->window << diff) | 1 : 1;
+            n->top = seq;
+        } else if (diff <= 0 && diff > -ESPNOW_SEQ_WINDOW) {
+            uint32_t bit = 1UL << -diff;
+            if (n->window & bit) {
+                fresh = false;
+            } else {
+                n->window |= bit;
+                n->reordered++;
+                if (n->lost > 0) {
+                    n->lost--;
+                }
+            }
+        } else {
+            ESP_LOGI(TAG, "Sequence restart from "MACSTR" (%u after %u)", MAC2STR(mac), seq, n->top);
+            n->resets++;
+            node_start(n, seq);
+        }
+    }
+
+    if (fresh) {
+        n->received++;
+    } else {
+        n->duplicates++;
+        s_stats.duplicates++;
+    }
+    xSemaphoreGive(s_lock);
+    return fresh;
+}
+
+int espnow_seq_emit_stats(const uint8_t *mac) {
+    char reply[224];
+    int sent = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < ESPNOW_SEQ_PEERS; i++) {
+        const seq_node_t *n = &s_nodes[i];
+        if (!n->in_use || (mac && memcmp(n->mac, mac, ESP_NOW_ETH_ALEN) != 0)) {
+            continue;
+        }
+        int len = snprintf(reply, sizeof(reply),
+                           "{\"type\":\"link_stats\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"received\":%" PRIu32
+                           ",\"duplicates\":%" PRIu32 ",\"lost\":%" PRIu32 ",\"reordered\":%" PRIu32
+                           ",\"resets\":%" PRIu32 ",\"last_seq\":%u}",
+                           MAC2STR(n->mac), n->received, n->duplicates, n->lost, n->reordered,
+                           n->resets, n->top);
+        host_proto_emit_status(reply, len);
+        sent++;
+    }
+    xSemaphoreGive(s_lock);
+    return sent;
+}
+
+void espnow_seq_get_stats(espnow_seq_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
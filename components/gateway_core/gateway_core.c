@@ -0,0 +1,1004 @@
+/* GATEWAY_CORE.C
+   ESP-NOW gateway core
+
+   Everything between the ESP-NOW driver and the host serial port: receive
+   callbacks, frame parsing, forwarding to the host, register handling and the
+   outbound send path. The core only talks to esp_now_* and serial_port_*, so
+   the same code runs on a board and, with the mock driver in host/, on the
+   ESP-IDF linux target.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_crc.h"
+#include "cJSON.h"
+#include "espnow_example.h"
+#include "nvs_helper.h"
+#include "json_scan.h"
+#include "pkt_pool.h"
+#include "serial_port.h"
+#include "host_tx.h"
+#include "host_proto.h"
+#include "espnow_codec.h"
+#include "peer_registry.h"
+#include "espnow_reliable.h"
+#include "espnow_sched.h"
+#include "espnow_seq.h"
+#include "host_cmd.h"
+#include "gateway_stats.h"
+#include "gateway_trace.h"
+#include "node_liveness.h"
+#include "sensor_coalesce.h"
+#include "node_register.h"
+#include "spsc_ring.h"
+#include "espnow_frag.h"
+#include "ota_relay.h"
+#include "gateway_pipeline.h"
+#include "gateway_core.h"
+
+static const char *TAG = "gateway_core";
+
+/* How far into a JSON payload the receive callback looks for a control type. */
+#define RX_CLASSIFY_WINDOW          64
+
+static uint8_t s_my_mac[ESP_NOW_ETH_ALEN];
+uint8_t s_broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+/* The callbacks never block: send results, control events (register,
+   config_response) and periodic data travel in separate queues, and
+   espnow_task, woken by a task notification, drains them in that order.
+   Send results have a queue of their own with room for every reliable frame
+   in flight, so a registration storm filling the control queue can not cost
+   the reliable layer a result. */
+static QueueHandle_t s_send_queue = NULL;
+static QueueHandle_t s_ctrl_queue = NULL;
+#if CONFIG_GATEWAY_PIPELINE
+/* The Wi-Fi task is the only producer of data events, so they go through a
+   lock-free ring, and the callbacks only notify espnow_task while it sleeps. */
+static uint8_t s_data_ring_buf[SPSC_RING_SIZE(ESPNOW_DATA_QUEUE_SIZE, sizeof(espnow_event_t))] __attribute__((aligned(4)));
+static spsc_ring_t s_data_ring;
+static _Atomic bool s_espnow_idle;
+#else
+static QueueHandle_t s_data_queue = NULL;
+#endif
+static TaskHandle_t s_espnow_task = NULL;
+#if CONFIG_GATEWAY_FRAGMENTATION
+/* Header v2 counters of outgoing fragments, shared by all senders. */
+static _Atomic uint16_t s_tx_seq;
+static _Atomic uint16_t s_tx_msg_id;
+#endif
+
+void mac_from_str(const char *s, uint8_t *mac) {
+    unsigned int b[6] = {0};
+    if (sscanf(s, "%02x:%02x:%02x:%02x:%02x:%02x",
+               &b[0],&b[1],&b[2],&b[3],&b[4],&b[5]) == 6) {
+        for (int i=0;i<6;i++) mac[i] = (uint8_t)b[i];
+    } else {
+        memset(mac, 0, 6);
+    }
+}
+
+/* ------------ helpers ------------- */
+void mac_to_str(const uint8_t *mac, char *str, size_t len) {
+    snprintf(str, len, "%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+// bool is_broadcast_mac(const uint8_t *mac) {
+//     return memcmp(mac, s_broadcast_mac, ESP_NOW_ETH_ALEN) == 0;
+// }
+
+/* Events queued before espnow_task exists are picked up when it starts. */
+static void espnow_task_wake(void)
+{
+#if CONFIG_GATEWAY_PIPELINE
+    // Pairs with the fence in espnow_task_sleep: either the task sees the
+    // new event, or this sees it going to sleep
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&s_espnow_idle, memory_order_relaxed)) {
+        return;
+    }
+#endif
+    if (s_espnow_task) {
+        xTaskNotifyGive(s_espnow_task);
+    }
+}
+
+/* ESPNOW sending callback function. Runs in the Wi-Fi task and never blocks. */
+static void espnow_send_cb(const esp_now_send_info_t *tx_info, esp_now_send_status_t status)
+{
+    espnow_event_t evt;
+    espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
+
+    if (tx_info == NULL) {
+        ESP_LOGE(TAG, "Send cb arg error");
+        return;
+    }
+
+    evt.id = ESPNOW_SEND_CB;
+    memcpy(send_cb->mac_addr, tx_info->des_addr, ESP_NOW_ETH_ALEN);
+    send_cb->status = status;
+    
+    if (status != ESP_NOW_SEND_SUCCESS) {
+        gateway_stats_inc(GATEWAY_STAT_SEND_CB_FAIL);
+    }
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+    // Only unicast results feed the reliable layer; the reserve is theirs
+    if (IS_BROADCAST_ADDR(send_cb->mac_addr) && uxQueueSpacesAvailable(s_send_queue) <= ESPNOW_RELIABLE_MAX_FRAMES) {
+        gateway_stats_inc(GATEWAY_STAT_SEND_RESULT_DROPPED);
+        return;
+    }
+#endif
+    if (xQueueSend(s_send_queue, &evt, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Send result queue fail");
+        gateway_stats_inc(GATEWAY_STAT_SEND_RESULT_DROPPED);
+        return;
+    }
+    espnow_task_wake();
+}
+
+
+/* ------------- ESPNOW receive callback (from gateway or other) ------------- */
+void espnow_register_cmd_handler(const cJSON *root) {
+    // Handle register requests and other broadcast commands from an already parsed message
+    if (root) {
+        cJSON *type = cJSON_GetObjectItem(root, "type");
+        if (cJSON_IsString(type)) {
+            if (strcmp(type->valuestring, "register") == 0) {
+                cJSON *mac_addr = cJSON_GetObjectItem(root, "mac");
+                if (mac_addr && cJSON_IsString(mac_addr)) {
+                    uint8_t target[6];
+                    mac_from_str(mac_addr->valuestring, target);
+#if CONFIG_GATEWAY_REGISTER_PACING
+                    // Acked later by unicast, see node_register.c
+                    node_register_request(target);
+#else
+                    //reply with gateway MAC
+                    char mymac[18];
+                    // Add peer if not exists; it is loaded while the driver has free slots
+                    bool is_new = false;
+                    if (peer_registry_add(target, &is_new) == ESP_OK) {
+                        peer_registry_preload(target);
+                        if (is_new) {
+                            ESP_LOGI(TAG, "Adding peer "MACSTR, MAC2STR(target));
+                            nvs_store_peer_mac(target);
+                        }
+                    }
+                    cJSON *o = cJSON_CreateObject();
+                    cJSON_AddStringToObject(o, "type", "register_ack");
+                    mac_to_str(s_my_mac, mymac, sizeof(mymac));
+                    cJSON_AddStringToObject(o, "mac", mymac);
+                    ESP_LOGI(TAG, "Registering gateway MAC %s to node "MACSTR, mymac, MAC2STR((uint8_t*)target));
+                    espnow_send_json(s_broadcast_mac, o, ESPNOW_TX_CONTROL, 0);
+                    cJSON_Delete(o);
+#endif
+                }
+            } 
+            // else if (strcmp(type->valuestring, "set_config")==0) {
+            //     cJSON *pl = cJSON_GetObjectItem(root, "payload");
+            //     if (pl) {
+            //         cJSON *it = pl->child;
+            //         while (it) {
+            //             if (cJSON_IsNumber(it)) {
+            //                 // accept cfg0..cfg4
+            //                 if (strncmp(it->string, "cfg", 3) == 0) {
+            //                     // parse index
+            //                     int idx = atoi(it->string + 3);
+            //                     if (idx >= 0 && idx < CFG_COUNT) {
+            //                         nvs_set_cfg(idx, it->valueint);
+            //                         ESP_LOGI(TAG, "Updated %s = %d", it->string, it->valueint);
+            //                     }
+            //                 }
+            //             }
+            //             it = it->next;
+            //         }
+            //     }
+            // }
+        }
+    }
+}
+
+/* Forward a client JSON payload to the host.
+   In passthrough mode unicast payloads are only scanned, never parsed, and the
+   received bytes are written out unchanged. Broadcasts are parsed once and the
+   same tree is handed to espnow_register_cmd_handler. With node liveness,
+   heartbeats from tracked nodes stop here, and with sensor coalescing so do
+   repeated sensor events. */
+static void espnow_forward_json(const uint8_t *mac_addr, uint8_t data_type, const char *json, size_t len)
+{
+    len = json_scan_trim(json, len);
+
+#if CONFIG_GATEWAY_NODE_LIVENESS
+    json_span_t type;
+    if (data_type == ESPNOW_DATA_UNICAST && json_scan_get_member(json, len, "type", &type) &&
+        json_span_equals(&type, "heartbeat") && node_liveness_absorb_heartbeat(mac_addr)) {
+        ESP_LOGD(TAG, "Heartbeat from: "MACSTR"", MAC2STR(mac_addr));
+        return;
+    }
+#endif
+#if CONFIG_GATEWAY_SENSOR_COALESCE
+    if (data_type == ESPNOW_DATA_UNICAST && sensor_coalesce_event(mac_addr, json, len)) {
+        return;
+    }
+#endif
+
+#if CONFIG_GATEWAY_JSON_PASSTHROUGH
+    bool single_line = false;
+    if (data_type == ESPNOW_DATA_UNICAST) {
+        if (json_scan_object(json, len, &single_line) && single_line) {
+            ESP_LOGD(TAG, "Received JSON: %.*s", (int)len, json);
+            host_proto_emit_node(mac_addr, json, len);
+            return;
+        }
+    }
+#endif
+
+    cJSON *root = cJSON_ParseWithLength(json, len);
+    if (root == NULL) {
+        ESP_LOGI(TAG, "Received data (not JSON): %.*s", (int)len, json);
+        return;
+    }
+
+#if CONFIG_GATEWAY_JSON_PASSTHROUGH
+    single_line = (memchr(json, '\n', len) == NULL && memchr(json, '\r', len) == NULL);
+    if (single_line) {
+        ESP_LOGD(TAG, "Received JSON: %.*s", (int)len, json);
+        host_proto_emit_node(mac_addr, json, len);
+    } else
+#endif
+    {
+        char *printed = cJSON_PrintUnformatted(root);
+        if (printed) {
+            ESP_LOGD(TAG, "Received JSON: %s", printed);
+            host_proto_emit_node(mac_addr, printed, strlen(printed));
+            free(printed);
+        }
+    }
+
+    if (data_type == ESPNOW_DATA_BROADCAST) {
+        espnow_register_cmd_handler(root);
+    }
+    cJSON_Delete(root);
+}
+
+
+/* Transcode a compact payload to the client's JSON form and forward it like a
+   text payload. Register requests are routed as broadcasts. */
+static void espnow_forward_compact(const uint8_t *mac_addr, const uint8_t *data, size_t len)
+{
+    char json[ESPNOW_CODEC_JSON_MAX];
+    uint8_t msg_type;
+    int json_len = espnow_codec_to_json(mac_addr, data, len, json, sizeof(json), &msg_type);
+
+    if (json_len < 0) {
+        ESP_LOGI(TAG, "Invalid compact data from: "MACSTR"", MAC2STR(mac_addr));
+        return;
+    }
+    espnow_forward_json(mac_addr, msg_type == ESPNOW_MSG_REGISTER ? ESPNOW_DATA_BROADCAST : ESPNOW_DATA_UNICAST,
+                        json, json_len);
+}
+
+/* Split an aggregated payload into its records and forward each one as if it
+   had arrived in a frame of its own. Stops at the first malformed record. */
+static void espnow_forward_aggregate(const uint8_t *mac_addr, const uint8_t *data, size_t len)
+{
+    int records = 0;
+
+    while (len > 0) {
+        const espnow_aggr_hdr_t *rec = (const espnow_aggr_hdr_t *)data;
+        if (len < sizeof(espnow_aggr_hdr_t) || rec->len > len - sizeof(espnow_aggr_hdr_t)) {
+            ESP_LOGI(TAG, "Truncated aggregate record %d from: "MACSTR"", records, MAC2STR(mac_addr));
+            break;
+        }
+        const uint8_t *body = data + sizeof(espnow_aggr_hdr_t);
+        if (rec->len > 0) {
+            if (rec->type == ESPNOW_DATA_COMPACT) {
+                espnow_forward_compact(mac_addr, body, rec->len);
+            } else if (rec->type == ESPNOW_DATA_BROADCAST || rec->type == ESPNOW_DATA_UNICAST) {
+                espnow_forward_json(mac_addr, rec->type, (const char *)body, rec->len);
+            } else {
+                ESP_LOGI(TAG, "Bad aggregate record type %d from: "MACSTR"", rec->type, MAC2STR(mac_addr));
+            }
+        }
+        data = body + rec->len;
+        len -= sizeof(espnow_aggr_hdr_t) + rec->len;
+        records++;
+    }
+    ESP_LOGD(TAG, "Aggregate of %d records from: "MACSTR"", records, MAC2STR(mac_addr));
+}
+
+/* True if needle occurs in the first bytes of data. */
+static bool rx_window_contains(const uint8_t *data, size_t len, const char *needle)
+{
+    size_t n = strlen(needle);
+
+    if (len > RX_CLASSIFY_WINDOW) {
+        len = RX_CLASSIFY_WINDOW;
+    }
+    for (size_t i = 0; i + n <= len; i++) {
+        if (data[i] == (uint8_t)needle[0] && memcmp(data + i, needle, n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Length of an extended header, which grew with v2. */
+static size_t espnow_ext_hdr_len(const espnow_data_ext_t *ext)
+{
+    return ext->version >= ESPNOW_HDR_V2 ? sizeof(espnow_data_v2_t) : sizeof(espnow_data_ext_t);
+}
+
+/* Classify a received frame for the event queues. Only the header and the
+   start of the payload are looked at; the CRC is checked later by
+   espnow_task. Aggregates carry periodic records and count as data, and so
+   do all fragments but the first. */
+static bool espnow_rx_is_control(const uint8_t *data, int len)
+{
+    size_t off = sizeof(espnow_data_t);
+    uint8_t type = data[0];
+
+    if (type & ESPNOW_DATA_EXT) {
+        const espnow_data_v2_t *v2 = (const espnow_data_v2_t *)data;
+        if (len < (int)sizeof(espnow_data_ext_t)) {
+            return false;
+        }
+        type &= ~ESPNOW_DATA_EXT;
+        off = espnow_ext_hdr_len((const espnow_data_ext_t *)data);
+        if (v2->version >= ESPNOW_HDR_V2 && len >= (int)off && (v2->flags & ESPNOW_FLAG_FRAGMENT) &&
+            v2->frag_idx != 0) {
+            return false;
+        }
+    }
+    if (len <= (int)off) {
+        return false;
+    }
+    const uint8_t *payload = data + off;
+    size_t payload_len = len - off;
+
+    switch (type) {
+        case ESPNOW_DATA_BROADCAST:
+            return true; // register
+        case ESPNOW_DATA_COMPACT:
+            return payload_len >= 3 && payload[0] == ESPNOW_TLV_MSG_TYPE &&
+                   (payload[2] == ESPNOW_MSG_REGISTER || payload[2] == ESPNOW_MSG_CONFIG_RESPONSE);
+        case ESPNOW_DATA_UNICAST:
+            return rx_window_contains(payload, payload_len, "\"config_response\"") ||
+                   rx_window_contains(payload, payload_len, "\"register\"");
+        default:
+            return false;
+    }
+}
+
+#if CONFIG_GATEWAY_PIPELINE
+/* Only espnow_task takes from the data ring, so nothing is evicted. */
+static bool espnow_drop_oldest_data(void)
+{
+    return false;
+}
+
+static bool espnow_queue_data(const espnow_event_t *evt)
+{
+    espnow_event_t *slot = spsc_ring_acquire(&s_data_ring, sizeof(espnow_event_t));
+
+    if (slot == NULL) {
+        return false;
+    }
+    *slot = *evt;
+    spsc_ring_commit(&s_data_ring, slot);
+    return true;
+}
+
+static uint32_t espnow_data_waiting(void)
+{
+    return spsc_ring_used(&s_data_ring) / SPSC_RING_RECORD_SIZE(sizeof(espnow_event_t));
+}
+#else
+/* Throw away the oldest queued data frame and return its block to the pool. */
+static bool espnow_drop_oldest_data(void)
+{
+    espnow_event_t old;
+
+    if (xQueueReceive(s_data_queue, &old, 0) != pdTRUE) {
+        return false;
+    }
+    pkt_pool_give(old.info.recv_cb.data);
+    GATEWAY_TRACE_DROP(old.info.recv_cb.trace_id);
+    gateway_stats_inc(GATEWAY_STAT_DATA_DROPPED);
+    return true;
+}
+
+static bool espnow_queue_data(const espnow_event_t *evt)
+{
+    bool queued = xQueueSend(s_data_queue, evt, 0) == pdTRUE;
+#if CONFIG_GATEWAY_RX_DROP_OLDEST
+    if (!queued && espnow_drop_oldest_data()) {
+        queued = xQueueSend(s_data_queue, evt, 0) == pdTRUE;
+    }
+#endif
+    return queued;
+}
+
+static uint32_t espnow_data_waiting(void)
+{
+    return uxQueueMessagesWaiting(s_data_queue);
+}
+#endif
+
+/* ESPNOW receiving callback function. Runs in the Wi-Fi task and never blocks. */
+static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    espnow_event_t evt;
+    espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
+    bool control;
+    bool queued;
+
+    ESP_LOGD(TAG, "espnow_recv_cb called, len=%d", len);
+    if (recv_info->src_addr == NULL || data == NULL || len <= 0) {
+        ESP_LOGE(TAG, "Receive cb arg error");
+        gateway_stats_inc(GATEWAY_STAT_RX_INVALID);
+        return;
+    }
+    recv_cb->trace_id = GATEWAY_TRACE_RX(recv_info->src_addr, len);
+
+    if (len > PKT_POOL_BLOCK_SIZE || len < (int)sizeof(espnow_data_t)) {
+        ESP_LOGE(TAG, "Receive data bad length, len:%d", len);
+        gateway_stats_inc(GATEWAY_STAT_RX_INVALID);
+        GATEWAY_TRACE_DROP(recv_cb->trace_id);
+        return;
+    }
+    control = espnow_rx_is_control(data, len);
+
+    evt.id = ESPNOW_RECV_CB;
+    memcpy(recv_cb->mac_addr, recv_info->src_addr, ESP_NOW_ETH_ALEN);
+    recv_cb->data = pkt_pool_take();
+    if (recv_cb->data == NULL && control && espnow_drop_oldest_data()) {
+        // Periodic data gives up its block so a registration still gets through
+        recv_cb->data = pkt_pool_take();
+    }
+    
+    if (recv_cb->data == NULL) {
+        ESP_LOGE(TAG, "Receive pool exhausted");
+        gateway_stats_inc(GATEWAY_STAT_ALLOC_FAIL);
+        GATEWAY_TRACE_DROP(recv_cb->trace_id);
+        return;
+    }
+    
+    memcpy(recv_cb->data, data, len);
+    recv_cb->data_len = len;
+
+    if (control) {
+        queued = xQueueSend(s_ctrl_queue, &evt, 0) == pdTRUE;
+        if (!queued) {
+            gateway_stats_inc(GATEWAY_STAT_CTRL_QUEUE_FULL);
+        }
+    } else {
+        queued = espnow_queue_data(&evt);
+        if (!queued) {
+            gateway_stats_inc(GATEWAY_STAT_DATA_DROPPED);
+        }
+    }
+    if (!queued) {
+        ESP_LOGD(TAG, "Receive %s queue full", control ? "control" : "data");
+        pkt_pool_give(recv_cb->data);
+        GATEWAY_TRACE_DROP(recv_cb->trace_id);
+        return;
+    }
+
+    gateway_stats_inc(GATEWAY_STAT_RX_FRAMES);
+    gateway_stats_add(GATEWAY_STAT_RX_BYTES, len);
+    if (control) {
+        gateway_stats_inc(GATEWAY_STAT_RX_CONTROL);
+        gateway_stats_max(GATEWAY_STAT_CTRL_QUEUE_HIGH_WATER, uxQueueMessagesWaiting(s_ctrl_queue));
+    } else {
+        gateway_stats_max(GATEWAY_STAT_DATA_QUEUE_HIGH_WATER, espnow_data_waiting());
+    }
+    espnow_task_wake();
+}
+
+/* Parse received ESPNOW data. */
+int espnow_data_parse(uint8_t *data, uint16_t data_len, uint8_t *type)
+{
+    espnow_data_t *buf = (espnow_data_t *)data;
+    uint16_t crc, crc_cal = 0;
+
+    if (data_len < sizeof(espnow_data_t)) {
+        ESP_LOGE(TAG, "Receive ESPNOW data too short, len:%d", data_len);
+        gateway_stats_inc(GATEWAY_STAT_RX_INVALID);
+        return -1;
+    }
+
+    *type = buf->type;
+    crc = buf->crc;
+    buf->crc = 0;
+    crc_cal = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, data_len);
+
+    if (crc_cal == crc) {
+        buf->crc = crc;
+        return 0; // Success
+    }
+
+    gateway_stats_inc(GATEWAY_STAT_CRC_FAIL);
+    return -1; // CRC error
+}
+
+/* Prepare ESPNOW data to be sent. */
+void espnow_data_prepare(espnow_send_param_t *send_param, uint8_t *payload, uint16_t payload_len)
+{
+    espnow_data_t *buf = (espnow_data_t *)send_param->buffer;
+
+    buf->type = IS_BROADCAST_ADDR(send_param->dest_mac) ? ESPNOW_DATA_BROADCAST : ESPNOW_DATA_UNICAST;
+    buf->crc = 0;
+    
+    // Copy payload if provided
+    if (payload != NULL && payload_len > 0) {
+        memcpy(buf->payload, payload, payload_len);
+    }
+    
+    buf->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)buf, send_param->len);
+}
+
+/* Deinitialize ESPNOW */
+static void espnow_deinit(void)
+{
+    if (s_send_queue) {
+        vQueueDelete(s_send_queue);
+        s_send_queue = NULL;
+    }
+    if (s_ctrl_queue) {
+        vQueueDelete(s_ctrl_queue);
+        s_ctrl_queue = NULL;
+    }
+#if !CONFIG_GATEWAY_PIPELINE
+    if (s_data_queue) {
+        vQueueDelete(s_data_queue);
+        s_data_queue = NULL;
+    }
+#endif
+    
+    esp_now_deinit();
+}
+
+/* Next event: send results, then control, then data. A control event queued
+   while a data frame is being handled is taken before the next data frame. */
+static bool espnow_next_event(espnow_event_t *evt)
+{
+    if (xQueueReceive(s_send_queue, evt, 0) == pdTRUE) {
+        return true;
+    }
+    if (xQueueReceive(s_ctrl_queue, evt, 0) == pdTRUE) {
+        return true;
+    }
+#if CONFIG_GATEWAY_PIPELINE
+    size_t len;
+    espnow_event_t *slot = spsc_ring_peek(&s_data_ring, &len);
+    if (slot == NULL) {
+        return false;
+    }
+    *evt = *slot;
+    spsc_ring_release(&s_data_ring, slot);
+    return true;
+#else
+    return xQueueReceive(s_data_queue, evt, 0) == pdTRUE;
+#endif
+}
+
+/* Wait for the callbacks to queue an event, for the next sensor coalescing
+   window to run out or for the next register_ack to be due. */
+static void espnow_task_sleep(void)
+{
+    TickType_t wait = portMAX_DELAY;
+
+#if CONFIG_GATEWAY_SENSOR_COALESCE
+    wait = sensor_coalesce_wait();
+#endif
+#if CONFIG_GATEWAY_REGISTER_PACING
+    TickType_t ack_wait = node_register_wait();
+    if (ack_wait < wait) {
+        wait = ack_wait;
+    }
+#endif
+#if CONFIG_GATEWAY_PIPELINE
+    atomic_store_explicit(&s_espnow_idle, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (uxQueueMessagesWaiting(s_send_queue) == 0 && uxQueueMessagesWaiting(s_ctrl_queue) == 0 &&
+        espnow_data_waiting() == 0) {
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+    atomic_store_explicit(&s_espnow_idle, false, memory_order_relaxed);
+#else
+    ulTaskNotifyTake(pdTRUE, wait);
+#endif
+}
+
+/* ESPNOW task to handle events */
+static void espnow_task(void *pvParameter)
+{
+    espnow_event_t evt;
+    uint8_t data_type;
+
+    while (1) {
+#if CONFIG_GATEWAY_SENSOR_COALESCE
+        sensor_coalesce_flush_expired();
+#endif
+#if CONFIG_GATEWAY_REGISTER_PACING
+        node_register_flush_due();
+#endif
+        if (!espnow_next_event(&evt)) {
+            espnow_task_sleep();
+            continue;
+        }
+        switch (evt.id) {
+            case ESPNOW_SEND_CB:
+            {
+                espnow_event_send_cb_t *send_cb = &evt.info.send_cb;
+                ESP_LOGI(TAG, "Send data to "MACSTR", status: %d", 
+                         MAC2STR(send_cb->mac_addr), send_cb->status);
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+                espnow_reliable_on_send_cb(send_cb->mac_addr, send_cb->status);
+#endif
+#if CONFIG_GATEWAY_REGISTER_PACING
+                node_register_send_result(send_cb->mac_addr, send_cb->status == ESP_NOW_SEND_SUCCESS);
+#endif
+                break;
+            }
+            case ESPNOW_RECV_CB:
+            {
+                espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
+                GATEWAY_TRACE_DEQUEUE(recv_cb->trace_id);
+                ESP_LOGD(TAG, "Received data len: %d", recv_cb->data_len);
+                
+                if (espnow_data_parse(recv_cb->data, recv_cb->data_len, &data_type) == 0) {
+                    const uint8_t *payload = ((espnow_data_t *)recv_cb->data)->payload;
+                    int payload_len = recv_cb->data_len - sizeof(espnow_data_t);
+                    if (data_type & ESPNOW_DATA_EXT) {
+                        espnow_data_ext_t *ext = (espnow_data_ext_t *)recv_cb->data;
+                        data_type &= ~ESPNOW_DATA_EXT;
+                        if (recv_cb->data_len < (int)sizeof(espnow_data_ext_t) || ext->version < ESPNOW_HDR_V1 ||
+                            recv_cb->data_len < (int)espnow_ext_hdr_len(ext)) {
+                            ESP_LOGI(TAG, "Bad extended header from: "MACSTR"", MAC2STR(recv_cb->mac_addr));
+                            gateway_stats_inc(GATEWAY_STAT_RX_INVALID);
+                            pkt_pool_give(recv_cb->data);
+                            break;
+                        }
+                        if (!espnow_seq_check(recv_cb->mac_addr, ext->seq)) {
+                            ESP_LOGD(TAG, "Duplicate seq %u from: "MACSTR"", ext->seq, MAC2STR(recv_cb->mac_addr));
+                            pkt_pool_give(recv_cb->data);
+                            break;
+                        }
+                        payload = recv_cb->data + espnow_ext_hdr_len(ext);
+                        payload_len = recv_cb->data + recv_cb->data_len - payload;
+                        if (ext->version >= ESPNOW_HDR_V2 &&
+                            (((espnow_data_v2_t *)ext)->flags & ESPNOW_FLAG_FRAGMENT)) {
+#if CONFIG_GATEWAY_FRAGMENTATION
+                            // Only the completing fragment goes on, as the whole message
+                            size_t msg_len = 0;
+                            payload = espnow_frag_add(recv_cb->mac_addr, (espnow_data_v2_t *)ext, payload,
+                                                      payload_len, &msg_len);
+                            payload_len = msg_len;
+#else
+                            ESP_LOGD(TAG, "Fragment dropped from: "MACSTR"", MAC2STR(recv_cb->mac_addr));
+                            payload_len = 0;
+#endif
+                        }
+                    }
+                    GATEWAY_TRACE_PARSED(recv_cb->trace_id);
+#if CONFIG_GATEWAY_NODE_LIVENESS
+                    node_liveness_seen(recv_cb->mac_addr);
+#endif
+                    if (data_type == ESPNOW_DATA_BROADCAST) {
+                        ESP_LOGI(TAG, "Receive broadcast data from: "MACSTR", len: %d", 
+                                 MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+                    } else {
+                        ESP_LOGD(TAG, "Receive unicast data from: "MACSTR", len: %d", 
+                                 MAC2STR(recv_cb->mac_addr), recv_cb->data_len);
+                    }
+                    if (payload_len > 0 && data_type == ESPNOW_DATA_AGGREGATE) {
+                        espnow_forward_aggregate(recv_cb->mac_addr, payload, payload_len);
+                    } else if (payload_len > 0 && data_type == ESPNOW_DATA_COMPACT) {
+                        espnow_forward_compact(recv_cb->mac_addr, payload, payload_len);
+                    } else if (payload_len > 0 && data_type == ESPNOW_DATA_OTA) {
+#if CONFIG_GATEWAY_OTA_RELAY
+                        ota_relay_on_frame(recv_cb->mac_addr, payload, payload_len);
+#endif
+                    } else if (payload_len > 0 && data_type < ESPNOW_DATA_MAX) {
+                        espnow_forward_json(recv_cb->mac_addr, data_type, (const char *)payload, payload_len);
+                    }
+                } else {
+                    ESP_LOGI(TAG, "Receive error data from: "MACSTR"", MAC2STR(recv_cb->mac_addr));
+                }
+                
+                pkt_pool_give(recv_cb->data);
+                break;
+            }
+            default:
+                ESP_LOGE(TAG, "Callback type error: %d", evt.id);
+                break;
+        }
+        if (evt.id == ESPNOW_RECV_CB) {
+            GATEWAY_TRACE_QUEUED(evt.info.recv_cb.trace_id);
+        }
+    }
+}
+
+#if CONFIG_GATEWAY_FRAGMENTATION
+#define ESPNOW_FRAG_PAYLOAD_MAX     (ESPNOW_FRAME_MAX - sizeof(espnow_data_v2_t))
+#define ESPNOW_TX_FRAGS_MAX         ((ESPNOW_MESSAGE_MAX + ESPNOW_FRAG_PAYLOAD_MAX - 1) / ESPNOW_FRAG_PAYLOAD_MAX)
+
+/* Queue text as header v2 fragments of up to ESPNOW_FRAME_MAX bytes, in
+   order and in the same class, all with ref. Either every fragment is
+   queued or none is, so a node never gets part of a message that cannot be
+   completed. */
+static esp_err_t espnow_send_fragments(const uint8_t *mac_addr, const char *text, size_t text_len,
+                                       espnow_tx_class_t cls, uint32_t ref)
+{
+    size_t frag_len = ESPNOW_FRAG_PAYLOAD_MAX;
+    uint32_t count = (text_len + frag_len - 1) / frag_len;
+    uint16_t msg_id = atomic_fetch_add(&s_tx_msg_id, 1);
+    uint8_t type = IS_BROADCAST_ADDR(mac_addr) ? ESPNOW_DATA_BROADCAST : ESPNOW_DATA_UNICAST;
+    uint8_t *frames[ESPNOW_TX_FRAGS_MAX];
+    uint16_t lens[ESPNOW_TX_FRAGS_MAX];
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t len = (i + 1 < count) ? frag_len : text_len - i * frag_len;
+        size_t total_len = sizeof(espnow_data_v2_t) + len;
+        espnow_data_v2_t *frag = malloc(total_len);
+        if (frag == NULL) {
+            ESP_LOGE(TAG, "Malloc send buffer fail");
+            gateway_stats_inc(GATEWAY_STAT_ALLOC_FAIL);
+            while (i > 0) {
+                free(frames[--i]);
+            }
+            return ESP_FAIL;
+        }
+        frag->type = type | ESPNOW_DATA_EXT;
+        frag->crc = 0;
+        frag->version = ESPNOW_HDR_V2;
+        frag->seq = atomic_fetch_add(&s_tx_seq, 1);
+        frag->flags = ESPNOW_FLAG_FRAGMENT;
+        frag->msg_id = msg_id;
+        frag->frag_idx = i;
+        frag->frag_count = count;
+        memcpy(frag->payload, text + i * frag_len, len);
+        frag->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)frag, total_len);
+        frames[i] = (uint8_t *)frag;
+        lens[i] = total_len;
+    }
+
+    esp_err_t err = espnow_sched_submit_all(mac_addr, frames, lens, count, cls, ref);
+    if (err != ESP_OK) {
+        return err;
+    }
+    espnow_frag_sent(count);
+    return ESP_OK;
+}
+#endif
+
+/* API to send a JSON text payload. The frame is queued on the outbound
+   scheduler in class cls; with reliable unicast ref is echoed in the delivery
+   report. Text that does not fit one frame is sent as fragments. */
+esp_err_t espnow_send_text(const uint8_t *mac_addr, const char *text, size_t text_len, espnow_tx_class_t cls, uint32_t ref)
+{
+    ESP_LOGI(TAG, "Sending JSON: %.*s", (int)text_len, text);
+
+    size_t total_len = sizeof(espnow_data_t) + text_len;
+    if (text_len > ESPNOW_MESSAGE_MAX) {
+        ESP_LOGE(TAG, "Payload too long, len:%d", (int)text_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+#if CONFIG_GATEWAY_FRAGMENTATION
+    if (total_len > ESPNOW_FRAME_MAX) {
+        return espnow_send_fragments(mac_addr, text, text_len, cls, ref);
+    }
+#endif
+    
+    // Allocate buffer
+    uint8_t *buffer = malloc(total_len);
+    if (!buffer) {
+        ESP_LOGE(TAG, "Malloc send buffer fail");
+        gateway_stats_inc(GATEWAY_STAT_ALLOC_FAIL);
+        return ESP_FAIL;
+    }
+    
+    // Prepare send parameters
+    espnow_send_param_t send_param;
+    send_param.unicast = !IS_BROADCAST_ADDR(mac_addr);
+    send_param.broadcast = IS_BROADCAST_ADDR(mac_addr);
+    send_param.delay = 0;
+    send_param.len = total_len;
+    send_param.buffer = buffer;
+    memcpy(send_param.dest_mac, mac_addr, ESP_NOW_ETH_ALEN);
+    
+    // Prepare the data
+    espnow_data_prepare(&send_param, (uint8_t *)text, text_len);
+    
+    // Queue the data; the scheduler owns the buffer from here on
+    return espnow_sched_submit(send_param.dest_mac, buffer, total_len, cls, ref);
+}
+
+/* API to send JSON data */
+esp_err_t espnow_send_json(const uint8_t *mac_addr, cJSON *json, espnow_tx_class_t cls, uint32_t ref)
+{
+    if (!json) {
+        ESP_LOGE(TAG, "Invalid JSON object");
+        return ESP_FAIL;
+    }
+    
+    // Convert JSON to string
+    char *json_str = cJSON_PrintUnformatted(json);
+    if (!json_str) {
+        ESP_LOGE(TAG, "Failed to print JSON");
+        return ESP_FAIL;
+    }
+    esp_err_t err = espnow_send_text(mac_addr, json_str, strlen(json_str), cls, ref);
+    free(json_str);
+    
+    return err;
+}
+
+/* Initialize ESPNOW */
+static esp_err_t espnow_init(void)
+{
+    s_send_queue = xQueueCreate(ESPNOW_SEND_QUEUE_SIZE, sizeof(espnow_event_t));
+    s_ctrl_queue = xQueueCreate(ESPNOW_CTRL_QUEUE_SIZE, sizeof(espnow_event_t));
+#if CONFIG_GATEWAY_PIPELINE
+    spsc_ring_init(&s_data_ring, s_data_ring_buf, sizeof(s_data_ring_buf));
+    if (s_send_queue == NULL || s_ctrl_queue == NULL) {
+#else
+    s_data_queue = xQueueCreate(ESPNOW_DATA_QUEUE_SIZE, sizeof(espnow_event_t));
+    if (s_send_queue == NULL || s_ctrl_queue == NULL || s_data_queue == NULL) {
+#endif
+        ESP_LOGE(TAG, "Create queue fail");
+        espnow_deinit();
+        return ESP_FAIL;
+    }
+
+    /* Receive buffers must exist before the receive callback is registered. */
+    ESP_ERROR_CHECK(pkt_pool_init());
+
+    /* Initialize ESPNOW and register sending and receiving callback function. */
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
+    
+    /* Set primary master key. */
+    ESP_ERROR_CHECK(esp_now_set_pmk((uint8_t *)CONFIG_ESPNOW_PMK));
+
+    /* Add broadcast peer information to peer list. */
+    esp_now_peer_info_t peer;
+    memset(&peer, 0, sizeof(esp_now_peer_info_t));
+    peer.channel = CONFIG_ESPNOW_CHANNEL;
+    peer.ifidx = ESPNOW_WIFI_IF;
+    peer.encrypt = false;
+    memcpy(peer.peer_addr, s_broadcast_mac, ESP_NOW_ETH_ALEN);
+    ESP_ERROR_CHECK(esp_now_add_peer(&peer));
+
+    // Get all stored peers (using the additional function). They are only loaded
+    // into the ESP-NOW peer table on demand by the registry.
+    static uint8_t all_macs[MAX_PEERS][6];
+    size_t peer_count = MAX_PEERS;
+    ESP_ERROR_CHECK(peer_registry_init());
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+    ESP_ERROR_CHECK(espnow_reliable_init());
+#endif
+    ESP_ERROR_CHECK(espnow_sched_init());
+    ESP_ERROR_CHECK(espnow_seq_init());
+#if CONFIG_GATEWAY_NODE_LIVENESS
+    ESP_ERROR_CHECK(node_liveness_init());
+#endif
+#if CONFIG_GATEWAY_OTA_RELAY
+    ESP_ERROR_CHECK(ota_relay_init());
+#endif
+#if CONFIG_GATEWAY_REGISTER_PACING
+    ESP_ERROR_CHECK(node_register_init(s_my_mac));
+#endif
+    if (nvs_get_all_peers(all_macs, &peer_count) == ESP_OK) {
+        for (int i = 0; i < peer_count; i++) {
+            if (peer_registry_add(all_macs[i], NULL) == ESP_OK) {
+                peer_registry_preload(all_macs[i]);
+            }
+            ESP_LOGI(TAG, "Peer %d: %02X:%02X:%02X:%02X:%02X:%02X", 
+                    i, all_macs[i][0], all_macs[i][1], all_macs[i][2], 
+                    all_macs[i][3], all_macs[i][4], all_macs[i][5]);
+        }
+    }
+
+    if (GATEWAY_TASK_CREATE(espnow_task, "espnow_task", GATEWAY_TASK_STACK(8192),
+                            GATEWAY_ESPNOW_TASK_PRIO, &s_espnow_task, GATEWAY_RADIO_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Create ESPNOW task fail");
+        espnow_deinit();
+        return ESP_FAIL;
+    }
+    gateway_stats_watch_task(s_espnow_task);
+#if CONFIG_GATEWAY_PIPELINE
+    host_tx_set_pipeline_producer(s_espnow_task);
+#endif
+
+    return ESP_OK;
+}
+
+/* API to send data */
+esp_err_t espnow_send_data(const uint8_t *mac_addr, const uint8_t *data, uint16_t len)
+{
+    espnow_send_param_t send_param;
+    
+    send_param.unicast = !IS_BROADCAST_ADDR(mac_addr);
+    send_param.broadcast = IS_BROADCAST_ADDR(mac_addr);
+    send_param.delay = 0; // No delay for event-based sending
+    send_param.len = sizeof(espnow_data_t) + len;
+    send_param.buffer = malloc(send_param.len);
+    
+    if (send_param.buffer == NULL) {
+        ESP_LOGE(TAG, "Malloc send buffer fail");
+        gateway_stats_inc(GATEWAY_STAT_ALLOC_FAIL);
+        return ESP_FAIL;
+    }
+    
+    memcpy(send_param.dest_mac, mac_addr, ESP_NOW_ETH_ALEN);
+    
+    // Prepare the data
+    espnow_data_prepare(&send_param, (uint8_t *)data, len);
+    
+    // Queue the data; the scheduler owns the buffer from here on
+    return espnow_sched_submit(send_param.dest_mac, send_param.buffer, send_param.len, ESPNOW_TX_BULK, 0);
+}
+
+/* Host reader task.
+   Blocks in serial_port_read until the host has sent data and hands the bytes
+   to host_cmd_feed, which splits them into messages for the host command task.
+*/
+static void serial_reader_task(void *arg) {
+    uint8_t buf[256];
+
+    while (1) {
+        int r = serial_port_read(buf, sizeof(buf), portMAX_DELAY);
+        if (r > 0) {
+            host_cmd_feed(buf, r);
+        }
+    }
+}
+
+esp_err_t gateway_core_init(const uint8_t *own_mac)
+{
+    TaskHandle_t reader;
+    esp_err_t err;
+
+    memcpy(s_my_mac, own_mac, ESP_NOW_ETH_ALEN);
+
+    err = serial_port_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = host_tx_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = espnow_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+    // command pipeline for messages from the host, once ESP-NOW can send
+    err = host_cmd_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "failed to start host command task");
+        return err;
+    }
+    if (GATEWAY_TASK_CREATE(serial_reader_task, "serial_reader", GATEWAY_TASK_STACK(4096),
+                            GATEWAY_READER_TASK_PRIO, &reader, GATEWAY_SERIAL_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Create reader task fail");
+        return ESP_FAIL;
+    }
+    gateway_stats_watch_task(reader);
+    return gateway_stats_init();
+}
@@ -0,0 +1,262 @@
+/* GATEWAY_STATS.C
+   Runtime statistics
+
+   Failures on the hot paths (receive callback, frame parsing, sends, host
+   commands) are counted here instead of only being logged, since the log
+   shares the serial line with the host protocol. The counters are atomics, so
+   the Wi-Fi callbacks update them without a lock. The get_stats host command
+   and the optional periodic line report them together with the drop counters
+   of the other modules and the stack high-water marks of the gateway tasks.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "pkt_pool.h"
+#include "host_tx.h"
+#include "host_cmd.h"
+#include "host_proto.h"
+#include "espnow_sched.h"
+#include "espnow_reliable.h"
+#include "espnow_seq.h"
+#include "node_liveness.h"
+#include "sensor_coalesce.h"
+#include "espnow_frag.h"
+#include "ota_relay.h"
+#include "node_register.h"
+#include "espnow_example.h"
+#include "gateway_stats.h"
+
+static const char *TAG = "gateway_stats";
+
+#define STATS_INTERVAL_S          CONFIG_GATEWAY_STATS_INTERVAL_S
+/* Same size as the get_stats reply buffer of host_cmd. */
+#define STATS_REPORT_MAX          (ESPNOW_MESSAGE_MAX > GATEWAY_STATS_JSON_MAX ? ESPNOW_MESSAGE_MAX : GATEWAY_STATS_JSON_MAX)
+
+static const char *const s_stat_names[GATEWAY_STAT_MAX] = {
+    [GATEWAY_STAT_RX_FRAMES]              = "rx_frames",
+    [GATEWAY_STAT_RX_BYTES]               = "rx_bytes",
+    [GATEWAY_STAT_RX_CONTROL]             = "rx_control",
+    [GATEWAY_STAT_RX_INVALID]             = "rx_invalid",
+    [GATEWAY_STAT_CRC_FAIL]               = "crc_fail",
+    [GATEWAY_STAT_TX_FRAMES]              = "tx_frames",
+    [GATEWAY_STAT_TX_BYTES]               = "tx_bytes",
+    [GATEWAY_STAT_TX_FAIL]                = "tx_fail",
+    [GATEWAY_STAT_SEND_CB_FAIL]           = "send_cb_fail",
+    [GATEWAY_STAT_SEND_RESULT_DROPPED]    = "send_result_dropped",
+    [GATEWAY_STAT_CTRL_QUEUE_FULL]        = "ctrl_queue_full",
+    [GATEWAY_STAT_CTRL_QUEUE_HIGH_WATER]  = "ctrl_queue_high_water",
+    [GATEWAY_STAT_DATA_DROPPED]           = "data_dropped",
+    [GATEWAY_STAT_DATA_QUEUE_HIGH_WATER]  = "data_queue_high_water",
+    [GATEWAY_STAT_ALLOC_FAIL]             = "alloc_fail",
+    [GATEWAY_STAT_HOST_CMD_INVALID]       = "host_cmd_invalid",
+    [GATEWAY_STAT_REPORT_TRUNCATED]       = "report_truncated",
+};
+
+static _Atomic uint32_t s_counters[GATEWAY_STAT_MAX];
+
+/* Watched tasks only change during start-up. */
+static TaskHandle_t s_tasks[GATEWAY_STATS_MAX_TASKS];
+static int s_task_count;
+static portMUX_TYPE s_task_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if STATS_INTERVAL_S > 0
+static esp_timer_handle_t s_report_timer;
+/* Only used by the esp_timer task. */
+static char s_report[STATS_REPORT_MAX];
+#endif
+
+void gateway_stats_add(gateway_stat_t id, uint32_t n) {
+    if (id < GATEWAY_STAT_MAX) {
+        atomic_fetch_add_explicit(&s_counters[id], n, memory_order_relaxed);
+    }
+}
+
+void gateway_stats_inc(gateway_stat_t id) {
+    gateway_stats_add(id, 1);
+}
+
+void gateway_stats_max(gateway_stat_t id, uint32_t value) {
+    if (id >= GATEWAY_STAT_MAX) {
+        return;
+    }
+    uint32_t cur = atomic_load_explicit(&s_counters[id], memory_order_relaxed);
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(&s_counters[id], &cur, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint32_t gateway_stats_get(gateway_stat_t id) {
+    return id < GATEWAY_STAT_MAX ? atomic_load_explicit(&s_counters[id], memory_order_relaxed) : 0;
+}
+
+void gateway_stats_watch_task(TaskHandle_t task) {
+    if (task == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&s_task_lock);
+    if (s_task_count < GATEWAY_STATS_MAX_TASKS) {
+        s_tasks[s_task_count++] = task;
+        task = NULL;
+    }
+    portEXIT_CRITICAL(&s_task_lock);
+    if (task != NULL) {
+        ESP_LOGW(TAG, "Too many watched tasks, %s not reported", pcTaskGetName(task));
+    }
+}
+
+/* snprintf at *pos; false once out is full. */
+static bool json_append(char *out, size_t out_size, size_t *pos, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(out + *pos, out_size - *pos, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= out_size - *pos) {
+        return false;
+    }
+    *pos += n;
+    return true;
+}
+
+int gateway_stats_json(char *out, size_t out_size) {
+    pkt_pool_stats_t pool;
+    host_tx_stats_t tx;
+    host_cmd_stats_t cmd;
+    host_proto_stats_t proto;
+    espnow_sched_stats_t sched;
+    espnow_seq_stats_t seq;
+    uint32_t sched_dropped = 0;
+    size_t pos = 0;
+    bool ok;
+
+    pkt_pool_get_stats(&pool);
+    host_tx_get_stats(&tx);
+    host_cmd_get_stats(&cmd);
+    host_proto_get_stats(&proto);
+    espnow_sched_get_stats(&sched);
+    espnow_seq_get_stats(&seq);
+    for (int c = 0; c < ESPNOW_TX_CLASS_MAX; c++) {
+        sched_dropped += sched.cls[c].dropped;
+    }
+
+    ok = json_append(out, out_size, &pos, "{\"type\":\"gateway_stats\",\"uptime_s\":%" PRIu32 ",\"counters\":{",
+                     (uint32_t)(esp_timer_get_time() / 1000000));
+    for (int i = 0; ok && i < GATEWAY_STAT_MAX; i++) {
+        ok = json_append(out, out_size, &pos, "%s\"%s\":%" PRIu32, i ? "," : "", s_stat_names[i],
+                         gateway_stats_get(i));
+    }
+    ok = ok && json_append(out, out_size, &pos,
+                           "},\"drops\":{\"rx_pool\":%" PRIu32 ",\"tx_queue\":%" PRIu32 ",\"host_rx\":%" PRIu32
+                           ",\"host_rx_oversize\":%" PRIu32 ",\"host_rx_bad_frames\":%" PRIu32 ",\"host_tx\":%" PRIu32
+                           ",\"duplicates\":%" PRIu32,
+                           pool.exhausted, sched_dropped, cmd.dropped, cmd.oversize, proto.bad_frames_rx,
+                           tx.dropped, seq.duplicates);
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+    espnow_reliable_stats_t rel;
+    espnow_reliable_get_stats(&rel);
+    ok = ok && json_append(out, out_size, &pos, ",\"reliable_failed\":%" PRIu32 ",\"reliable_rejected\":%" PRIu32
+                           ",\"reliable_timeouts\":%" PRIu32 ",\"reliable_late_results\":%" PRIu32,
+                           rel.failed, rel.rejected, rel.timeouts, rel.late_results);
+#endif
+    ok = ok && json_append(out, out_size, &pos, "},\"rx_pool_high_water\":%" PRIu32, pool.high_water);
+#if CONFIG_GATEWAY_NODE_LIVENESS
+    node_liveness_stats_t live;
+    node_liveness_get_stats(&live);
+    ok = ok && json_append(out, out_size, &pos,
+                           ",\"liveness\":{\"online\":%" PRIu32 ",\"offline\":%" PRIu32 ",\"heartbeats_absorbed\":%" PRIu32
+                           ",\"untracked\":%" PRIu32 ",\"evictions\":%" PRIu32 "}",
+                           live.online, live.tracked - live.online, live.absorbed, live.untracked, live.evictions);
+#endif
+#if CONFIG_GATEWAY_SENSOR_COALESCE
+    sensor_coalesce_stats_t coalesce;
+    sensor_coalesce_get_stats(&coalesce);
+    ok = ok && json_append(out, out_size, &pos,
+                           ",\"coalesce\":{\"absorbed\":%" PRIu32 ",\"summaries\":%" PRIu32 ",\"untracked\":%" PRIu32 "}",
+                           coalesce.absorbed, coalesce.summaries, coalesce.untracked);
+#endif
+#if CONFIG_GATEWAY_FRAGMENTATION
+    espnow_frag_stats_t frag;
+    espnow_frag_get_stats(&frag);
+    ok = ok && json_append(out, out_size, &pos,
+                           ",\"fragments\":{\"tx_messages\":%" PRIu32 ",\"tx_fragments\":%" PRIu32
+                           ",\"rx_fragments\":%" PRIu32 ",\"rx_messages\":%" PRIu32 ",\"rx_timeouts\":%" PRIu32
+                           ",\"rx_evicted\":%" PRIu32 ",\"rx_invalid\":%" PRIu32 "}",
+                           frag.tx_messages, frag.tx_fragments, frag.rx_fragments, frag.rx_messages,
+                           frag.rx_timeouts, frag.rx_evicted, frag.rx_invalid);
+#endif
+#if CONFIG_GATEWAY_OTA_RELAY
+    ota_relay_stats_t ota;
+    ota_relay_get_stats(&ota);
+    ok = ok && json_append(out, out_size, &pos,
+                           ",\"ota\":{\"sessions\":%" PRIu32 ",\"chunks_in\":%" PRIu32 ",\"chunks_rejected\":%" PRIu32
+                           ",\"frames_sent\":%" PRIu32 ",\"retransmits\":%" PRIu32 ",\"send_dropped\":%" PRIu32
+                           ",\"acks\":%" PRIu32 ",\"targets_ok\":%" PRIu32 ",\"targets_failed\":%" PRIu32 "}",
+                           ota.sessions, ota.chunks_in, ota.chunks_rejected, ota.frames_sent, ota.retransmits,
+                           ota.send_dropped, ota.acks, ota.targets_ok, ota.targets_failed);
+#endif
+#if CONFIG_GATEWAY_REGISTER_PACING
+    node_register_stats_t reg;
+    node_register_get_stats(&reg);
+    ok = ok && json_append(out, out_size, &pos,
+                           ",\"register\":{\"requests\":%" PRIu32 ",\"stored\":%" PRIu32 ",\"cached\":%" PRIu32
+                           ",\"merged\":%" PRIu32 ",\"rate_limited\":%" PRIu32 ",\"acks\":%" PRIu32
+                           ",\"evictions\":%" PRIu32 "}",
+                           reg.requests, reg.stored, reg.cached, reg.merged, reg.rate_limited, reg.acks, reg.evictions);
+#endif
+    ok = ok && json_append(out, out_size, &pos, ",\"tasks\":[");
+
+    portENTER_CRITICAL(&s_task_lock);
+    int task_count = s_task_count;
+    portEXIT_CRITICAL(&s_task_lock);
+    for (int i = 0; ok && i < task_count; i++) {
+        // Stack sizes are in bytes on ESP-IDF
+        ok = json_append(out, out_size, &pos, "%s{\"name\":\"%s\",\"stack_free\":%" PRIu32 "}", i ? "," : "",
+                         pcTaskGetName(s_tasks[i]), (uint32_t)uxTaskGetStackHighWaterMark(s_tasks[i]));
+    }
+    ok = ok && json_append(out, out_size, &pos, "]}");
+    if (!ok) {
+        ESP_LOGW(TAG, "Stats reply does not fit %u bytes", (unsigned)out_size);
+        gateway_stats_inc(GATEWAY_STAT_REPORT_TRUNCATED);
+        return -1;
+    }
+    return (int)pos;
+}
+
+#if STATS_INTERVAL_S > 0
+static void report_timer_cb(void *arg) {
+    int n = gateway_stats_json(s_report, sizeof(s_report));
+    if (n > 0) {
+        host_proto_emit_status(s_report, n);
+    }
+}
+#endif
+
+esp_err_t gateway_stats_init(void) {
+#if STATS_INTERVAL_S > 0
+    const esp_timer_create_args_t timer_args = {
+        .callback = report_timer_cb,
+        .name = "gateway_stats",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_report_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Create report timer fail: %s", esp_err_to_name(err));
+        return err;
+    }
+    return esp_timer_start_periodic(s_report_timer, (uint64_t)STATS_INTERVAL_S * 1000000);
+#else
+    return ESP_OK;
+#endif
+}
@@ -0,0 +1,249 @@
+/* GATEWAY_TRACE.C
+   Per-frame stage tracing
+
+   With CONFIG_GATEWAY_TRACE every received frame gets a record in a fixed
+   ring, stamped with esp_timer_get_time() at four stages: receive callback
+   entry, dequeue in espnow_task, parse done (header, CRC and sequence checks
+   passed, before forwarding) and serial write done. The write stage is
+   matched by position: once espnow_task has forwarded a frame, the number of
+   items committed to host TX so far is remembered, and the frame counts as
+   written once the writer task has written that many items. The ring
+   overwrites the oldest records; get_trace sends it to the host. Without
+   the option the hooks compile to nothing.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_tx.h"
+#include "host_proto.h"
+#include "gateway_trace.h"
+
+#if CONFIG_GATEWAY_TRACE
+
+static const char *TAG = "gateway_trace";
+
+#define TRACE_DUMP_BATCH          16
+#define TRACE_EMIT_RETRIES        20
+#define TRACE_EMIT_RETRY_TICKS    pdMS_TO_TICKS(10)
+
+typedef struct {
+    gateway_trace_record_t rec;
+    uint32_t tx_seq;                      // Host TX items committed once the frame was forwarded.
+    bool queued;                          // Forwarded, tx_seq is valid.
+    bool dropped;                         // Never reached espnow_task.
+} trace_entry_t;
+
+static trace_entry_t s_ring[GATEWAY_TRACE_ENTRIES];
+static uint32_t s_next_id = 1;            // 0 means "not traced".
+static uint32_t s_write_next = 1;         // Oldest frame still waiting for its write stamp.
+static uint32_t s_written;                // Host TX items written so far.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Command task only. */
+static gateway_trace_record_t s_batch[TRACE_DUMP_BATCH];
+static char s_text[TRACE_DUMP_BATCH * 150 + 32];
+
+/* Entry for id, or NULL if it has been overwritten. Called with s_lock held. */
+static trace_entry_t *entry_locked(uint32_t id) {
+    trace_entry_t *e = &s_ring[id % GATEWAY_TRACE_ENTRIES];
+    return (id != 0 && e->rec.id == id) ? e : NULL;
+}
+
+static uint32_t since(const trace_entry_t *e, int64_t now) {
+    return (uint32_t)(now - e->rec.rx_us);
+}
+
+uint32_t gateway_trace_rx(const uint8_t *mac, int len) {
+    int64_t now = esp_timer_get_time();
+    uint32_t id;
+
+    portENTER_CRITICAL(&s_lock);
+    id = s_next_id++;
+    if (s_next_id == 0) {
+        s_next_id = 1;
+    }
+    trace_entry_t *e = &s_ring[id % GATEWAY_TRACE_ENTRIES];
+    e->rec.id = id;
+    memcpy(e->rec.mac, mac, sizeof(e->rec.mac));
+    e->rec.len = len;
+    e->rec.rx_us = now;
+    e->rec.dequeue_us = GATEWAY_TRACE_NONE;
+    e->rec.parse_us = GATEWAY_TRACE_NONE;
+    e->rec.write_us = GATEWAY_TRACE_NONE;
+    e->queued = false;
+    e->dropped = false;
+    portEXIT_CRITICAL(&s_lock);
+    return id;
+}
+
+void gateway_trace_drop(uint32_t id) {
+    portENTER_CRITICAL(&s_lock);
+    trace_entry_t *e = entry_locked(id);
+    if (e) {
+        e->dropped = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void gateway_trace_dequeue(uint32_t id) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    trace_entry_t *e = entry_locked(id);
+    if (e) {
+        e->rec.dequeue_us = since(e, now);
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/* Stamp the write stage of every forwarded frame whose lines are out. Frames
+   finish in order, so stop at the first one that is not done. The writer can
+   get to a line before espnow_task has recorded the frame as forwarded,
+   hence this also runs after each forward. Called with s_lock held. */
+static void advance_writes_locked(int64_t now) {
+    if (s_next_id - s_write_next > GATEWAY_TRACE_ENTRIES) {
+        s_write_next = s_next_id - GATEWAY_TRACE_ENTRIES;
+    }
+    while (s_write_next != s_next_id) {
+        trace_entry_t *e = entry_locked(s_write_next);
+        if (e && !e->dropped) {
+            if (!e->queued || (int32_t)(e->tx_seq - s_written) > 0) {
+                break;
+            }
+            e->rec.write_us = since(e, now);
+        }
+        s_write_next++;
+    }
+}
+
+void gateway_trace_parsed(uint32_t id) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    trace_entry_t *e = entry_locked(id);
+    if (e) {
+        e->rec.parse_us = since(e, now);
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void gateway_trace_queued(uint32_t id) {
+    int64_t now = esp_timer_get_time();
+    uint32_t tx_seq = host_tx_traced_queued();
+
+    portENTER_CRITICAL(&s_lock);
+    trace_entry_t *e = entry_locked(id);
+    if (e) {
+        e->tx_seq = tx_seq;
+        e->queued = true;
+    }
+    advance_writes_locked(now);
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void gateway_trace_written(uint32_t items) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    s_written += items;
+    advance_writes_locked(now);
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/* Host TX never blocks; the command task waits for room instead of losing
+   part of the dump. */
+static bool emit_retry(bool binary, const void *data, size_t len) {
+    for (int i = 0; i < TRACE_EMIT_RETRIES; i++) {
+        bool ok = binary ? host_proto_emit_trace(data, len) : host_proto_emit_status(data, len);
+        if (ok) {
+            return true;
+        }
+        vTaskDelay(TRACE_EMIT_RETRY_TICKS);
+    }
+    return false;
+}
+
+static int append_stage(char *out, size_t size, const char *name, uint32_t us) {
+    if (us == GATEWAY_TRACE_NONE) {
+        return snprintf(out, size, ",\"%s\":null", name);
+    }
+    return snprintf(out, size, ",\"%s\":%" PRIu32, name, us);
+}
+
+/* Render a batch as a {"type":"trace","entries":[...]} line. */
+static int batch_json(const gateway_trace_record_t *recs, int count) {
+    size_t pos = 0;
+    int n;
+
+    n = snprintf(s_text, sizeof(s_text), "{\"type\":\"trace\",\"entries\":[");
+    pos += n;
+    for (int i = 0; i < count; i++) {
+        const gateway_trace_record_t *r = &recs[i];
+        n = snprintf(s_text + pos, sizeof(s_text) - pos,
+                     "%s{\"id\":%" PRIu32 ",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"len\":%u,\"rx_us\":%" PRId64,
+                     i ? "," : "", r->id, r->mac[0], r->mac[1], r->mac[2], r->mac[3], r->mac[4], r->mac[5],
+                     r->len, r->rx_us);
+        pos += n;
+        pos += append_stage(s_text + pos, sizeof(s_text) - pos, "dequeue_us", r->dequeue_us);
+        pos += append_stage(s_text + pos, sizeof(s_text) - pos, "parse_us", r->parse_us);
+        pos += append_stage(s_text + pos, sizeof(s_text) - pos, "write_us", r->write_us);
+        pos += snprintf(s_text + pos, sizeof(s_text) - pos, "}");
+    }
+    pos += snprintf(s_text + pos, sizeof(s_text) - pos, "]}");
+    return pos < sizeof(s_text) ? (int)pos : -1;
+}
+
+void gateway_trace_dump(void) {
+    bool binary = host_proto_get_mode() == HOST_PROTO_BINARY;
+    uint32_t first, last, sent = 0;
+
+    portENTER_CRITICAL(&s_lock);
+    last = s_next_id;
+    portEXIT_CRITICAL(&s_lock);
+    first = last > GATEWAY_TRACE_ENTRIES ? last - GATEWAY_TRACE_ENTRIES : 1;
+
+    for (uint32_t id = first; id != last;) {
+        int count = 0;
+
+        portENTER_CRITICAL(&s_lock);
+        for (; id != last && count < TRACE_DUMP_BATCH; id++) {
+            trace_entry_t *e = entry_locked(id);
+            if (e) {
+                s_batch[count++] = e->rec;
+            }
+        }
+        portEXIT_CRITICAL(&s_lock);
+        if (count == 0) {
+            continue;
+        }
+
+        bool ok;
+        if (binary) {
+            ok = emit_retry(true, s_batch, count * sizeof(gateway_trace_record_t));
+        } else {
+            int n = batch_json(s_batch, count);
+            ok = n > 0 && emit_retry(false, s_text, n);
+        }
+        if (!ok) {
+            ESP_LOGW(TAG, "Host TX full, trace dump cut short");
+            break;
+        }
+        sent += count;
+    }
+
+    int n = snprintf(s_text, sizeof(s_text), "{\"type\":\"trace_end\",\"entries\":%" PRIu32 "}", sent);
+    emit_retry(false, s_text, n);
+}
+
+#endif // CONFIG_GATEWAY_TRACE
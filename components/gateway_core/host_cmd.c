@@ -0,0 +1,431 @@
+/* HOST_CMD.C
+   Host command pipeline
+
+   Every transport (USB Serial/JTAG or UART) is only a byte source: its reader
+   task passes whatever it read to host_cmd_feed, which splits the stream into
+   messages for the current host protocol and passes them through a
+   preallocated message buffer, so no heap is used per command. One command task
+   scans each message in place with json_scan, without building a cJSON tree,
+   and looks its "type" up in a sorted, compile-time command table, so both
+   transports share exactly the same behaviour. Payloads that are passed on to
+   a node are copied from the line verbatim.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/message_buffer.h"
+#include "esp_log.h"
+#include "espnow_example.h"
+#include "json_scan.h"
+#include "host_proto.h"
+#include "espnow_sched.h"
+#include "espnow_seq.h"
+#include "gateway_stats.h"
+#include "gateway_trace.h"
+#include "node_liveness.h"
+#include "ota_relay.h"
+#include "gateway_pipeline.h"
+#include "host_cmd.h"
+
+static const char *TAG = "host_cmd";
+
+#define HOST_CMD_TASK_STACK       GATEWAY_TASK_STACK(4096)
+
+/* Members of a host command the handlers use, found in one scan of the line. */
+enum {
+    ARG_TYPE,
+    ARG_MAC,
+    ARG_ID,
+    ARG_PAYLOAD,
+    ARG_CONFIGURATIONS,
+    ARG_PROTOCOL,
+    ARG_TARGETS,
+    ARG_SIZE,
+    ARG_CRC32,
+    ARG_COUNT,
+};
+
+static const char *const s_arg_keys[ARG_COUNT] = {
+    "type", "mac", "id", "payload", "configurations", "protocol", "targets", "size", "crc32",
+};
+
+/* A host command. Spans point into line, which stays valid for the handler. */
+typedef struct {
+    const char *line;
+    size_t len;
+    json_span_t arg[ARG_COUNT];
+    uint8_t mac[6];                       // Parsed "mac" for entries with needs_mac.
+    uint32_t ref;                         // Optional numeric "id", 0 if absent.
+} host_cmd_msg_t;
+
+typedef void (*host_cmd_fn_t)(const host_cmd_msg_t *msg);
+
+typedef struct {
+    const char *name;
+    host_cmd_fn_t fn;
+    bool needs_mac;
+} host_cmd_t;
+
+/* Complete messages travel from the reader to the command task through a
+   statically allocated message buffer, length-prefixed and copied once. */
+static uint8_t s_rx_storage[HOST_CMD_RX_BUFFER_SIZE];
+static StaticMessageBuffer_t s_rx_mb_struct;
+static MessageBufferHandle_t s_rx_mb = NULL;
+
+/* Reader side: the message being assembled. */
+static char s_line[HOST_CMD_LINE_MAX];
+static size_t s_line_len;
+static bool s_line_discard;               // Rest of an oversize line is being skipped.
+
+/* Command task side: the message being executed. */
+static char s_cmd_line[HOST_CMD_LINE_MAX];
+
+static host_cmd_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Outgoing text built by a handler, also large enough for a get_stats reply.
+   Only used by the command task. */
+#if CONFIG_GATEWAY_FRAGMENTATION
+#define HOST_CMD_TEXT_MAX         ESPNOW_MESSAGE_MAX
+#else
+#define HOST_CMD_TEXT_MAX         ESP_NOW_MAX_DATA_LEN_V2
+#endif
+static char s_text[HOST_CMD_TEXT_MAX > GATEWAY_STATS_JSON_MAX ? HOST_CMD_TEXT_MAX : GATEWAY_STATS_JSON_MAX];
+
+_Static_assert(HOST_CMD_RX_BUFFER_SIZE >= HOST_CMD_LINE_MAX + 4,
+               "GATEWAY_HOST_RX_BUFFER_SIZE too small for the longest host command");
+#if CONFIG_GATEWAY_OTA_RELAY
+/* An OTA chunk frame, COBS encoded, must fit a host line. */
+_Static_assert(HOST_CMD_LINE_MAX > OTA_RELAY_CHUNK_LEN + OTA_RELAY_CHUNK_LEN / 254 + 32,
+               "GATEWAY_OTA_CHUNK_LEN too long for a host line");
+#endif
+
+/* Parse a "AA:BB:CC:DD:EE:FF" string span; false if missing or malformed. */
+static bool span_to_mac(const json_span_t *span, uint8_t *mac) {
+    char str[18];
+
+    if (span->type != JSON_SPAN_STRING || span->len != sizeof(str) - 1) {
+        return false;
+    }
+    memcpy(str, span->ptr, span->len);
+    str[span->len] = 0;
+    mac_from_str(str, mac);
+    return memcmp(mac, "\0\0\0\0\0\0", 6) != 0;
+}
+
+static void cmd_forward(const host_cmd_msg_t *msg) {
+    json_span_t raw;
+
+    if (msg->arg[ARG_PAYLOAD].type == JSON_SPAN_NONE) {
+        return;
+    }
+    // The payload bytes go out exactly as the host wrote them
+    json_span_raw(&msg->arg[ARG_PAYLOAD], &raw);
+    espnow_send_text(msg->mac, raw.ptr, raw.len, ESPNOW_TX_BULK, msg->ref);
+}
+
+static void cmd_get_config(const host_cmd_msg_t *msg) {
+    static const char request[] = "{\"type\":\"config_request\"}";
+    espnow_send_text(msg->mac, request, sizeof(request) - 1, ESPNOW_TX_CONFIG, msg->ref);
+}
+
+/* get_link_stats: per-node sequence statistics, for one node if mac is given */
+static void cmd_get_link_stats(const host_cmd_msg_t *msg) {
+    uint8_t target[6];
+
+    if (msg->arg[ARG_MAC].type == JSON_SPAN_NONE) {
+        espnow_seq_emit_stats(NULL);
+    } else if (!span_to_mac(&msg->arg[ARG_MAC], target) || espnow_seq_emit_stats(target) == 0) {
+        ESP_LOGW(TAG, "No link stats for %.*s", (int)msg->arg[ARG_MAC].len, msg->arg[ARG_MAC].ptr);
+    }
+}
+
+/* get_stats: gateway counters, drops and task stacks */
+static void cmd_get_stats(const host_cmd_msg_t *msg) {
+    int n = gateway_stats_json(s_text, sizeof(s_text));
+    if (n > 0) {
+        host_proto_emit_status(s_text, n);
+    }
+}
+
+#if CONFIG_GATEWAY_TRACE
+/* get_trace: per-frame stage times, oldest first, then a trace_end line */
+static void cmd_get_trace(const host_cmd_msg_t *msg) {
+    gateway_trace_dump();
+}
+#endif
+
+#if CONFIG_GATEWAY_NODE_LIVENESS
+/* get_roster: every tracked node with its online state and last frame age */
+static void cmd_get_roster(const host_cmd_msg_t *msg) {
+    node_liveness_emit_roster(s_text, sizeof(s_text));
+}
+#endif
+
+#if CONFIG_GATEWAY_OTA_RELAY
+/* ota_abort: stop the running firmware relay */
+static void cmd_ota_abort(const host_cmd_msg_t *msg) {
+    ota_relay_abort();
+}
+
+/* ota_begin: offer an image of "size" bytes to the nodes in "targets" */
+static void cmd_ota_begin(const host_cmd_msg_t *msg) {
+    uint8_t targets[OTA_RELAY_TARGETS][6];
+    json_span_t item;
+    size_t pos = 0;
+    uint32_t size = 0;
+    uint32_t crc32 = 0;
+    int count = 0;
+
+    while (json_span_array_next(&msg->arg[ARG_TARGETS], &pos, &item)) {
+        if (count == OTA_RELAY_TARGETS || !span_to_mac(&item, targets[count])) {
+            count = 0;
+            break;
+        }
+        count++;
+    }
+    if (!json_span_to_u32(&msg->arg[ARG_SIZE], &size) || !json_span_to_u32(&msg->arg[ARG_CRC32], &crc32)) {
+        size = 0;
+    }
+    // Invalid requests are answered by the relay as bad_request
+    ota_relay_begin(targets[0], count, size, crc32, msg->ref);
+}
+#endif
+
+/* get_sched_stats: outbound queue depth and wait times per priority class */
+static void cmd_get_sched_stats(const host_cmd_msg_t *msg) {
+    char reply[512];
+    int n = espnow_sched_stats_json(reply, sizeof(reply));
+    if (n > 0) {
+        host_proto_emit_status(reply, n);
+    }
+}
+
+static void cmd_set_config(const host_cmd_msg_t *msg) {
+    const json_span_t *cfg = &msg->arg[ARG_CONFIGURATIONS];
+    json_span_t raw;
+
+    ESP_LOGI(TAG, "Set Config");
+    if (cfg->type == JSON_SPAN_NONE) {
+        return;
+    }
+    json_span_raw(cfg, &raw);
+    int n = snprintf(s_text, HOST_CMD_TEXT_MAX, "{\"type\":\"set_config\",\"configurations\":%.*s}",
+                     (int)raw.len, raw.ptr);
+    if (n < 0 || n >= HOST_CMD_TEXT_MAX) {
+        ESP_LOGW(TAG, "set_config too long");
+        return;
+    }
+    espnow_send_text(msg->mac, s_text, n, ESPNOW_TX_CONFIG, msg->ref);
+}
+
+/* set_protocol: acknowledge in the current framing, then switch */
+static void cmd_set_protocol(const host_cmd_msg_t *msg) {
+    const json_span_t *proto = &msg->arg[ARG_PROTOCOL];
+    host_proto_mode_t mode;
+    char reply[64];
+
+    if (json_span_equals(proto, "json")) {
+        mode = HOST_PROTO_JSON;
+    } else if (json_span_equals(proto, "binary")) {
+        mode = HOST_PROTO_BINARY;
+    } else {
+        ESP_LOGW(TAG, "Unknown protocol from Node-RED: %.*s", (int)proto->len, proto->ptr ? proto->ptr : "");
+        return;
+    }
+    int n = snprintf(reply, sizeof(reply), "{\"type\":\"protocol_ack\",\"protocol\":\"%.*s\"}",
+                     (int)proto->len, proto->ptr);
+    host_proto_emit_status(reply, n);
+    host_proto_set_mode(mode);
+}
+
+/* system_reset: the command itself is what the node expects */
+static void cmd_system_reset(const host_cmd_msg_t *msg) {
+    ESP_LOGW(TAG, "Sending system_reset to node");
+    espnow_send_text(msg->mac, msg->line, msg->len, ESPNOW_TX_CONTROL, msg->ref);
+}
+
+/* Sorted by name for bsearch; host_cmd_init checks the order. */
+static const host_cmd_t s_commands[] = {
+    { "forward",         cmd_forward,         true  },
+    { "get_config",      cmd_get_config,      true  },
+    { "get_link_stats",  cmd_get_link_stats,  false },
+#if CONFIG_GATEWAY_NODE_LIVENESS
+    { "get_roster",      cmd_get_roster,      false },
+#endif
+    { "get_sched_stats", cmd_get_sched_stats, false },
+    { "get_stats",       cmd_get_stats,       false },
+#if CONFIG_GATEWAY_TRACE
+    { "get_trace",       cmd_get_trace,       false },
+#endif
+#if CONFIG_GATEWAY_OTA_RELAY
+    { "ota_abort",       cmd_ota_abort,       false },
+    { "ota_begin",       cmd_ota_begin,       false },
+#endif
+    { "set_config",      cmd_set_config,      true  },
+    { "set_protocol",    cmd_set_protocol,    false },
+    { "system_reset",    cmd_system_reset,    true  },
+};
+
+#define HOST_CMD_COUNT  (sizeof(s_commands) / sizeof(s_commands[0]))
+
+/* bsearch comparator, key is the json_span_t of "type" */
+static int cmd_compare(const void *key, const void *entry) {
+    const json_span_t *type = key;
+    const char *name = ((const host_cmd_t *)entry)->name;
+    int r = strncmp(type->ptr, name, type->len);
+    if (r == 0 && name[type->len] != 0) {
+        r = -1; // type is a proper prefix of name
+    }
+    return r;
+}
+
+static void host_cmd_run(const char *line, size_t len) {
+    host_cmd_msg_t msg = { .line = line, .len = json_scan_trim(line, len), .ref = 0 };
+    const host_cmd_t *cmd = NULL;
+
+    if (!json_scan_members(msg.line, msg.len, s_arg_keys, msg.arg, ARG_COUNT)) {
+        ESP_LOGW(TAG, "Failed to parse JSON from Node-RED");
+        gateway_stats_inc(GATEWAY_STAT_HOST_CMD_INVALID);
+        return;
+    }
+    if (msg.arg[ARG_TYPE].type != JSON_SPAN_STRING) {
+        ESP_LOGW(TAG, "Invalid command JSON from Node-RED");
+        gateway_stats_inc(GATEWAY_STAT_HOST_CMD_INVALID);
+        return;
+    }
+    cmd = bsearch(&msg.arg[ARG_TYPE], s_commands, HOST_CMD_COUNT, sizeof(host_cmd_t), cmd_compare);
+    if (cmd == NULL) {
+        ESP_LOGW(TAG, "Unknown type from Node-RED: %.*s", (int)msg.arg[ARG_TYPE].len, msg.arg[ARG_TYPE].ptr);
+        gateway_stats_inc(GATEWAY_STAT_HOST_CMD_INVALID);
+        return;
+    }
+    if (cmd->needs_mac && !span_to_mac(&msg.arg[ARG_MAC], msg.mac)) {
+        ESP_LOGW(TAG, "Invalid target MAC from Node-RED");
+        gateway_stats_inc(GATEWAY_STAT_HOST_CMD_INVALID);
+        return;
+    }
+    json_span_to_u32(&msg.arg[ARG_ID], &msg.ref);
+    cmd->fn(&msg);
+}
+
+static void host_cmd_task(void *arg) {
+    while (1) {
+        size_t n = xMessageBufferReceive(s_rx_mb, s_cmd_line, sizeof(s_cmd_line) - 1, portMAX_DELAY);
+        if (n > 0) {
+            s_cmd_line[n] = 0;
+            ESP_LOGI(TAG, "Host RX: %s", s_cmd_line);
+            host_cmd_run(s_cmd_line, n);
+        }
+    }
+}
+
+/* Queue one complete message from the host. In binary mode buf holds a COBS
+   frame, which is decoded and its command JSON queued; OTA chunks go to the
+   relay instead. Never waits for the command task: when the receive buffer is
+   full the message is dropped and counted. */
+static void host_cmd_submit(char *buf, size_t len) {
+    if (host_proto_get_mode() == HOST_PROTO_BINARY) {
+        host_frame_t frame;
+        if (host_proto_decode_frame((uint8_t *)buf, len, &frame) != ESP_OK) {
+            ESP_LOGW(TAG, "Dropped invalid frame from host");
+            return;
+        }
+#if CONFIG_GATEWAY_OTA_RELAY
+        // Chunks are copied into the relay window right here, not queued
+        if (frame.type == HOST_FRAME_OTA_CHUNK) {
+            ota_relay_host_chunk(frame.payload, frame.len);
+            return;
+        }
+#endif
+        if (frame.type != HOST_FRAME_CMD_JSON) {
+            ESP_LOGW(TAG, "Dropped invalid frame from host");
+            return;
+        }
+        buf = (char *)frame.payload;
+        len = frame.len;
+    }
+    bool sent = xMessageBufferSend(s_rx_mb, buf, len, 0) == len;
+    portENTER_CRITICAL(&s_stats_lock);
+    if (sent) {
+        s_stats.lines++;
+    } else {
+        s_stats.dropped++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    if (!sent) {
+        ESP_LOGW(TAG, "Host RX buffer full, dropped %d bytes", (int)len);
+    }
+}
+
+/* Host delimiter for the current protocol: newline for JSON, 0x00 for frames */
+static bool host_cmd_is_delimiter(char c) {
+    if (host_proto_get_mode() == HOST_PROTO_BINARY) {
+        return c == HOST_FRAME_DELIMITER;
+    }
+    return c == '\n' || c == '\r';
+}
+
+void host_cmd_feed(const uint8_t *data, size_t len) {
+    if (s_rx_mb == NULL) {
+        return; // not started yet
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char c = (char)data[i];
+        if (host_cmd_is_delimiter(c)) {
+            if (s_line_len > 0 && !s_line_discard) {
+                host_cmd_submit(s_line, s_line_len);
+            }
+            s_line_len = 0;
+            s_line_discard = false;
+        } else if (s_line_discard) {
+            continue;
+        } else if (s_line_len < sizeof(s_line) - 1) {
+            s_line[s_line_len++] = c;
+        } else {
+            // Too long: drop the rest up to the next delimiter as well
+            ESP_LOGW(TAG, "Host line longer than %d bytes dropped", HOST_CMD_LINE_MAX - 1);
+            portENTER_CRITICAL(&s_stats_lock);
+            s_stats.oversize++;
+            portEXIT_CRITICAL(&s_stats_lock);
+            s_line_discard = true;
+        }
+    }
+}
+
+esp_err_t host_cmd_init(void) {
+    TaskHandle_t task;
+
+    for (size_t i = 1; i < HOST_CMD_COUNT; i++) {
+        if (strcmp(s_commands[i - 1].name, s_commands[i].name) >= 0) {
+            ESP_LOGE(TAG, "Command table not sorted at %s", s_commands[i].name);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    s_rx_mb = xMessageBufferCreateStatic(sizeof(s_rx_storage), s_rx_storage, &s_rx_mb_struct);
+    if (s_rx_mb == NULL) {
+        ESP_LOGE(TAG, "Create message buffer fail");
+        return ESP_FAIL;
+    }
+    if (GATEWAY_TASK_CREATE(host_cmd_task, "host_cmd", HOST_CMD_TASK_STACK, GATEWAY_HOST_CMD_TASK_PRIO, &task,
+                            GATEWAY_SERIAL_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Create task fail");
+        return ESP_FAIL;
+    }
+    gateway_stats_watch_task(task);
+    return ESP_OK;
+}
+
+void host_cmd_get_stats(host_cmd_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
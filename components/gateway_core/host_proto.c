@@ -0,0 +1,280 @@
+/* HOST_PROTO.C
+   Host link framing
+
+   The host link starts in newline-terminated JSON mode. After the host sends
+   {"type":"set_protocol","protocol":"binary"} both directions switch to COBS
+   encoded frames delimited by 0x00 (see host_proto.h for the layout). Client
+   payloads that match the canonical sensor and heartbeat messages are sent as
+   a few bytes of binary; everything else is carried as JSON inside a frame.
+   tools/espnow_host_proto.js is the matching host-side decoder.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+#include "host_tx.h"
+#include "host_proto.h"
+
+static const char *TAG = "host_proto";
+
+static volatile host_proto_mode_t s_mode = HOST_PROTO_JSON;
+static host_proto_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Streaming COBS encoder. With out == NULL it only counts the encoded length. */
+typedef struct {
+    uint8_t *out;
+    size_t pos;
+    size_t code_pos;
+    uint8_t code;
+} cobs_enc_t;
+
+static void cobs_begin(cobs_enc_t *e, uint8_t *out) {
+    e->out = out;
+    e->code_pos = 0;
+    e->pos = 1;
+    e->code = 1;
+}
+
+static void cobs_close_block(cobs_enc_t *e) {
+    if (e->out) {
+        e->out[e->code_pos] = e->code;
+    }
+    e->code_pos = e->pos++;
+    e->code = 1;
+}
+
+static void cobs_put(cobs_enc_t *e, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == 0) {
+            cobs_close_block(e);
+            continue;
+        }
+        if (e->out) {
+            e->out[e->pos] = data[i];
+        }
+        e->pos++;
+        if (++e->code == 0xFF) {
+            cobs_close_block(e);
+        }
+    }
+}
+
+static size_t cobs_end(cobs_enc_t *e) {
+    if (e->out) {
+        e->out[e->code_pos] = e->code;
+    }
+    return e->pos;
+}
+
+static bool emit_frame(uint8_t type, const uint8_t *mac, const void *payload, size_t len) {
+    uint8_t hdr[HOST_FRAME_HDR_LEN];
+    uint8_t crc_le[HOST_FRAME_CRC_LEN];
+    uint16_t crc;
+    cobs_enc_t e;
+    size_t enc_len;
+    uint8_t *item;
+
+    if (len > UINT16_MAX) {
+        return false;
+    }
+    hdr[0] = type;
+    hdr[1] = len & 0xFF;
+    hdr[2] = len >> 8;
+    if (mac) {
+        memcpy(&hdr[3], mac, 6);
+    } else {
+        memset(&hdr[3], 0, 6);
+    }
+    crc = esp_crc16_le(UINT16_MAX, hdr, sizeof(hdr));
+    crc = esp_crc16_le(crc, payload, len);
+    crc_le[0] = crc & 0xFF;
+    crc_le[1] = crc >> 8;
+
+    // First pass sizes the frame so it can be encoded straight into the TX ring
+    cobs_begin(&e, NULL);
+    cobs_put(&e, hdr, sizeof(hdr));
+    cobs_put(&e, payload, len);
+    cobs_put(&e, crc_le, sizeof(crc_le));
+    enc_len = cobs_end(&e);
+
+    // Delimit on both sides so stray console output never merges with a frame
+    item = host_tx_acquire(enc_len + 2);
+    if (item == NULL) {
+        return false;
+    }
+    item[0] = HOST_FRAME_DELIMITER;
+    cobs_begin(&e, item + 1);
+    cobs_put(&e, hdr, sizeof(hdr));
+    cobs_put(&e, payload, len);
+    cobs_put(&e, crc_le, sizeof(crc_le));
+    cobs_end(&e);
+    item[enc_len + 1] = HOST_FRAME_DELIMITER;
+    host_tx_commit(item);
+    return true;
+}
+
+uint8_t host_proto_canonical_type(const uint8_t *mac, const char *json, size_t len, bool *status) {
+    static const char sensor_prefix[] = "{\"type\":\"sensor\"";
+    static const char heartbeat_prefix[] = "{\"type\":\"heartbeat\"";
+    char canon[96];
+    int n;
+
+    if (len >= sizeof(canon)) {
+        return HOST_FRAME_NODE_JSON;
+    }
+    if (len > sizeof(sensor_prefix) && memcmp(json, sensor_prefix, sizeof(sensor_prefix) - 1) == 0) {
+        *status = (json[len - 4] == 'u'); // ...true}} or ...false}}
+        n = snprintf(canon, sizeof(canon),
+                     "{\"type\":\"sensor\",\"payload\":{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"status\":%s}}",
+                     mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], *status ? "true" : "false");
+        if (n == (int)len && memcmp(canon, json, len) == 0) {
+            return HOST_FRAME_NODE_SENSOR;
+        }
+    } else if (len > sizeof(heartbeat_prefix) && memcmp(json, heartbeat_prefix, sizeof(heartbeat_prefix) - 1) == 0) {
+        n = snprintf(canon, sizeof(canon),
+                     "{\"type\":\"heartbeat\",\"payload\":{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"}}",
+                     mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        if (n == (int)len && memcmp(canon, json, len) == 0) {
+            return HOST_FRAME_NODE_HEARTBEAT;
+        }
+    }
+    return HOST_FRAME_NODE_JSON;
+}
+
+host_proto_mode_t host_proto_get_mode(void) {
+    return s_mode;
+}
+
+void host_proto_set_mode(host_proto_mode_t mode) {
+    if (mode != s_mode) {
+        ESP_LOGI(TAG, "Host protocol: %s", mode == HOST_PROTO_BINARY ? "binary" : "json");
+    }
+    s_mode = mode;
+}
+
+bool host_proto_emit_node(const uint8_t *mac, const char *json, size_t len) {
+    bool sensor_status = false;
+    uint8_t status;
+    uint8_t type;
+    bool ok;
+
+    if (s_mode == HOST_PROTO_JSON) {
+        return host_tx_send_line(json, len);
+    }
+
+    type = host_proto_canonical_type(mac, json, len, &sensor_status);
+    status = sensor_status;
+    switch (type) {
+        case HOST_FRAME_NODE_SENSOR:
+            ok = emit_frame(type, mac, &status, 1);
+            break;
+        case HOST_FRAME_NODE_HEARTBEAT:
+            ok = emit_frame(type, mac, NULL, 0);
+            break;
+        default:
+            ok = emit_frame(type, mac, json, len);
+            break;
+    }
+    if (ok) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.frames_tx++;
+        if (type != HOST_FRAME_NODE_JSON) {
+            s_stats.compact_tx++;
+        }
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    return ok;
+}
+
+bool host_proto_emit_status(const char *json, size_t len) {
+    bool ok;
+
+    if (s_mode == HOST_PROTO_JSON) {
+        return host_tx_send_line(json, len);
+    }
+    ok = emit_frame(HOST_FRAME_STATUS_JSON, NULL, json, len);
+    if (ok) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.frames_tx++;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    return ok;
+}
+
+bool host_proto_emit_trace(const void *records, size_t len) {
+    bool ok;
+
+    if (s_mode != HOST_PROTO_BINARY) {
+        return false;
+    }
+    ok = emit_frame(HOST_FRAME_TRACE, NULL, records, len);
+    if (ok) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.frames_tx++;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    return ok;
+}
+
+esp_err_t host_proto_decode_frame(uint8_t *buf, size_t len, host_frame_t *frame) {
+    size_t in = 0;
+    size_t out = 0;
+    uint16_t plen;
+    uint16_t crc;
+
+    // COBS decode in place; the output never overtakes the input
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if (code == 0 || in + code - 1 > len) {
+            goto bad_frame;
+        }
+        for (int i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        if (code != 0xFF && in < len) {
+            buf[out++] = 0;
+        }
+    }
+
+    if (out < HOST_FRAME_HDR_LEN + HOST_FRAME_CRC_LEN) {
+        goto bad_frame;
+    }
+    plen = buf[1] | (buf[2] << 8);
+    if ((size_t)plen + HOST_FRAME_HDR_LEN + HOST_FRAME_CRC_LEN != out) {
+        goto bad_frame;
+    }
+    crc = esp_crc16_le(UINT16_MAX, buf, HOST_FRAME_HDR_LEN + plen);
+    if (crc != (buf[out - 2] | (buf[out - 1] << 8))) {
+        goto bad_frame;
+    }
+
+    frame->type = buf[0];
+    memcpy(frame->mac, &buf[3], 6);
+    frame->payload = &buf[HOST_FRAME_HDR_LEN];
+    frame->len = plen;
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.frames_rx++;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return ESP_OK;
+
+bad_frame:
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.bad_frames_rx++;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return ESP_ERR_INVALID_CRC;
+}
+
+void host_proto_get_stats(host_proto_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
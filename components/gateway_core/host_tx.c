@@ -0,0 +1,291 @@
+/* HOST_TX.C
+   Serial TX writer task
+
+   All output to the host goes through a ring buffer drained by one writer
+   task. Producers copy complete lines into the ring without blocking, and the
+   writer packs as many queued lines as fit into a single driver write, so a
+   slow or absent host never stalls espnow_task. In pipeline mode espnow_task,
+   which produces nearly all of the output, has a lock-free ring of its own
+   and the writer takes from it first.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_log.h"
+#include "serial_port.h"
+#include "host_tx.h"
+#include "gateway_stats.h"
+#include "gateway_trace.h"
+#include "gateway_pipeline.h"
+#include "spsc_ring.h"
+
+static const char *TAG = "host_tx";
+
+#define HOST_TX_RING_SIZE       CONFIG_GATEWAY_HOST_TX_RING_SIZE
+#define HOST_TX_COALESCE_SIZE   CONFIG_GATEWAY_HOST_TX_COALESCE_SIZE
+#define HOST_TX_WRITE_TIMEOUT   pdMS_TO_TICKS(CONFIG_GATEWAY_HOST_TX_WRITE_TIMEOUT_MS)
+#define HOST_TX_PIPELINE_RING    CONFIG_GATEWAY_PIPELINE_TX_RING_SIZE
+
+static RingbufHandle_t s_tx_ring = NULL;
+static uint8_t s_coalesce[HOST_TX_COALESCE_SIZE];
+static host_tx_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if CONFIG_GATEWAY_PIPELINE
+static uint8_t s_fast_buf[HOST_TX_PIPELINE_RING] __attribute__((aligned(4)));
+static spsc_ring_t s_fast;
+static TaskHandle_t s_fast_producer = NULL;
+static TaskHandle_t s_writer = NULL;
+static _Atomic bool s_writer_idle;
+static _Atomic uint32_t s_fast_queued;      // Kept out of s_stats to stay lock-free.
+#endif
+
+/* Hand one buffer to the serial driver. Only called from the writer task. */
+static void host_tx_write(const uint8_t *data, size_t len) {
+    int written;
+
+    if (!serial_port_connected()) {
+        return;
+    }
+    written = serial_port_write(data, len, HOST_TX_WRITE_TIMEOUT);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.driver_writes++;
+    if (written > 0) {
+        s_stats.bytes_written += written;
+    }
+    if (written < (int)len) {
+        s_stats.short_writes++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Next queued item without waiting, espnow_task's ring first. */
+static uint8_t *host_tx_next(size_t *len, bool *fast) {
+#if CONFIG_GATEWAY_PIPELINE
+    uint8_t *item = spsc_ring_peek(&s_fast, len);
+    if (item != NULL) {
+        *fast = true;
+        return item;
+    }
+#endif
+    *fast = false;
+    return xRingbufferReceive(s_tx_ring, len, 0);
+}
+
+static uint8_t *host_tx_wait(size_t *len, bool *fast) {
+#if CONFIG_GATEWAY_PIPELINE
+    uint8_t *item;
+
+    while ((item = host_tx_next(len, fast)) == NULL) {
+        // Producers only notify after seeing the flag, see host_tx_wake
+        atomic_store_explicit(&s_writer_idle, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        item = host_tx_next(len, fast);
+        if (item == NULL) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        atomic_store_explicit(&s_writer_idle, false, memory_order_relaxed);
+        if (item != NULL) {
+            break;
+        }
+    }
+    return item;
+#else
+    *fast = false;
+    return xRingbufferReceive(s_tx_ring, len, portMAX_DELAY);
+#endif
+}
+
+static void host_tx_return(uint8_t *item, bool fast) {
+#if CONFIG_GATEWAY_PIPELINE
+    if (fast) {
+        spsc_ring_release(&s_fast, item);
+        return;
+    }
+#endif
+    vRingbufferReturnItem(s_tx_ring, item);
+}
+
+/* Frame tracing follows the items of the ring espnow_task writes to. */
+static bool host_tx_traced(bool fast) {
+#if CONFIG_GATEWAY_PIPELINE
+    return fast;
+#else
+    return true;
+#endif
+}
+
+static void host_tx_task(void *arg) {
+    uint8_t *pending = NULL;
+    size_t pending_len = 0;
+    bool pending_fast = false;
+
+    while (1) {
+        uint8_t *item;
+        size_t len;
+        size_t fill;
+        bool fast;
+        uint32_t items;
+
+        if (pending) {
+            item = pending;
+            len = pending_len;
+            fast = pending_fast;
+            pending = NULL;
+        } else {
+            item = host_tx_wait(&len, &fast);
+            if (item == NULL) {
+                continue;
+            }
+        }
+        items = host_tx_traced(fast);
+
+        if (len > sizeof(s_coalesce)) {
+            // Too large to coalesce, write it straight from the ring
+            host_tx_write(item, len);
+            host_tx_return(item, fast);
+            GATEWAY_TRACE_WRITTEN(items);
+            continue;
+        }
+
+        memcpy(s_coalesce, item, len);
+        fill = len;
+        host_tx_return(item, fast);
+
+        // Pack whatever else is already queued into the same write
+        while ((item = host_tx_next(&len, &fast)) != NULL) {
+            if (fill + len > sizeof(s_coalesce)) {
+                pending = item;
+                pending_len = len;
+                pending_fast = fast;
+                break;
+            }
+            memcpy(s_coalesce + fill, item, len);
+            fill += len;
+            items += host_tx_traced(fast);
+            host_tx_return(item, fast);
+        }
+
+        host_tx_write(s_coalesce, fill);
+        GATEWAY_TRACE_WRITTEN(items);
+    }
+}
+
+esp_err_t host_tx_init(void) {
+    TaskHandle_t task;
+
+    s_tx_ring = xRingbufferCreate(HOST_TX_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (s_tx_ring == NULL) {
+        ESP_LOGE(TAG, "Create TX ring fail");
+        return ESP_ERR_NO_MEM;
+    }
+
+#if CONFIG_GATEWAY_PIPELINE
+    spsc_ring_init(&s_fast, s_fast_buf, sizeof(s_fast_buf));
+#endif
+
+    if (GATEWAY_TASK_CREATE(host_tx_task, "host_tx", CONFIG_EXAMPLE_TASK_STACK_SIZE, GATEWAY_HOST_TX_TASK_PRIO, &task,
+                            GATEWAY_SERIAL_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Create TX task fail");
+        return ESP_FAIL;
+    }
+#if CONFIG_GATEWAY_PIPELINE
+    s_writer = task;
+#endif
+    gateway_stats_watch_task(task);
+    return ESP_OK;
+}
+
+#if CONFIG_GATEWAY_PIPELINE
+void host_tx_set_pipeline_producer(TaskHandle_t task) {
+    s_fast_producer = task;
+}
+
+/* Pairs with the fence in host_tx_wait: either the writer sees the new item,
+   or this sees the writer going to sleep. */
+static void host_tx_wake(void) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&s_writer_idle, memory_order_relaxed) && s_writer != NULL) {
+        xTaskNotifyGive(s_writer);
+    }
+}
+#endif
+
+void *host_tx_acquire(size_t len) {
+    void *item = NULL;
+
+#if CONFIG_GATEWAY_PIPELINE
+    if (s_fast_producer != NULL && xTaskGetCurrentTaskHandle() == s_fast_producer) {
+        item = spsc_ring_acquire(&s_fast, len);
+    } else
+#endif
+    if (s_tx_ring == NULL || xRingbufferSendAcquire(s_tx_ring, &item, len, 0) != pdTRUE) {
+        item = NULL;
+    }
+    if (item == NULL) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        return NULL;
+    }
+    return item;
+}
+
+void host_tx_commit(void *item) {
+#if CONFIG_GATEWAY_PIPELINE
+    if (spsc_ring_contains(&s_fast, item)) {
+        spsc_ring_commit(&s_fast, item);
+        atomic_fetch_add_explicit(&s_fast_queued, 1, memory_order_relaxed);
+        host_tx_wake();
+        return;
+    }
+#endif
+    xRingbufferSendComplete(s_tx_ring, item);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.queued++;
+    portEXIT_CRITICAL(&s_stats_lock);
+#if CONFIG_GATEWAY_PIPELINE
+    host_tx_wake();
+#endif
+}
+
+uint32_t host_tx_traced_queued(void) {
+#if CONFIG_GATEWAY_PIPELINE
+    return atomic_load_explicit(&s_fast_queued, memory_order_relaxed);
+#else
+    host_tx_stats_t tx;
+    host_tx_get_stats(&tx);
+    return tx.queued;
+#endif
+}
+
+bool host_tx_send_line(const char *data, size_t len) {
+    uint8_t *item = host_tx_acquire(len + 2);
+
+    if (item == NULL) {
+        return false;
+    }
+    memcpy(item, data, len);
+    memcpy(item + len, "\r\n", 2);
+    host_tx_commit(item);
+    return true;
+}
+
+void host_tx_get_stats(host_tx_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+#if CONFIG_GATEWAY_PIPELINE
+    stats->queued += atomic_load_explicit(&s_fast_queued, memory_order_relaxed);
+#endif
+}
@@ -0,0 +1,41 @@
+/* ESPNOW Compact Codec Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_CODEC_H
+#define ESPNOW_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Compact payloads (ESPNOW_DATA_COMPACT) are a list of TLV records:
+   tag(1) | len(1) | value(len). Unknown tags are skipped, so clients can add
+   fields without breaking older gateways. The client MAC is not sent; the
+   gateway takes it from the ESP-NOW frame header. */
+enum {
+    ESPNOW_TLV_MSG_TYPE = 0x01,           // u8, one of ESPNOW_MSG_*. Must come first.
+    ESPNOW_TLV_STATUS   = 0x02,           // u8, 0 or 1.
+    ESPNOW_TLV_CFG      = 0x03,           // u8 index + i32 LE value, rendered as "cfg<index>".
+};
+
+enum {
+    ESPNOW_MSG_SENSOR          = 1,
+    ESPNOW_MSG_HEARTBEAT       = 2,
+    ESPNOW_MSG_REGISTER        = 3,
+    ESPNOW_MSG_CONFIG_RESPONSE = 4,
+};
+
+/* Largest JSON text espnow_codec_to_json produces for one compact payload. */
+#define ESPNOW_CODEC_JSON_MAX     256
+
+/* Render a compact payload from mac as the JSON text the client would have sent.
+   Returns the JSON length, or -1 if the payload is malformed or does not fit. */
+int espnow_codec_to_json(const uint8_t *mac, const uint8_t *data, size_t len,
+                         char *out, size_t out_size, uint8_t *msg_type);
+
+#endif // ESPNOW_CODEC_H
@@ -0,0 +1,150 @@
+#ifndef ESPNOW_EXAMPLE_H
+#define ESPNOW_EXAMPLE_H
+
+#include <string.h>
+#include <stdbool.h>
+#include "esp_now.h"
+#include "esp_err.h"
+#include "esp_types.h"
+#include "cJSON.h"
+#include "espnow_sched.h"
+
+/* ESPNOW can work in both station and softap mode. It is configured in menuconfig. */
+#if CONFIG_ESPNOW_WIFI_MODE_STATION
+#define ESPNOW_WIFI_MODE WIFI_MODE_STA
+#define ESPNOW_WIFI_IF   ESP_IF_WIFI_STA
+#else
+#define ESPNOW_WIFI_MODE WIFI_MODE_AP
+#define ESPNOW_WIFI_IF   ESP_IF_WIFI_AP
+#endif
+//#MAC_SELF b4:3a:45:8a:29:80
+//#MAC_CLIENT e4:b3:23:b6:a8:08
+#define ESPNOW_CTRL_QUEUE_SIZE      CONFIG_GATEWAY_RX_CTRL_QUEUE_SIZE
+#define ESPNOW_DATA_QUEUE_SIZE      CONFIG_GATEWAY_RX_DATA_QUEUE_SIZE
+#if CONFIG_GATEWAY_RELIABLE_UNICAST
+#define ESPNOW_RELIABLE_MAX_FRAMES  CONFIG_GATEWAY_RELIABLE_MAX_FRAMES
+/* Every reliable frame in flight plus room for broadcast results. */
+#define ESPNOW_SEND_QUEUE_SIZE      (ESPNOW_RELIABLE_MAX_FRAMES + ESPNOW_CTRL_QUEUE_SIZE)
+#else
+#define ESPNOW_SEND_QUEUE_SIZE      ESPNOW_CTRL_QUEUE_SIZE
+#endif
+
+#define IS_BROADCAST_ADDR(addr) (memcmp(addr, s_broadcast_mac, ESP_NOW_ETH_ALEN) == 0)
+
+typedef enum {
+    ESPNOW_SEND_CB,
+    ESPNOW_RECV_CB,
+} espnow_event_id_t;
+
+typedef struct {
+    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+    esp_now_send_status_t status;
+} espnow_event_send_cb_t;
+
+typedef struct {
+    uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+    uint8_t *data;                        // Block from pkt_pool, returned by espnow_task.
+    int data_len;
+    uint32_t trace_id;                    // gateway_trace id, 0 when not traced.
+} espnow_event_recv_cb_t;
+
+typedef union {
+    espnow_event_send_cb_t send_cb;
+    espnow_event_recv_cb_t recv_cb;
+} espnow_event_info_t;
+
+/* When ESPNOW sending or receiving callback function is called, post event to ESPNOW task. */
+typedef struct {
+    espnow_event_id_t id;
+    espnow_event_info_t info;
+} espnow_event_t;
+
+enum {
+    ESPNOW_DATA_BROADCAST,
+    ESPNOW_DATA_UNICAST,
+    ESPNOW_DATA_COMPACT,                  // Binary TLV payload, see espnow_codec.h.
+    ESPNOW_DATA_AGGREGATE,                // Several records, see espnow_aggr_hdr_t.
+    ESPNOW_DATA_OTA,                      // Firmware relay, see ota_relay.h.
+    ESPNOW_DATA_MAX,
+};
+
+/* User defined field of ESPNOW data. */
+typedef struct {
+    uint8_t type;                         // Broadcast or unicast ESPNOW data.
+    uint16_t crc;                         // CRC16 value of ESPNOW data.
+    uint8_t payload[0];                   // Real payload of ESPNOW data.
+} __attribute__((packed)) espnow_data_t;
+
+/* Record header inside an ESPNOW_DATA_AGGREGATE payload. Records follow each
+   other back to back; type is BROADCAST, UNICAST or COMPACT and len counts
+   the record bytes after this header. */
+typedef struct {
+    uint8_t type;
+    uint16_t len;                         // LE.
+} __attribute__((packed)) espnow_aggr_hdr_t;
+
+/* Set in type when the frame carries the extended header below. */
+#define ESPNOW_DATA_EXT             0x80
+#define ESPNOW_HDR_V1               1
+#define ESPNOW_HDR_V2               2
+
+/* Header v2 flags. */
+#define ESPNOW_FLAG_FRAGMENT        0x01  // Payload is one fragment of a larger message.
+
+/* Extended header: espnow_data_t plus a version and a per-sender sequence number. */
+typedef struct {
+    uint8_t type;                         // Data type | ESPNOW_DATA_EXT.
+    uint16_t crc;                         // CRC16 value of ESPNOW data.
+    uint8_t version;                      // ESPNOW_HDR_V1.
+    uint16_t seq;                         // Incremented by the sender for every new frame, LE.
+    uint8_t payload[0];                   // Real payload of ESPNOW data.
+} __attribute__((packed)) espnow_data_ext_t;
+
+/* Extended header v2: v1 plus flags and the fragment fields. Every fragment of
+   a message carries its own seq and CRC, the message's data type and the same
+   msg_id; all fragments but the last have the same payload length. Without
+   ESPNOW_FLAG_FRAGMENT the fragment fields are ignored. */
+typedef struct {
+    uint8_t type;                         // Data type | ESPNOW_DATA_EXT.
+    uint16_t crc;                         // CRC16 value of ESPNOW data.
+    uint8_t version;                      // ESPNOW_HDR_V2 or later.
+    uint16_t seq;                         // Incremented by the sender for every new frame, LE.
+    uint8_t flags;                        // ESPNOW_FLAG_*.
+    uint16_t msg_id;                      // Incremented by the sender for every fragmented message, LE.
+    uint8_t frag_idx;                     // 0 .. frag_count - 1.
+    uint8_t frag_count;                   // Fragments in the message.
+    uint8_t payload[0];                   // Real payload of ESPNOW data.
+} __attribute__((packed)) espnow_data_v2_t;
+
+/* Largest frame the gateway sends, and largest message payload it sends or
+   reassembles. Longer messages are split into v2 fragments. */
+#if CONFIG_GATEWAY_FRAGMENTATION
+#define ESPNOW_FRAME_MAX            CONFIG_GATEWAY_MAX_FRAME_LEN
+#define ESPNOW_MESSAGE_MAX          CONFIG_GATEWAY_MAX_MESSAGE_LEN
+#else
+#define ESPNOW_FRAME_MAX            ESP_NOW_MAX_DATA_LEN_V2
+#define ESPNOW_MESSAGE_MAX          (ESP_NOW_MAX_DATA_LEN_V2 - sizeof(espnow_data_t))
+#endif
+
+/* Parameters of sending ESPNOW data. */
+typedef struct {
+    bool unicast;                         // Send unicast ESPNOW data.
+    bool broadcast;                       // Send broadcast ESPNOW data.
+    uint16_t delay;                       // Delay between sending two ESPNOW data, unit: ms.
+    int len;                              // Length of ESPNOW data to be sent, unit: byte.
+    uint8_t *buffer;                      // Buffer pointing to ESPNOW data.
+    uint8_t dest_mac[ESP_NOW_ETH_ALEN];   // MAC address of destination device.
+} espnow_send_param_t;
+
+extern uint8_t s_broadcast_mac[ESP_NOW_ETH_ALEN];
+
+/* Global Functions (gateway_core.c) */
+void mac_from_str(const char *s, uint8_t *mac);
+void mac_to_str(const uint8_t *mac, char *str, size_t len);
+int espnow_data_parse(uint8_t *data, uint16_t data_len, uint8_t *type);
+void espnow_data_prepare(espnow_send_param_t *send_param, uint8_t *payload, uint16_t payload_len);
+esp_err_t espnow_send_text(const uint8_t *mac_addr, const char *text, size_t text_len, espnow_tx_class_t cls, uint32_t ref);
+esp_err_t espnow_send_json(const uint8_t *mac_addr, cJSON *json, espnow_tx_class_t cls, uint32_t ref);
+esp_err_t espnow_send_data(const uint8_t *mac_addr, const uint8_t *data, uint16_t len);
+
+#endif // ESPNOW_EXAMPLE_H
@@ -0,0 +1,41 @@
+/* ESPNOW Fragment Reassembly Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_FRAG_H
+#define ESPNOW_FRAG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "espnow_example.h"
+
+#define ESPNOW_FRAG_SLOTS         CONFIG_GATEWAY_REASSEMBLY_SLOTS
+#define ESPNOW_FRAG_TIMEOUT_MS    CONFIG_GATEWAY_REASSEMBLY_TIMEOUT_MS
+
+typedef struct {
+    uint32_t tx_messages;                 // Messages sent as fragments.
+    uint32_t tx_fragments;                // Fragments queued for those messages.
+    uint32_t rx_fragments;                // Fragments received, duplicates included.
+    uint32_t rx_messages;                 // Messages reassembled and forwarded.
+    uint32_t rx_timeouts;                 // Partial messages dropped after ESPNOW_FRAG_TIMEOUT_MS.
+    uint32_t rx_evicted;                  // Partial messages dropped for a newer one.
+    uint32_t rx_invalid;                  // Fragments that do not fit their message.
+} espnow_frag_stats_t;
+
+/* Global Functions */
+/* Add a received fragment from mac. Returns the complete message payload once
+   the last missing fragment is in, NULL otherwise. The message stays valid
+   until the next call. For espnow_task only. */
+const uint8_t *espnow_frag_add(const uint8_t *mac, const espnow_data_v2_t *hdr, const uint8_t *payload,
+                               size_t len, size_t *msg_len);
+/* Count a message sent as count fragments. */
+void espnow_frag_sent(uint32_t count);
+void espnow_frag_get_stats(espnow_frag_stats_t *stats);
+
+#endif // ESPNOW_FRAG_H
@@ -0,0 +1,44 @@
+/* ESPNOW Reliable Unicast Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_RELIABLE_H
+#define ESPNOW_RELIABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+typedef struct {
+    uint32_t submitted;                   // Frames accepted for reliable delivery.
+    uint32_t delivered;                   // Frames acknowledged by the send callback.
+    uint32_t failed;                      // Frames given up after the last attempt.
+    uint32_t retries;                     // Retransmissions.
+    uint32_t rejected;                    // Frames refused because the table was full.
+    uint32_t timeouts;                    // Attempts whose send callback never came.
+    uint32_t late_results;                // Send callbacks of timed-out attempts, discarded.
+    uint32_t pending;                     // Frames currently queued, in flight or backing off.
+} espnow_reliable_stats_t;
+
+/* Global Functions */
+esp_err_t espnow_reliable_init(void);
+/* Queue a prepared ESP-NOW frame for mac. Takes ownership of frame (malloc'd)
+   in all cases. ref is echoed in the delivery report; frames with ref 0 are
+   not reported. */
+esp_err_t espnow_reliable_send(const uint8_t *mac, uint8_t *frame, size_t len, uint32_t ref);
+/* Whether another frame for mac would be sent at once rather than wait. */
+bool espnow_reliable_has_room(const uint8_t *mac);
+/* Called whenever a frame completes and frees room in the window. */
+void espnow_reliable_set_release_cb(void (*cb)(void));
+/* Feed a send callback result from espnow_task. */
+void espnow_reliable_on_send_cb(const uint8_t *mac, esp_now_send_status_t status);
+void espnow_reliable_get_stats(espnow_reliable_stats_t *stats);
+
+#endif // ESPNOW_RELIABLE_H
@@ -0,0 +1,55 @@
+/* ESPNOW Outbound Scheduler Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_SCHED_H
+#define ESPNOW_SCHED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Priority classes, served strictly in this order. */
+typedef enum {
+    ESPNOW_TX_CONTROL,                    // system_reset, register_ack.
+    ESPNOW_TX_CONFIG,                     // get_config, set_config.
+    ESPNOW_TX_BULK,                       // forward and anything else.
+    ESPNOW_TX_CLASS_MAX,
+} espnow_tx_class_t;
+
+typedef struct {
+    uint32_t depth;                       // Frames queued now.
+    uint32_t high_water;                  // Largest depth seen.
+    uint32_t sent;                        // Frames handed on for transmission.
+    uint32_t dropped;                     // Frames refused by the memory budget.
+    uint64_t wait_total_us;               // Sum of queueing delay of sent frames.
+    uint32_t wait_max_us;                 // Longest queueing delay of a sent frame.
+} espnow_sched_class_stats_t;
+
+typedef struct {
+    uint32_t queued_bytes;                // Frame bytes held now.
+    uint32_t peers;                       // Peers with queued frames now.
+    espnow_sched_class_stats_t cls[ESPNOW_TX_CLASS_MAX];
+} espnow_sched_stats_t;
+
+/* Global Functions */
+esp_err_t espnow_sched_init(void);
+/* Queue a prepared ESP-NOW frame (malloc'd) for mac. Takes ownership of frame
+   in all cases. ref is passed on to the delivery report of reliable unicast. */
+esp_err_t espnow_sched_submit(const uint8_t *mac, uint8_t *frame, size_t len, espnow_tx_class_t cls, uint32_t ref);
+/* Queue count frames for mac back to back in one lane, or none of them if
+   they do not all fit. Takes ownership of every frame in all cases. */
+esp_err_t espnow_sched_submit_all(const uint8_t *mac, uint8_t *const *frames, const uint16_t *lens, size_t count,
+                                  espnow_tx_class_t cls, uint32_t ref);
+/* Wake the scheduler, e.g. when the reliable window has room again. */
+void espnow_sched_kick(void);
+void espnow_sched_get_stats(espnow_sched_stats_t *stats);
+/* Render the stats as a {"type":"sched_stats",...} host reply. */
+int espnow_sched_stats_json(char *out, size_t out_size);
+
+#endif // ESPNOW_SCHED_H
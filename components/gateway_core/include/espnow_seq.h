@@ -0,0 +1,36 @@
+/* ESPNOW Sequence Tracking Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESPNOW_SEQ_H
+#define ESPNOW_SEQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define ESPNOW_SEQ_PEERS          CONFIG_GATEWAY_SEQ_PEERS
+#define ESPNOW_SEQ_WINDOW         32      // Sequence numbers remembered behind the newest.
+#define ESPNOW_SEQ_MAX_GAP        CONFIG_GATEWAY_SEQ_MAX_GAP
+
+typedef struct {
+    uint32_t tracked;                     // Nodes in the table now.
+    uint32_t duplicates;                  // Frames dropped as duplicates, all nodes.
+    uint32_t evictions;                   // Nodes dropped from a full table.
+} espnow_seq_stats_t;
+
+/* Global Functions */
+esp_err_t espnow_seq_init(void);
+/* Record seq from mac. Returns false if the frame is a duplicate and must be dropped. */
+bool espnow_seq_check(const uint8_t *mac, uint16_t seq);
+/* Send one {"type":"link_stats",...} status message per node, or only for mac
+   if it is not NULL. Returns the number of messages sent. */
+int espnow_seq_emit_stats(const uint8_t *mac);
+void espnow_seq_get_stats(espnow_seq_stats_t *stats);
+
+#endif // ESPNOW_SEQ_H
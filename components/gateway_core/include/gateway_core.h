@@ -0,0 +1,22 @@
+/* Gateway Core Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef GATEWAY_CORE_H
+#define GATEWAY_CORE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Global Functions */
+/* Bring up the serial port, host TX, ESP-NOW and the command pipeline.
+   NVS and the radio (or the mock driver) must be initialised already;
+   own_mac is the address announced to clients in register_ack. */
+esp_err_t gateway_core_init(const uint8_t *own_mac);
+
+#endif // GATEWAY_CORE_H
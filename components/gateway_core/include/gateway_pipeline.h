@@ -0,0 +1,49 @@
+/* Gateway Pipeline Header File
+
+   Task priorities and, with CONFIG_GATEWAY_PIPELINE, core affinity of the
+   gateway tasks. The radio stage (espnow_task, espnow_sched) and the serial
+   stage (host_tx, serial_reader, host_cmd) then run on separate cores.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef GATEWAY_PIPELINE_H
+#define GATEWAY_PIPELINE_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define GATEWAY_ESPNOW_TASK_PRIO        CONFIG_GATEWAY_ESPNOW_TASK_PRIO
+#define GATEWAY_SCHED_TASK_PRIO         CONFIG_GATEWAY_SCHED_TASK_PRIO
+#define GATEWAY_HOST_TX_TASK_PRIO       CONFIG_GATEWAY_HOST_TX_TASK_PRIO
+#define GATEWAY_READER_TASK_PRIO        CONFIG_GATEWAY_READER_TASK_PRIO
+#define GATEWAY_HOST_CMD_TASK_PRIO      CONFIG_GATEWAY_HOST_CMD_TASK_PRIO
+#define GATEWAY_PEER_FLUSH_TASK_PRIO    1       // Peer list flash writes can wait for everything else.
+
+/* Stack sizes are chosen for the chips. On the linux target every task is a
+   POSIX thread that also runs libc and the log formatting on its stack, so
+   no task gets less than CONFIG_EXAMPLE_TASK_STACK_SIZE there. */
+#if CONFIG_IDF_TARGET_LINUX
+#define GATEWAY_TASK_STACK(size) \
+    ((size) > CONFIG_EXAMPLE_TASK_STACK_SIZE ? (size) : CONFIG_EXAMPLE_TASK_STACK_SIZE)
+#else
+#define GATEWAY_TASK_STACK(size)        (size)
+#endif
+
+#if CONFIG_GATEWAY_PIPELINE
+#define GATEWAY_RADIO_CORE              CONFIG_GATEWAY_RADIO_CORE
+#define GATEWAY_SERIAL_CORE             CONFIG_GATEWAY_SERIAL_CORE
+#define GATEWAY_TASK_CREATE(fn, name, stack, prio, handle, core) \
+    xTaskCreatePinnedToCore(fn, name, stack, NULL, prio, handle, core)
+#else
+#define GATEWAY_RADIO_CORE              tskNO_AFFINITY
+#define GATEWAY_SERIAL_CORE             tskNO_AFFINITY
+#define GATEWAY_TASK_CREATE(fn, name, stack, prio, handle, core) \
+    xTaskCreate(fn, name, stack, NULL, prio, handle)
+#endif
+
+#endif // GATEWAY_PIPELINE_H
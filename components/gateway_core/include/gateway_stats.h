@@ -0,0 +1,63 @@
+/* Gateway Statistics Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef GATEWAY_STATS_H
+#define GATEWAY_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+/* Counters wrap at 2^32; alerting should look at the difference between two
+   reports. Names in the host reply are in gateway_stats.c. */
+typedef enum {
+    GATEWAY_STAT_RX_FRAMES,               // Frames queued by the receive callback.
+    GATEWAY_STAT_RX_BYTES,                // Bytes of those frames.
+    GATEWAY_STAT_RX_CONTROL,              // Of those, frames queued as control events.
+    GATEWAY_STAT_RX_INVALID,              // Frames dropped for length or header errors.
+    GATEWAY_STAT_CRC_FAIL,                // Frames dropped for a CRC mismatch.
+    GATEWAY_STAT_TX_FRAMES,               // Frames accepted by esp_now_send.
+    GATEWAY_STAT_TX_BYTES,                // Bytes of those frames.
+    GATEWAY_STAT_TX_FAIL,                 // esp_now_send or peer slot errors.
+    GATEWAY_STAT_SEND_CB_FAIL,            // Send callbacks reporting no MAC ack.
+    GATEWAY_STAT_SEND_RESULT_DROPPED,     // Send results dropped, send result queue full.
+    GATEWAY_STAT_CTRL_QUEUE_FULL,         // Control events dropped, control queue full.
+    GATEWAY_STAT_CTRL_QUEUE_HIGH_WATER,   // Deepest control queue seen (a maximum, not a count).
+    GATEWAY_STAT_DATA_DROPPED,            // Data frames dropped by the receive drop policy.
+    GATEWAY_STAT_DATA_QUEUE_HIGH_WATER,   // Deepest data queue seen (a maximum, not a count).
+    GATEWAY_STAT_ALLOC_FAIL,              // Receive pool or send buffer allocations that failed.
+    GATEWAY_STAT_HOST_CMD_INVALID,        // Host commands rejected by the command task.
+    GATEWAY_STAT_REPORT_TRUNCATED,        // Stats replies dropped for not fitting their buffer.
+    GATEWAY_STAT_MAX,
+} gateway_stat_t;
+
+#define GATEWAY_STATS_MAX_TASKS   8
+/* A reply with every option on, all counters at 10 digits and
+   GATEWAY_STATS_MAX_TASKS tasks is just under 2 KB. */
+#define GATEWAY_STATS_JSON_MAX    2048
+
+/* Global Functions */
+/* Start the periodic stats line if CONFIG_GATEWAY_STATS_INTERVAL_S is set. */
+esp_err_t gateway_stats_init(void);
+/* Counter updates are lock-free and safe from callbacks and ISRs. */
+void gateway_stats_add(gateway_stat_t id, uint32_t n);
+void gateway_stats_inc(gateway_stat_t id);
+/* Raise a high-water entry to value if it is larger. */
+void gateway_stats_max(gateway_stat_t id, uint32_t value);
+uint32_t gateway_stats_get(gateway_stat_t id);
+/* Report the stack high-water mark of task in the stats. */
+void gateway_stats_watch_task(TaskHandle_t task);
+/* Render counters, drops of the other modules and task stacks as a
+   {"type":"gateway_stats",...} host reply. Returns -1 and counts
+   GATEWAY_STAT_REPORT_TRUNCATED if it does not fit out_size. */
+int gateway_stats_json(char *out, size_t out_size);
+
+#endif // GATEWAY_STATS_H
@@ -0,0 +1,59 @@
+/* Gateway Trace Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef GATEWAY_TRACE_H
+#define GATEWAY_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define GATEWAY_TRACE_ENTRIES     CONFIG_GATEWAY_TRACE_ENTRIES
+#define GATEWAY_TRACE_NONE        UINT32_MAX  // Stage not reached (yet).
+
+/* Packed trace record, as sent in HOST_FRAME_TRACE frames. All fields little
+   endian; stage times are microseconds after rx_us. */
+typedef struct __attribute__((packed)) {
+    uint32_t id;                          // Trace id, increments per received frame.
+    uint8_t mac[6];                       // ESP-NOW source.
+    uint16_t len;                         // Frame length.
+    int64_t rx_us;                        // esp_timer_get_time() at receive callback entry.
+    uint32_t dequeue_us;                  // espnow_task took the frame from the event queue.
+    uint32_t parse_us;                    // Header, CRC and sequence checks passed.
+    uint32_t write_us;                    // Serial write of those lines returned.
+} gateway_trace_record_t;
+
+#if CONFIG_GATEWAY_TRACE
+/* Hot-path hooks. Ids are 0 for frames that were not traced. */
+uint32_t gateway_trace_rx(const uint8_t *mac, int len);
+void gateway_trace_drop(uint32_t id);
+void gateway_trace_dequeue(uint32_t id);
+void gateway_trace_parsed(uint32_t id);
+/* The frame is forwarded; its lines, if any, are in host TX. */
+void gateway_trace_queued(uint32_t id);
+void gateway_trace_written(uint32_t items);
+/* Send the ring, oldest first, in the current host protocol. Command task only. */
+void gateway_trace_dump(void);
+
+#define GATEWAY_TRACE_RX(mac, len)          gateway_trace_rx(mac, len)
+#define GATEWAY_TRACE_DROP(id)              gateway_trace_drop(id)
+#define GATEWAY_TRACE_DEQUEUE(id)           gateway_trace_dequeue(id)
+#define GATEWAY_TRACE_PARSED(id)            gateway_trace_parsed(id)
+#define GATEWAY_TRACE_QUEUED(id)            gateway_trace_queued(id)
+#define GATEWAY_TRACE_WRITTEN(items)        gateway_trace_written(items)
+#else
+#define GATEWAY_TRACE_RX(mac, len)          0
+#define GATEWAY_TRACE_DROP(id)              ((void)(id))
+#define GATEWAY_TRACE_DEQUEUE(id)           ((void)(id))
+#define GATEWAY_TRACE_PARSED(id)            ((void)(id))
+#define GATEWAY_TRACE_QUEUED(id)            ((void)(id))
+#define GATEWAY_TRACE_WRITTEN(items)        ((void)(items))
+#endif
+
+#endif // GATEWAY_TRACE_H
@@ -0,0 +1,43 @@
+/* Host Command Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef HOST_CMD_H
+#define HOST_CMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#if CONFIG_GATEWAY_FRAGMENTATION
+/* A command wrapping the longest message a node can be sent. */
+#define HOST_CMD_LINE_MAX         (CONFIG_GATEWAY_MAX_MESSAGE_LEN + 256)
+#elif CONFIG_GATEWAY_OTA_RELAY && CONFIG_GATEWAY_OTA_CHUNK_LEN > 960
+/* A binary OTA chunk frame, COBS encoded. */
+#define HOST_CMD_LINE_MAX         (CONFIG_GATEWAY_OTA_CHUNK_LEN + 64)
+#else
+#define HOST_CMD_LINE_MAX         1024
+#endif
+#define HOST_CMD_RX_BUFFER_SIZE   CONFIG_GATEWAY_HOST_RX_BUFFER_SIZE
+
+typedef struct {
+    uint32_t lines;                       // Messages queued for the command task.
+    uint32_t dropped;                     // Messages lost because the receive buffer was full.
+    uint32_t oversize;                    // Lines longer than HOST_CMD_LINE_MAX - 1, dropped.
+} host_cmd_stats_t;
+
+/* Global Functions */
+/* Create the command queue and the task that runs host commands. */
+esp_err_t host_cmd_init(void);
+/* Byte source entry point: feed raw bytes read from the host link. Messages
+   are split on the delimiter of the current host protocol; bytes fed before
+   host_cmd_init are dropped. Only one transport may feed bytes. */
+void host_cmd_feed(const uint8_t *data, size_t len);
+void host_cmd_get_stats(host_cmd_stats_t *stats);
+
+#endif // HOST_CMD_H
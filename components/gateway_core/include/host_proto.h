@@ -0,0 +1,73 @@
+/* Host Protocol Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef HOST_PROTO_H
+#define HOST_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/* Framing used on the host link. JSON is the default after boot. */
+typedef enum {
+    HOST_PROTO_JSON,                      // Newline-terminated JSON text in both directions.
+    HOST_PROTO_BINARY,                    // COBS frames terminated by 0x00 in both directions.
+} host_proto_mode_t;
+
+/* Binary frame types. A frame before COBS encoding is
+   type(1) | len(2, LE) | mac(6) | payload(len) | crc16(2, LE)
+   where crc16 is esp_crc16_le(UINT16_MAX, ...) over type..payload. */
+enum {
+    HOST_FRAME_NODE_JSON      = 0x01,     // Client JSON payload, mac is the ESP-NOW source.
+    HOST_FRAME_NODE_SENSOR    = 0x02,     // Canonical sensor event, payload is the status byte.
+    HOST_FRAME_NODE_HEARTBEAT = 0x03,     // Canonical heartbeat, no payload.
+    HOST_FRAME_STATUS_JSON    = 0x10,     // Gateway status or reply JSON, mac is zero.
+    HOST_FRAME_TRACE          = 0x11,     // get_trace records, gateway_trace_record_t each.
+    HOST_FRAME_CMD_JSON       = 0x20,     // Host command JSON, same commands as JSON mode.
+    HOST_FRAME_OTA_CHUNK      = 0x21,     // Firmware chunk, session(2) | index(4) | data, mac is zero.
+};
+
+#define HOST_FRAME_HDR_LEN        9
+#define HOST_FRAME_CRC_LEN        2
+#define HOST_FRAME_DELIMITER      0x00
+
+/* A decoded frame. payload points into the buffer given to host_proto_decode_frame. */
+typedef struct {
+    uint8_t type;
+    uint8_t mac[6];
+    uint8_t *payload;
+    uint16_t len;
+} host_frame_t;
+
+typedef struct {
+    uint32_t frames_tx;                   // Binary frames queued to the host.
+    uint32_t compact_tx;                  // Of those, sensor/heartbeat frames sent without JSON.
+    uint32_t frames_rx;                   // Valid frames received from the host.
+    uint32_t bad_frames_rx;               // Frames dropped for COBS, length or CRC errors.
+} host_proto_stats_t;
+
+/* Global Functions */
+host_proto_mode_t host_proto_get_mode(void);
+void host_proto_set_mode(host_proto_mode_t mode);
+/* Forward a client JSON payload received from mac in the current mode. */
+bool host_proto_emit_node(const uint8_t *mac, const char *json, size_t len);
+/* HOST_FRAME_NODE_SENSOR or HOST_FRAME_NODE_HEARTBEAT if json is exactly the
+   canonical message of that type for mac, so it can be rebuilt byte for byte,
+   else HOST_FRAME_NODE_JSON. status is set for sensor messages. */
+uint8_t host_proto_canonical_type(const uint8_t *mac, const char *json, size_t len, bool *status);
+/* Send a gateway status/reply JSON object in the current mode. */
+bool host_proto_emit_status(const char *json, size_t len);
+/* Send packed trace records; only valid in binary mode. */
+bool host_proto_emit_trace(const void *records, size_t len);
+/* Decode one COBS frame (without the delimiter) in place. */
+esp_err_t host_proto_decode_frame(uint8_t *buf, size_t len, host_frame_t *frame);
+void host_proto_get_stats(host_proto_stats_t *stats);
+
+#endif // HOST_PROTO_H
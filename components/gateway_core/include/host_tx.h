@@ -0,0 +1,47 @@
+/* Host TX Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef HOST_TX_H
+#define HOST_TX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+typedef struct {
+    uint32_t queued;            // Lines and frames accepted into the TX ring.
+    uint32_t dropped;           // Lines and frames rejected because the ring was full or not running.
+    uint32_t driver_writes;     // Driver write calls issued by the writer task.
+    uint32_t bytes_written;     // Bytes accepted by the driver.
+    uint32_t short_writes;      // Driver writes that timed out before all bytes were taken.
+} host_tx_stats_t;
+
+/* Global Functions */
+/* Create the TX ring and writer task. The serial port must already be initialised. */
+esp_err_t host_tx_init(void);
+/* Queue one line (CRLF is appended). Never blocks; returns false if the line was dropped. */
+bool host_tx_send_line(const char *data, size_t len);
+/* Reserve len bytes in the ring for the caller to fill, then commit. Never blocks;
+   returns NULL (and counts a drop) if there is no room. */
+void *host_tx_acquire(size_t len);
+void host_tx_commit(void *item);
+/* Items committed so far to the ring espnow_task writes to; frame tracing
+   matches its write stage against this. */
+uint32_t host_tx_traced_queued(void);
+#if CONFIG_GATEWAY_PIPELINE
+/* Lines queued by task bypass the shared ring through a lock-free ring of
+   their own. Only one task can be set. */
+void host_tx_set_pipeline_producer(TaskHandle_t task);
+#endif
+void host_tx_get_stats(host_tx_stats_t *stats);
+
+#endif // HOST_TX_H
@@ -0,0 +1,63 @@
+/* JSON Scanner Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Type of a value found by the scanner. */
+typedef enum {
+    JSON_SPAN_NONE,
+    JSON_SPAN_STRING,
+    JSON_SPAN_NUMBER,
+    JSON_SPAN_OBJECT,
+    JSON_SPAN_ARRAY,
+    JSON_SPAN_TRUE,
+    JSON_SPAN_FALSE,
+    JSON_SPAN_NULL,
+} json_span_type_t;
+
+/* A value inside a caller-owned buffer. Strings exclude the quotes and are not unescaped. */
+typedef struct {
+    const char *ptr;
+    size_t len;
+    json_span_type_t type;
+} json_span_t;
+
+/* Length of json with trailing whitespace and NUL padding removed. */
+size_t json_scan_trim(const char *json, size_t len);
+
+/* Check that json holds exactly one well-formed (RFC 8259) object, without building a tree.
+   single_line (optional) is cleared when a raw CR/LF appears between tokens,
+   i.e. the bytes cannot be written to the host as one line. */
+bool json_scan_object(const char *json, size_t len, bool *single_line);
+
+/* Find a top-level member of the object in json. Returns false if absent or malformed. */
+bool json_scan_get_member(const char *json, size_t len, const char *key, json_span_t *out);
+
+/* Validate the object in json and, in the same pass, find the top-level
+   members named in keys[0..count-1]. spans[i] is JSON_SPAN_NONE for an absent key. */
+bool json_scan_members(const char *json, size_t len, const char *const *keys, json_span_t *spans, size_t count);
+
+/* The bytes of a value as they appear in the text, i.e. strings with their quotes. */
+void json_span_raw(const json_span_t *span, json_span_t *raw);
+
+/* Value of a number span holding a plain non-negative integer that fits 32 bits. */
+bool json_span_to_u32(const json_span_t *span, uint32_t *out);
+
+/* Step through the values of an array span: start with *pos = 0, each call
+   returns the next value. False after the last one. */
+bool json_span_array_next(const json_span_t *array, size_t *pos, json_span_t *item);
+/* True if span is a string equal to str. */
+bool json_span_equals(const json_span_t *span, const char *str);
+
+#endif // JSON_SCAN_H
@@ -0,0 +1,43 @@
+/* Node Liveness Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef NODE_LIVENESS_H
+#define NODE_LIVENESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define NODE_LIVENESS_NODES       CONFIG_GATEWAY_LIVENESS_NODES
+#define NODE_OFFLINE_S            CONFIG_GATEWAY_NODE_OFFLINE_S
+#define NODE_ROSTER_INTERVAL_S    CONFIG_GATEWAY_ROSTER_INTERVAL_S
+
+typedef struct {
+    uint32_t tracked;                     // Nodes in the table now.
+    uint32_t online;                      // Of those, nodes heard within NODE_OFFLINE_S.
+    uint32_t absorbed;                    // Heartbeats not forwarded to the host.
+    uint32_t untracked;                   // Frames from nodes that found the table full.
+    uint32_t evictions;                   // Offline nodes dropped from a full table.
+} node_liveness_stats_t;
+
+/* Global Functions */
+esp_err_t node_liveness_init(void);
+/* Record a valid frame from mac. Sends node_online if the node was unknown
+   or offline. espnow_task only. */
+void node_liveness_seen(const uint8_t *mac);
+/* True if the heartbeat from mac is covered by the liveness table and must
+   not be forwarded. */
+bool node_liveness_absorb_heartbeat(const uint8_t *mac);
+/* Send the table as {"type":"roster",...} status messages, rendered in buf.
+   Returns the number of messages sent. */
+int node_liveness_emit_roster(char *buf, size_t size);
+void node_liveness_get_stats(node_liveness_stats_t *stats);
+
+#endif // NODE_LIVENESS_H
@@ -0,0 +1,48 @@
+/* Node Register Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef NODE_REGISTER_H
+#define NODE_REGISTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define NODE_REGISTER_NODES       CONFIG_GATEWAY_REGISTER_NODES
+#define NODE_REGISTER_BURST       CONFIG_GATEWAY_REGISTER_BURST
+#define NODE_REGISTER_REFILL_MS   CONFIG_GATEWAY_REGISTER_REFILL_MS
+#define NODE_REGISTER_JITTER_MS   CONFIG_GATEWAY_REGISTER_ACK_JITTER_MS
+#define NODE_REGISTER_SPACING_MS  CONFIG_GATEWAY_REGISTER_ACK_SPACING_MS
+
+typedef struct {
+    uint32_t requests;                    // register messages received.
+    uint32_t stored;                      // New peers added to the registry and NVS.
+    uint32_t cached;                      // Repeats answered from the cache.
+    uint32_t merged;                      // Repeats covered by an ack that was already pending.
+    uint32_t rate_limited;                // Requests dropped: no token left, or no idle cache entry.
+    uint32_t acks;                        // register_ack messages sent.
+    uint32_t evictions;                   // Least recently seen nodes dropped from the cache.
+} node_register_stats_t;
+
+/* Global Functions. All but node_register_init and node_register_get_stats
+   are for espnow_task only. */
+/* own_mac is the address announced in register_ack. */
+esp_err_t node_register_init(const uint8_t *own_mac);
+/* Handle a register request from mac: add the peer once and schedule an ack. */
+void node_register_request(const uint8_t *mac);
+/* Send the acks that are due. */
+void node_register_flush_due(void);
+/* Feed a send result for mac: a delivered ack puts the peer back on the LMK. */
+void node_register_send_result(const uint8_t *mac, bool ok);
+/* How long espnow_task may sleep before the next ack is due. */
+TickType_t node_register_wait(void);
+void node_register_get_stats(node_register_stats_t *stats);
+
+#endif // NODE_REGISTER_H
@@ -11,11 +11,14 @@
 #define NVS_HELPER_H
 
 /* Global Variables */
-#define MAX_PEERS 5
+#define MAX_PEERS CONFIG_GATEWAY_PEER_REGISTRY_SIZE
 /* Global Functions */
+/* Load the peer list. Calling it again reloads the list from flash and drops
+   peers that were not flushed yet. */
 esp_err_t nvs_init(void);
 esp_err_t nvs_store_peer_mac(const uint8_t *mac);
 esp_err_t nvs_load_peer_mac(uint8_t *mac_out);
 esp_err_t nvs_erase_peer_mac(void);
 esp_err_t nvs_get_all_peers(uint8_t mac_list[][6], size_t *count);
+esp_err_t nvs_flush_peers(void);
 #endif // NVS_HELPER_H
\ No newline at end of file
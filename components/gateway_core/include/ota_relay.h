@@ -0,0 +1,105 @@
+/* OTA Relay Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef OTA_RELAY_H
+#define OTA_RELAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+#define OTA_RELAY_CHUNK_LEN       CONFIG_GATEWAY_OTA_CHUNK_LEN
+#define OTA_RELAY_WINDOW          CONFIG_GATEWAY_OTA_WINDOW
+#define OTA_RELAY_TARGETS         CONFIG_GATEWAY_OTA_TARGETS
+#define OTA_RELAY_RETRY_MS        CONFIG_GATEWAY_OTA_RETRY_MS
+#define OTA_RELAY_MAX_RETRIES     CONFIG_GATEWAY_OTA_MAX_RETRIES
+
+/* Payload of an ESPNOW_DATA_OTA frame starts with one of these ops. All
+   numbers are LE. */
+enum {
+    OTA_OP_OFFER              = 0x01,     // Gateway → node: ota_offer_t.
+    OTA_OP_DATA               = 0x02,     // Gateway → node: ota_data_t and the chunk.
+    OTA_OP_ABORT              = 0x03,     // Gateway → node: ota_abort_t.
+    OTA_OP_ACK                = 0x81,     // Node → gateway: ota_ack_t.
+};
+
+/* OTA_DATA flags. */
+#define OTA_DATA_ACK_REQ          0x01    // Node answers with an ack right away.
+
+/* Node status in OTA_ACK. */
+enum {
+    OTA_STATUS_RECEIVING      = 0,        // Image not complete yet, or still being checked.
+    OTA_STATUS_OK             = 1,        // Every chunk received and the CRC-32 matched.
+    OTA_STATUS_ERROR          = 2,        // Node gives up, e.g. CRC mismatch or flash error.
+};
+
+/* Announces a session. Chunks are chunk_len bytes, the last one may be
+   shorter; at most window chunks past the node's first missing one are sent. */
+typedef struct {
+    uint8_t op;
+    uint16_t session;
+    uint32_t size;                        // Image bytes.
+    uint16_t chunk_len;
+    uint8_t window;
+    uint32_t crc32;                       // IEEE CRC-32 of the whole image.
+} __attribute__((packed)) ota_offer_t;
+
+typedef struct {
+    uint8_t op;
+    uint16_t session;
+    uint32_t index;                       // Chunk number, offset is index * chunk_len.
+    uint8_t flags;                        // OTA_DATA_*.
+    uint8_t data[0];
+} __attribute__((packed)) ota_data_t;
+
+typedef struct {
+    uint8_t op;
+    uint16_t session;
+} __attribute__((packed)) ota_abort_t;
+
+/* Selective acknowledgement. Chunks below next are all received; bit i of
+   bitmap is set if chunk next + 1 + i is received too. An ack with next = 0
+   accepts an offer. */
+typedef struct {
+    uint8_t op;
+    uint16_t session;
+    uint32_t next;                        // First missing chunk.
+    uint32_t bitmap;
+    uint8_t status;                       // OTA_STATUS_*.
+} __attribute__((packed)) ota_ack_t;
+
+typedef struct {
+    uint32_t sessions;                    // Sessions started.
+    uint32_t chunks_in;                   // Chunks accepted from the host.
+    uint32_t chunks_rejected;             // Host chunks out of order, out of credit or malformed.
+    uint32_t frames_sent;                 // OTA frames queued, retransmits included.
+    uint32_t retransmits;                 // Chunks sent again to a node that missed them.
+    uint32_t send_dropped;                // OTA frames the scheduler had no room for, sent again later.
+    uint32_t acks;                        // Acks received from target nodes.
+    uint32_t targets_ok;                  // Nodes that confirmed an image.
+    uint32_t targets_failed;              // Nodes that reported an error or stopped answering.
+} ota_relay_stats_t;
+
+/* Global Functions */
+esp_err_t ota_relay_init(void);
+/* Start relaying an image of size bytes to the count nodes whose MACs follow
+   each other in targets. Replies to the host with ota_started or ota_error;
+   ref is echoed in both and in the final ota_result. */
+void ota_relay_begin(const uint8_t *targets, int count, uint32_t size, uint32_t crc32, uint32_t ref);
+/* Stop the current session and tell its nodes. */
+void ota_relay_abort(void);
+/* A HOST_FRAME_OTA_CHUNK payload from the host: session(2) | index(4) | data. */
+void ota_relay_host_chunk(const uint8_t *data, size_t len);
+/* An ESPNOW_DATA_OTA payload from mac. espnow_task only. */
+void ota_relay_on_frame(const uint8_t *mac, const uint8_t *data, size_t len);
+void ota_relay_get_stats(ota_relay_stats_t *stats);
+
+#endif // OTA_RELAY_H
@@ -0,0 +1,48 @@
+/* Peer Registry Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef PEER_REGISTRY_H
+#define PEER_REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define PEER_REGISTRY_SIZE        CONFIG_GATEWAY_PEER_REGISTRY_SIZE
+#define PEER_DRIVER_SLOTS         CONFIG_GATEWAY_PEER_DRIVER_SLOTS
+
+typedef struct {
+    uint32_t peers;                       // Peers known to the gateway.
+    uint32_t resident;                    // Peers currently loaded in the ESP-NOW peer table.
+    uint32_t slot_hits;                   // Sends to a peer that was already resident.
+    uint32_t slot_loads;                  // Peers loaded into the driver on demand.
+    uint32_t slot_evictions;              // Least recently used peers removed to make room.
+    uint32_t full_rejects;                // Registrations refused because the registry was full.
+} peer_registry_stats_t;
+
+/* Global Functions */
+esp_err_t peer_registry_init(void);
+/* Add a peer to the registry only; it is loaded into the driver when first used.
+   is_new (optional) is set when the MAC was not known before. */
+esp_err_t peer_registry_add(const uint8_t *mac, bool *is_new);
+bool peer_registry_contains(const uint8_t *mac);
+/* Make sure mac holds an ESP-NOW peer slot before a unicast send, evicting the
+   least recently used peer if the driver table is full. */
+esp_err_t peer_registry_acquire_slot(const uint8_t *mac);
+/* Load mac into a free driver slot, if there is one, without evicting
+   anybody. Used for stored and newly registered peers; ESP_ERR_NO_MEM means
+   the peer stays on demand. */
+esp_err_t peer_registry_preload(const uint8_t *mac);
+/* With CONFIG_GATEWAY_PEER_ENCRYPT, load mac with (the default) or without
+   the LMK from now on, changing the driver entry if it is resident. Without
+   the option peers are always plain and this does nothing. */
+esp_err_t peer_registry_set_encrypt(const uint8_t *mac, bool encrypt);
+void peer_registry_get_stats(peer_registry_stats_t *stats);
+
+#endif // PEER_REGISTRY_H
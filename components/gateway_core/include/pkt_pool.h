@@ -0,0 +1,36 @@
+/* Packet Pool Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef PKT_POOL_H
+#define PKT_POOL_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_now.h"
+
+/* Every block holds the largest ESP-NOW v2 frame. */
+#define PKT_POOL_BLOCK_SIZE   ESP_NOW_MAX_DATA_LEN_V2
+#define PKT_POOL_BLOCKS       CONFIG_GATEWAY_RX_POOL_BLOCKS
+
+typedef struct {
+    uint32_t blocks;        // Total number of blocks.
+    uint32_t in_use;        // Blocks currently taken.
+    uint32_t high_water;    // Largest in_use value seen.
+    uint32_t taken;         // Successful takes since boot.
+    uint32_t exhausted;     // Takes that failed because the pool was empty.
+} pkt_pool_stats_t;
+
+/* Global Functions */
+esp_err_t pkt_pool_init(void);
+/* Take and give are safe from the Wi-Fi callback context and from ISRs. */
+uint8_t *pkt_pool_take(void);
+void pkt_pool_give(uint8_t *block);
+void pkt_pool_get_stats(pkt_pool_stats_t *stats);
+
+#endif // PKT_POOL_H
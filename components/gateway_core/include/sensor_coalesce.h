@@ -0,0 +1,37 @@
+/* Sensor Coalescing Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef SENSOR_COALESCE_H
+#define SENSOR_COALESCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+
+#define SENSOR_COALESCE_MS        CONFIG_GATEWAY_SENSOR_COALESCE_MS
+#define SENSOR_COALESCE_NODES     CONFIG_GATEWAY_SENSOR_COALESCE_NODES
+
+typedef struct {
+    uint32_t absorbed;                    // Sensor events counted in a window instead of forwarded.
+    uint32_t summaries;                   // sensor_summary messages sent.
+    uint32_t untracked;                   // Events forwarded because every window slot was busy.
+} sensor_coalesce_stats_t;
+
+/* Global Functions. All but sensor_coalesce_get_stats are for espnow_task only. */
+/* Offer a client message from mac. Returns true if it is a repeated sensor
+   event that was counted in the node's open window and must not be forwarded. */
+bool sensor_coalesce_event(const uint8_t *mac, const char *json, size_t len);
+/* Close the windows that have run out, sending their summaries. */
+void sensor_coalesce_flush_expired(void);
+/* How long espnow_task may sleep before a window runs out. */
+TickType_t sensor_coalesce_wait(void);
+void sensor_coalesce_get_stats(sensor_coalesce_stats_t *stats);
+
+#endif // SENSOR_COALESCE_H
@@ -0,0 +1,40 @@
+/* Serial Port Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/* The byte stream to the host. One backend is built per target:
+   USB Serial/JTAG on the ESP32-C6, UART0 on other chips and stdin/stdout
+   (or a pty) on the linux target. */
+
+/* Global Functions */
+/* Install the driver. Called once by gateway_core_init before any other call. */
+esp_err_t serial_port_init(void);
+/* Wait up to timeout for input and read what is there, at most len bytes.
+   Returns the number of bytes read, 0 on timeout. Only one reader task. */
+int serial_port_read(uint8_t *buf, size_t len, TickType_t timeout);
+/* Write len bytes, waiting up to timeout for room. Returns the bytes taken. */
+int serial_port_write(const uint8_t *data, size_t len, TickType_t timeout);
+/* False while no host is attached; output is then discarded. */
+bool serial_port_connected(void);
+
+#if CONFIG_IDF_TARGET_LINUX
+/* Hand all output to sink instead of stdout or the pty, e.g. to a benchmark
+   that timestamps the lines. NULL restores the descriptor. */
+void serial_port_set_sink(void (*sink)(const uint8_t *data, size_t len));
+#endif
+
+#endif // SERIAL_PORT_H
@@ -0,0 +1,50 @@
+/* SPSC Ring Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Ring bytes needed to hold count records of len bytes at once. */
+#define SPSC_RING_RECORD_SIZE(len)      (4 + (((len) + 3) & ~3u))
+#define SPSC_RING_SIZE(count, len)      (((count) + 1) * SPSC_RING_RECORD_SIZE(len))
+
+/* Lock-free ring of variable length records for exactly one producer task
+   and one consumer task. Records are contiguous, so producers build them in
+   place. buf must be 4-byte aligned and size a multiple of 4. */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    _Atomic size_t head;                  // Written by the producer only.
+    _Atomic size_t tail;                  // Written by the consumer only.
+} spsc_ring_t;
+
+/* Global Functions */
+void spsc_ring_init(spsc_ring_t *ring, void *buf, size_t size);
+/* Producer: room for a len byte record, or NULL if the ring is full. At most
+   one record may be acquired at a time; it is invisible until committed, and
+   an acquired record that is never committed is simply dropped. */
+void *spsc_ring_acquire(spsc_ring_t *ring, size_t len);
+void spsc_ring_commit(spsc_ring_t *ring, void *item);
+/* Consumer: oldest committed record, or NULL if the ring is empty. It stays
+   in the ring until released. */
+void *spsc_ring_peek(spsc_ring_t *ring, size_t *len);
+void spsc_ring_release(spsc_ring_t *ring, void *item);
+/* Bytes in use, including record headers. Exact only from the two tasks. */
+size_t spsc_ring_used(spsc_ring_t *ring);
+
+static inline bool spsc_ring_contains(const spsc_ring_t *ring, const void *item) {
+    return (const uint8_t *)item >= ring->buf && (const uint8_t *)item < ring->buf + ring->size;
+}
+
+#endif // SPSC_RING_H
@@ -0,0 +1,384 @@
+/* JSON_SCAN.C
+   Non-allocating JSON scanner
+
+   Walks JSON text in place to validate it or locate members, so payloads that
+   only need to be checked or routed do not have to be parsed into a cJSON tree.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdint.h>
+#include "json_scan.h"
+
+/* Nesting limit, keeps the recursion bounded on the task stack. */
+#define JSON_SCAN_MAX_DEPTH 16
+
+typedef struct {
+    const char *p;
+    const char *end;
+    bool single_line;
+} json_cursor_t;
+
+static bool scan_value(json_cursor_t *c, int depth, json_span_t *out);
+
+static void skip_ws(json_cursor_t *c) {
+    while (c->p < c->end) {
+        char ch = *c->p;
+        if (ch == '\n' || ch == '\r') {
+            c->single_line = false;
+        } else if (ch != ' ' && ch != '\t') {
+            break;
+        }
+        c->p++;
+    }
+}
+
+static bool is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+static bool is_hex(char ch) {
+    return is_digit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+/* Cursor on the backslash. Leaves it on the last character of a valid
+   escape: one of "\/bfnrt, or u and four hex digits. */
+static bool scan_escape(json_cursor_t *c) {
+    if (++c->p >= c->end) {
+        return false;
+    }
+    if (*c->p != 'u') {
+        return strchr("\"\\/bfnrt", *c->p) != NULL && *c->p != '\0';
+    }
+    if (c->end - c->p < 5) {
+        return false;
+    }
+    for (int i = 1; i <= 4; i++) {
+        if (!is_hex(c->p[i])) {
+            return false;
+        }
+    }
+    c->p += 4;
+    return true;
+}
+
+/* Cursor must be on the opening quote. Span excludes the quotes. */
+static bool scan_string(json_cursor_t *c, json_span_t *out) {
+    const char *start = ++c->p;
+    while (c->p < c->end) {
+        unsigned char ch = (unsigned char)*c->p;
+        if (ch == '"') {
+            if (out) {
+                out->ptr = start;
+                out->len = c->p - start;
+                out->type = JSON_SPAN_STRING;
+            }
+            c->p++;
+            return true;
+        }
+        if (ch < 0x20) {
+            return false; // raw control characters are not allowed inside strings
+        }
+        if (ch == '\\' && !scan_escape(c)) {
+            return false;
+        }
+        c->p++;
+    }
+    return false;
+}
+
+static bool scan_literal(json_cursor_t *c, const char *lit) {
+    size_t n = strlen(lit);
+    if ((size_t)(c->end - c->p) < n || memcmp(c->p, lit, n) != 0) {
+        return false;
+    }
+    c->p += n;
+    return true;
+}
+
+static bool scan_digits(json_cursor_t *c) {
+    const char *start = c->p;
+    while (c->p < c->end && is_digit(*c->p)) {
+        c->p++;
+    }
+    return c->p > start;
+}
+
+/* RFC 8259: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static bool scan_number(json_cursor_t *c) {
+    if (*c->p == '-') {
+        c->p++;
+    }
+    if (c->p < c->end && *c->p == '0') {
+        c->p++;
+    } else if (!scan_digits(c)) {
+        return false;
+    }
+    if (c->p < c->end && *c->p == '.') {
+        c->p++;
+        if (!scan_digits(c)) {
+            return false;
+        }
+    }
+    if (c->p < c->end && (*c->p == 'e' || *c->p == 'E')) {
+        c->p++;
+        if (c->p < c->end && (*c->p == '+' || *c->p == '-')) {
+            c->p++;
+        }
+        if (!scan_digits(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool scan_container(json_cursor_t *c, int depth, bool is_object) {
+    const char close = is_object ? '}' : ']';
+
+    if (depth >= JSON_SCAN_MAX_DEPTH) {
+        return false;
+    }
+    c->p++;
+    skip_ws(c);
+    if (c->p < c->end && *c->p == close) {
+        c->p++;
+        return true;
+    }
+    while (1) {
+        if (is_object) {
+            skip_ws(c);
+            if (c->p >= c->end || *c->p != '"' || !scan_string(c, NULL)) {
+                return false;
+            }
+            skip_ws(c);
+            if (c->p >= c->end || *c->p != ':') {
+                return false;
+            }
+            c->p++;
+        }
+        if (!scan_value(c, depth + 1, NULL)) {
+            return false;
+        }
+        skip_ws(c);
+        if (c->p >= c->end) {
+            return false;
+        }
+        if (*c->p == ',') {
+            c->p++;
+            continue;
+        }
+        if (*c->p == close) {
+            c->p++;
+            return true;
+        }
+        return false;
+    }
+}
+
+static bool scan_value(json_cursor_t *c, int depth, json_span_t *out) {
+    json_span_type_t type;
+    const char *start;
+    bool ok;
+
+    skip_ws(c);
+    if (c->p >= c->end) {
+        return false;
+    }
+    start = c->p;
+    switch (*c->p) {
+        case '"':
+            return scan_string(c, out);
+        case '{':
+            type = JSON_SPAN_OBJECT;
+            ok = scan_container(c, depth, true);
+            break;
+        case '[':
+            type = JSON_SPAN_ARRAY;
+            ok = scan_container(c, depth, false);
+            break;
+        case 't':
+            type = JSON_SPAN_TRUE;
+            ok = scan_literal(c, "true");
+            break;
+        case 'f':
+            type = JSON_SPAN_FALSE;
+            ok = scan_literal(c, "false");
+            break;
+        case 'n':
+            type = JSON_SPAN_NULL;
+            ok = scan_literal(c, "null");
+            break;
+        default:
+            type = JSON_SPAN_NUMBER;
+            ok = scan_number(c);
+            break;
+    }
+    if (ok && out) {
+        out->ptr = start;
+        out->len = c->p - start;
+        out->type = type;
+    }
+    return ok;
+}
+
+size_t json_scan_trim(const char *json, size_t len) {
+    while (len > 0) {
+        char ch = json[len - 1];
+        if (ch != '\0' && ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') {
+            break;
+        }
+        len--;
+    }
+    return len;
+}
+
+bool json_scan_object(const char *json, size_t len, bool *single_line) {
+    json_cursor_t c = { .p = json, .end = json + len, .single_line = true };
+    bool ok;
+
+    skip_ws(&c);
+    ok = c.p < c.end && *c.p == '{' && scan_value(&c, 0, NULL);
+    if (ok) {
+        skip_ws(&c);
+        ok = (c.p == c.end);
+    }
+    if (single_line) {
+        *single_line = c.single_line;
+    }
+    return ok;
+}
+
+/* Walk the members of the object in json and store the values of the listed
+   keys. With full set the whole object must be well formed; otherwise the walk
+   stops once every key has been found. The first occurrence of a key wins. */
+static bool scan_members(const char *json, size_t len, const char *const *keys, json_span_t *spans,
+                         size_t count, bool full) {
+    json_cursor_t c = { .p = json, .end = json + len, .single_line = true };
+    json_span_t name;
+    json_span_t value;
+    size_t found = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        spans[i].ptr = NULL;
+        spans[i].len = 0;
+        spans[i].type = JSON_SPAN_NONE;
+    }
+    skip_ws(&c);
+    if (c.p >= c.end || *c.p != '{') {
+        return false;
+    }
+    c.p++;
+    skip_ws(&c);
+    if (full && c.p < c.end && *c.p == '}') {
+        c.p++;
+        skip_ws(&c);
+        return c.p == c.end;
+    }
+    while (1) {
+        skip_ws(&c);
+        if (c.p >= c.end || *c.p != '"' || !scan_string(&c, &name)) {
+            return false;
+        }
+        skip_ws(&c);
+        if (c.p >= c.end || *c.p != ':') {
+            return false;
+        }
+        c.p++;
+        if (!scan_value(&c, 1, &value)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (spans[i].type == JSON_SPAN_NONE && json_span_equals(&name, keys[i])) {
+                spans[i] = value;
+                found++;
+                break;
+            }
+        }
+        if (!full && found == count) {
+            return true;
+        }
+        skip_ws(&c);
+        if (c.p < c.end && *c.p == ',') {
+            c.p++;
+            continue;
+        }
+        if (full && c.p < c.end && *c.p == '}') {
+            c.p++;
+            skip_ws(&c);
+            return c.p == c.end;
+        }
+        return false;
+    }
+}
+
+bool json_scan_get_member(const char *json, size_t len, const char *key, json_span_t *out) {
+    json_span_t value;
+
+    if (!scan_members(json, len, &key, &value, 1, false)) {
+        return false;
+    }
+    if (out) {
+        *out = value;
+    }
+    return true;
+}
+
+bool json_scan_members(const char *json, size_t len, const char *const *keys, json_span_t *spans, size_t count) {
+    return scan_members(json, len, keys, spans, count, true);
+}
+
+void json_span_raw(const json_span_t *span, json_span_t *raw) {
+    *raw = *span;
+    if (span->type == JSON_SPAN_STRING) {
+        raw->ptr--;
+        raw->len += 2;
+    }
+}
+
+bool json_span_to_u32(const json_span_t *span, uint32_t *out) {
+    uint32_t v = 0;
+
+    if (span->type != JSON_SPAN_NUMBER || span->len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < span->len; i++) {
+        char ch = span->ptr[i];
+        if (ch < '0' || ch > '9' || v > UINT32_MAX / 10 ||
+            (v == UINT32_MAX / 10 && (uint32_t)(ch - '0') > UINT32_MAX % 10)) {
+            return false; // negative, fractional, exponent or too large
+        }
+        v = v * 10 + (ch - '0');
+    }
+    *out = v;
+    return true;
+}
+
+bool json_span_array_next(const json_span_t *array, size_t *pos, json_span_t *item) {
+    json_cursor_t c = { .p = array->ptr + *pos, .end = array->ptr + array->len, .single_line = true };
+
+    if (array->type != JSON_SPAN_ARRAY) {
+        return false;
+    }
+    if (*pos == 0) {
+        c.p++; // '['
+    }
+    skip_ws(&c);
+    if (c.p >= c.end || *c.p == ']' || !scan_value(&c, 1, item)) {
+        return false;
+    }
+    skip_ws(&c);
+    if (c.p < c.end && *c.p == ',') {
+        c.p++;
+    }
+    *pos = c.p - array->ptr;
+    return true;
+}
+
+bool json_span_equals(const json_span_t *span, const char *str) {
+    size_t n = strlen(str);
+    return span->type == JSON_SPAN_STRING && span->len == n && memcmp(span->ptr, str, n) == 0;
+}
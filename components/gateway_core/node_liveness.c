@@ -0,0 +1,294 @@
+/* NODE_LIVENESS.C
+   Node liveness table
+
+   With CONFIG_GATEWAY_NODE_LIVENESS the gateway remembers when it last heard
+   from every node. espnow_task records each valid frame by source MAC; the
+   host only hears about transitions, as node_online and node_offline status
+   messages, and heartbeats from tracked nodes are no longer forwarded.
+   Offline detection runs on a timer wheel with one slot per second: an online
+   node sits in the slot of its deadline, and when a slot comes up each node in
+   it is either declared offline or, if it was heard from since, moved to the
+   slot of its new deadline. A frame therefore only updates a timestamp. The
+   table can optionally be sent as a compact periodic roster.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "host_proto.h"
+#include "node_liveness.h"
+
+#if CONFIG_GATEWAY_NODE_LIVENESS
+
+static const char *TAG = "node_liveness";
+
+#define LIVENESS_WHEEL_SLOTS      256     // Seconds, power of two. Longer timeouts take several turns.
+#define LIVENESS_HASH_BUCKETS     256     // Power of two.
+#define LIVENESS_NIL              UINT16_MAX
+#define ROSTER_TEXT_MAX           1024
+#define ROSTER_TRAILER_LEN        16      // ],"last":false} and the NUL.
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool online;
+    uint16_t hash_next;                   // Next entry in the same hash bucket.
+    uint16_t wheel_next;                  // Next entry in the same wheel slot, online nodes only.
+    uint32_t last_seen;                   // s_now at the last frame.
+} liveness_node_t;
+
+static liveness_node_t s_nodes[NODE_LIVENESS_NODES];
+static uint16_t s_hash[LIVENESS_HASH_BUCKETS];
+static uint16_t s_wheel[LIVENESS_WHEEL_SLOTS];
+static uint16_t s_used;                   // Entries handed out so far; they are never freed.
+static uint32_t s_now;                    // Seconds since init, advanced by the tick timer.
+static node_liveness_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_tick_timer;
+
+#if NODE_ROSTER_INTERVAL_S > 0
+/* Only used by the esp_timer task. */
+static char s_roster[ROSTER_TEXT_MAX];
+#endif
+
+static uint16_t *hash_head(const uint8_t *mac) {
+    return &s_hash[(mac[3] * 31u + mac[4] * 7u + mac[5]) & (LIVENESS_HASH_BUCKETS - 1)];
+}
+
+static uint16_t node_find(const uint8_t *mac) {
+    uint16_t idx = *hash_head(mac);
+
+    while (idx != LIVENESS_NIL && memcmp(s_nodes[idx].mac, mac, ESP_NOW_ETH_ALEN) != 0) {
+        idx = s_nodes[idx].hash_next;
+    }
+    return idx;
+}
+
+/* New entry for mac. Once the table is full the offline node heard from
+   longest ago makes room; if every node is online there is none. */
+static uint16_t node_add(const uint8_t *mac) {
+    uint16_t idx = LIVENESS_NIL;
+
+    if (s_used < NODE_LIVENESS_NODES) {
+        idx = s_used++;
+        s_stats.tracked++;
+    } else {
+        for (uint16_t i = 0; i < NODE_LIVENESS_NODES; i++) {
+            if (!s_nodes[i].online &&
+                (idx == LIVENESS_NIL || (int32_t)(s_nodes[i].last_seen - s_nodes[idx].last_seen) < 0)) {
+                idx = i;
+            }
+        }
+        if (idx == LIVENESS_NIL) {
+            return LIVENESS_NIL;
+        }
+        ESP_LOGD(TAG, "Evict node "MACSTR, MAC2STR(s_nodes[idx].mac));
+        for (uint16_t *link = hash_head(s_nodes[idx].mac); *link != LIVENESS_NIL; link = &s_nodes[*link].hash_next) {
+            if (*link == idx) {
+                *link = s_nodes[idx].hash_next;
+                break;
+            }
+        }
+        s_stats.evictions++;
+    }
+
+    liveness_node_t *n = &s_nodes[idx];
+    uint16_t *head = hash_head(mac);
+    memset(n, 0, sizeof(*n));
+    memcpy(n->mac, mac, ESP_NOW_ETH_ALEN);
+    n->hash_next = *head;
+    n->wheel_next = LIVENESS_NIL;
+    *head = idx;
+    return idx;
+}
+
+static void wheel_insert(uint16_t idx, uint32_t deadline) {
+    uint16_t *slot = &s_wheel[deadline & (LIVENESS_WHEEL_SLOTS - 1)];
+
+    s_nodes[idx].wheel_next = *slot;
+    *slot = idx;
+}
+
+/* Send a node_online or node_offline message. For node_online, secs is the
+   time the node was offline, or negative for a node not seen before. */
+static void emit_transition(const liveness_node_t *n, const char *type, const char *key, int64_t secs) {
+    char msg[112];
+    int len = snprintf(msg, sizeof(msg), "{\"type\":\"%s\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"",
+                       type, n->mac[0], n->mac[1], n->mac[2], n->mac[3], n->mac[4], n->mac[5]);
+    if (secs >= 0) {
+        len += snprintf(msg + len, sizeof(msg) - len, ",\"%s\":%" PRIu32, key, (uint32_t)secs);
+    }
+    len += snprintf(msg + len, sizeof(msg) - len, "}");
+    host_proto_emit_status(msg, len);
+}
+
+void node_liveness_seen(const uint8_t *mac) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t now = s_now;
+    uint16_t idx = node_find(mac);
+    int64_t offline_s = -1;
+
+    if (idx == LIVENESS_NIL) {
+        idx = node_add(mac);
+        if (idx == LIVENESS_NIL) {
+            s_stats.untracked++;
+            xSemaphoreGive(s_lock);
+            return;
+        }
+    } else if (!s_nodes[idx].online) {
+        offline_s = now - s_nodes[idx].last_seen;
+    }
+
+    liveness_node_t *n = &s_nodes[idx];
+    n->last_seen = now;
+    if (!n->online) {
+        n->online = true;
+        s_stats.online++;
+        wheel_insert(idx, now + NODE_OFFLINE_S);
+        emit_transition(n, "node_online", "offline_s", offline_s);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+bool node_liveness_absorb_heartbeat(const uint8_t *mac) {
+    bool absorb;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint16_t idx = node_find(mac);
+    absorb = idx != LIVENESS_NIL && s_nodes[idx].online;
+    if (absorb) {
+        s_stats.absorbed++;
+    }
+    xSemaphoreGive(s_lock);
+    return absorb;
+}
+
+static size_t roster_begin(char *buf, size_t size, int part, const node_liveness_stats_t *st) {
+    return snprintf(buf, size, "{\"type\":\"roster\",\"part\":%d,\"online\":%" PRIu32 ",\"offline\":%" PRIu32
+                    ",\"nodes\":[", part, st->online, st->tracked - st->online);
+}
+
+static bool roster_end(char *buf, size_t size, size_t pos, bool last) {
+    pos += snprintf(buf + pos, size - pos, "],\"last\":%s}", last ? "true" : "false");
+    return host_proto_emit_status(buf, pos);
+}
+
+/* Nodes are listed as ["mac",online,seconds since last frame], as many per
+   message as fit in buf. */
+int node_liveness_emit_roster(char *buf, size_t size) {
+    node_liveness_stats_t st;
+    int part = 1, count = 0, sent = 0;
+    uint16_t used;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    st = s_stats;
+    used = s_used;
+    xSemaphoreGive(s_lock);
+
+    size_t pos = roster_begin(buf, size, part, &st);
+    for (uint16_t i = 0; i < used; i++) {
+        liveness_node_t n;
+        uint32_t age;
+        char item[48];
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        n = s_nodes[i];
+        age = s_now - n.last_seen;
+        xSemaphoreGive(s_lock);
+
+        int len = snprintf(item, sizeof(item), ",[\"%02X:%02X:%02X:%02X:%02X:%02X\",%d,%" PRIu32 "]",
+                           n.mac[0], n.mac[1], n.mac[2], n.mac[3], n.mac[4], n.mac[5], n.online, age);
+        if (count > 0 && pos + len + ROSTER_TRAILER_LEN > size) {
+            sent += roster_end(buf, size, pos, false);
+            pos = roster_begin(buf, size, ++part, &st);
+            count = 0;
+        }
+        const char *text = count ? item : item + 1; // no comma before the first node
+        len -= (text - item);
+        if (pos + len + ROSTER_TRAILER_LEN > size) {
+            ESP_LOGW(TAG, "Roster buffer too small");
+            return sent;
+        }
+        memcpy(buf + pos, text, len);
+        pos += len;
+        count++;
+    }
+    sent += roster_end(buf, size, pos, true);
+    return sent;
+}
+
+/* Advance the clock and check the nodes whose deadline may have come. */
+static void tick_timer_cb(void *arg) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t now = ++s_now;
+    uint16_t *slot = &s_wheel[now & (LIVENESS_WHEEL_SLOTS - 1)];
+    uint16_t idx = *slot;
+
+    *slot = LIVENESS_NIL;
+    while (idx != LIVENESS_NIL) {
+        liveness_node_t *n = &s_nodes[idx];
+        uint16_t next = n->wheel_next;
+        uint32_t deadline = n->last_seen + NODE_OFFLINE_S;
+
+        if ((int32_t)(deadline - now) > 0) {
+            wheel_insert(idx, deadline);
+        } else {
+            n->online = false;
+            n->wheel_next = LIVENESS_NIL;
+            s_stats.online--;
+            ESP_LOGI(TAG, "Node "MACSTR" offline", MAC2STR(n->mac));
+            emit_transition(n, "node_offline", "silent_s", now - n->last_seen);
+        }
+        idx = next;
+    }
+    xSemaphoreGive(s_lock);
+
+#if NODE_ROSTER_INTERVAL_S > 0
+    if (now % NODE_ROSTER_INTERVAL_S == 0) {
+        node_liveness_emit_roster(s_roster, sizeof(s_roster));
+    }
+#endif
+}
+
+void node_liveness_get_stats(node_liveness_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t node_liveness_init(void) {
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_hash, 0xFF, sizeof(s_hash));
+    memset(s_wheel, 0xFF, sizeof(s_wheel));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_used = 0;
+    s_now = 0;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = tick_timer_cb,
+        .name = "node_liveness",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_tick_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Create tick timer fail: %s", esp_err_to_name(err));
+        return err;
+    }
+    return esp_timer_start_periodic(s_tick_timer, 1000000);
+}
+
+#endif // CONFIG_GATEWAY_NODE_LIVENESS
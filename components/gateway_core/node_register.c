@@ -0,0 +1,289 @@
+/* NODE_REGISTER.C
+   Paced handling of node registrations
+
+   With CONFIG_GATEWAY_REGISTER_PACING a register request no longer gets an
+   immediate broadcast register_ack. Every node that registers is kept in a
+   small cache. Only the first request of a node adds the peer and, if it is
+   new, stores it in NVS; repeats are answered from the cache. Each node has a
+   token bucket of NODE_REGISTER_BURST requests refilled every
+   NODE_REGISTER_REFILL_MS, and a request that finds the bucket empty is
+   dropped. Each ack is sent after a random delay of up to
+   NODE_REGISTER_JITTER_MS and at least NODE_REGISTER_SPACING_MS after the
+   one before. When a whole site reboots, the acks are spread out instead of
+   colliding with the next wave of requests. The ack goes by unicast, so no
+   node hears acks meant for others. With CONFIG_GATEWAY_PEER_ENCRYPT a node
+   that does not know the gateway yet has no key to read it with, so its peer
+   is switched to plain for the ack and back to the LMK once the ack's send
+   result arrives. A node with an ack pending or in flight is never evicted
+   from the cache; when every entry is busy, a request from a new node is
+   dropped as rate limited, and the node retries. Everything runs in
+   espnow_task, which also wakes up for the next due ack.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "espnow_example.h"
+#include "nvs_helper.h"
+#include "peer_registry.h"
+#include "node_register.h"
+
+#if CONFIG_GATEWAY_REGISTER_PACING
+
+static const char *TAG = "node_register";
+
+#define REGISTER_REFILL_US        ((int64_t)NODE_REGISTER_REFILL_MS * 1000)
+#define REGISTER_JITTER_US        ((uint32_t)NODE_REGISTER_JITTER_MS * 1000)
+#define REGISTER_SPACING_US       ((int64_t)NODE_REGISTER_SPACING_MS * 1000)
+#define REGISTER_NONE             INT64_MAX
+/* Longest a peer stays plain waiting for the ack's send result. A node that
+   missed the ack retries after at least the refill interval anyway. */
+#define REGISTER_PLAIN_US         REGISTER_REFILL_US
+
+typedef struct {
+    bool used;
+    bool is_peer;                         // In the peer registry, so it can be sent to.
+    bool ack_pending;
+    bool plain;                           // Peer switched to plain for an ack in flight.
+    uint8_t tokens;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int64_t refill_us;                    // Time the bucket was last topped up.
+    int64_t last_us;                      // Last request, for eviction.
+    int64_t due_us;                       // When the pending ack goes out.
+    int64_t plain_until_us;               // When the peer goes back to the LMK at the latest.
+} register_node_t;
+
+static register_node_t s_nodes[NODE_REGISTER_NODES];
+static char s_ack[64];
+static int s_ack_len;
+static int64_t s_next_due = REGISTER_NONE; // Earliest pending ack.
+static int64_t s_next_slot;               // No ack is scheduled before this.
+static node_register_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void stats_add(uint32_t *counter) {
+    portENTER_CRITICAL(&s_stats_lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Whether the entry still has an ack to send or to see through. */
+static bool node_busy(const register_node_t *n) {
+    return n->ack_pending || n->plain;
+}
+
+/* Entry for mac, taking a free or the least recently seen idle one if it is
+   new. NULL if every entry is busy. */
+static register_node_t *node_lookup(const uint8_t *mac, bool *is_new) {
+    register_node_t *victim = NULL;
+
+    for (int i = 0; i < NODE_REGISTER_NODES; i++) {
+        register_node_t *n = &s_nodes[i];
+        if (n->used && memcmp(n->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            *is_new = false;
+            return n;
+        }
+        if (n->used && node_busy(n)) {
+            continue;
+        }
+        if (victim == NULL || (victim->used && (!n->used || n->last_us < victim->last_us))) {
+            victim = n;
+        }
+    }
+    if (victim == NULL) {
+        return NULL;
+    }
+    if (victim->used) {
+        ESP_LOGD(TAG, "Evicting "MACSTR, MAC2STR(victim->mac));
+        stats_add(&s_stats.evictions);
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    memcpy(victim->mac, mac, ESP_NOW_ETH_ALEN);
+    *is_new = true;
+    return victim;
+}
+
+static void bucket_refill(register_node_t *n, int64_t now) {
+    int64_t add = (now - n->refill_us) / REGISTER_REFILL_US;
+
+    if (n->tokens + add >= NODE_REGISTER_BURST) {
+        n->tokens = NODE_REGISTER_BURST;
+        n->refill_us = now;
+    } else if (add > 0) {
+        n->tokens += add;
+        n->refill_us += add * REGISTER_REFILL_US;
+    }
+}
+
+static void ack_schedule(register_node_t *n, int64_t now) {
+    int64_t due = now;
+
+    if (REGISTER_JITTER_US > 0) {
+        due += esp_random() % (REGISTER_JITTER_US + 1);
+    }
+    if (due < s_next_slot) {
+        due = s_next_slot;
+    }
+    s_next_slot = due + REGISTER_SPACING_US;
+    n->ack_pending = true;
+    n->due_us = due;
+    if (due < s_next_due) {
+        s_next_due = due;
+    }
+}
+
+/* Put the peer back on the LMK after its ack. */
+static void ack_done(register_node_t *n) {
+    n->plain = false;
+    peer_registry_set_encrypt(n->mac, true);
+}
+
+/* Unicast the ack, plain under peer encryption. A node the registry had no
+   room for cannot be sent to and gets none. */
+static void ack_send(register_node_t *n, int64_t now) {
+    if (!n->is_peer) {
+        ESP_LOGW(TAG, "No peer entry to ack "MACSTR, MAC2STR(n->mac));
+        return;
+    }
+#if CONFIG_GATEWAY_PEER_ENCRYPT
+    peer_registry_set_encrypt(n->mac, false);
+    n->plain = true;
+    n->plain_until_us = now + REGISTER_PLAIN_US;
+#endif
+    if (espnow_send_text(n->mac, s_ack, s_ack_len, ESPNOW_TX_CONTROL, 0) == ESP_OK) {
+        ESP_LOGI(TAG, "Registered node "MACSTR, MAC2STR(n->mac));
+        stats_add(&s_stats.acks);
+    } else if (n->plain) {
+        ack_done(n);
+    }
+}
+
+esp_err_t node_register_init(const uint8_t *own_mac) {
+    s_ack_len = snprintf(s_ack, sizeof(s_ack), "{\"type\":\"register_ack\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"}",
+                         own_mac[0], own_mac[1], own_mac[2], own_mac[3], own_mac[4], own_mac[5]);
+    return ESP_OK;
+}
+
+void node_register_request(const uint8_t *mac) {
+    int64_t now = esp_timer_get_time();
+    bool is_new;
+    register_node_t *n = node_lookup(mac, &is_new);
+
+    stats_add(&s_stats.requests);
+    if (n == NULL) {
+        // Every entry waits on an ack; dropping one of those would lose it
+        ESP_LOGD(TAG, "No idle entry for "MACSTR, MAC2STR(mac));
+        stats_add(&s_stats.rate_limited);
+        return;
+    }
+    n->last_us = now;
+    if (is_new) {
+        n->tokens = NODE_REGISTER_BURST;
+        n->refill_us = now;
+    } else {
+        bucket_refill(n, now);
+    }
+    if (n->ack_pending) {
+        stats_add(&s_stats.merged);
+        return;
+    }
+    if (n->tokens == 0) {
+        ESP_LOGD(TAG, "Rate limited "MACSTR, MAC2STR(mac));
+        stats_add(&s_stats.rate_limited);
+        return;
+    }
+    n->tokens--;
+
+    if (n->is_peer) {
+        stats_add(&s_stats.cached);
+    } else {
+        bool is_peer_new = false;
+        n->is_peer = (peer_registry_add(mac, &is_peer_new) == ESP_OK);
+        if (n->is_peer) {
+            peer_registry_preload(mac);
+        }
+        if (is_peer_new) {
+            ESP_LOGI(TAG, "Adding peer "MACSTR, MAC2STR(mac));
+            nvs_store_peer_mac(mac);
+            stats_add(&s_stats.stored);
+        } else {
+            stats_add(&s_stats.cached);
+        }
+    }
+    ack_schedule(n, now);
+}
+
+void node_register_flush_due(void) {
+    int64_t now = esp_timer_get_time();
+
+    if (now < s_next_due) {
+        return;
+    }
+    s_next_due = REGISTER_NONE;
+    for (int i = 0; i < NODE_REGISTER_NODES; i++) {
+        register_node_t *n = &s_nodes[i];
+        if (!n->used) {
+            continue;
+        }
+        if (n->ack_pending && n->due_us <= now) {
+            n->ack_pending = false;
+            ack_send(n, now);
+        }
+        if (n->plain && n->plain_until_us <= now) {
+            ESP_LOGD(TAG, "No send result for the ack to "MACSTR, MAC2STR(n->mac));
+            ack_done(n);
+        }
+        if (n->ack_pending && n->due_us < s_next_due) {
+            s_next_due = n->due_us;
+        }
+        if (n->plain && n->plain_until_us < s_next_due) {
+            s_next_due = n->plain_until_us;
+        }
+    }
+}
+
+void node_register_send_result(const uint8_t *mac, bool ok) {
+#if CONFIG_GATEWAY_PEER_ENCRYPT
+    if (!ok) {
+        return; // A retry of the ack may follow, still plain
+    }
+    for (int i = 0; i < NODE_REGISTER_NODES; i++) {
+        register_node_t *n = &s_nodes[i];
+        if (n->used && n->plain && memcmp(n->mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            ack_done(n);
+            return;
+        }
+    }
+#endif
+}
+
+TickType_t node_register_wait(void) {
+    if (s_next_due == REGISTER_NONE) {
+        return portMAX_DELAY;
+    }
+    int64_t left_us = s_next_due - esp_timer_get_time();
+    if (left_us <= 0) {
+        return 0;
+    }
+    return pdMS_TO_TICKS((left_us + 999) / 1000) + 1;
+}
+
+void node_register_get_stats(node_register_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#endif // CONFIG_GATEWAY_REGISTER_PACING
@@ -0,0 +1,400 @@
+/* NVS_HELPER.C
+   NVS Helper Implementation File
+
+   The peer list is loaded into RAM in nvs_init and all lookups are served
+   from there. New peers are written back in batches: a flush runs
+   GATEWAY_PEER_FLUSH_INTERVAL_MS after the first unsaved change, or right away
+   once GATEWAY_PEER_FLUSH_THRESHOLD peers are waiting, so a mass re-registration
+   costs a few flash writes instead of one per node. The timer only wakes a
+   low-priority flush task, so a flash erase never holds up the other
+   esp_timer callbacks, and a failed flush is retried after the same delay.
+   A peer list that is present but cannot be read (an NVS error, a version
+   this firmware does not know, or a malformed header) is left alone: the
+   gateway runs with the peers it could load and no flush overwrites the
+   list until it is erased.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs_helper.h"
+#include "gateway_pipeline.h"
+// #include "cJSON.h"
+// #include "espnow_data.h"
+
+static const char *TAG = "nvs_helper";
+
+/* Configs */
+#define TAG "nvs_peer_mac"
+#define NVS_NAMESPACE "peer_storage"
+#define PEER_MAC_KEY "peer_macs"          // Version 1: packed 6-byte MACs.
+#define PEER_LIST_KEY "peer_list"         // Version 2: peer_blob_hdr_t + records.
+
+#define PEER_BLOB_VERSION 2
+#define PEER_FLUSH_DELAY_US ((uint64_t)CONFIG_GATEWAY_PEER_FLUSH_INTERVAL_MS * 1000)
+
+/* Versioned peer list. Readers use record_size to step over fields added by
+   newer firmware, so records can grow without a migration. */
+typedef struct {
+    uint8_t version;
+    uint8_t record_size;
+    uint16_t count;
+} __attribute__((packed)) peer_blob_hdr_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t flags;                        // Reserved, written as 0.
+    uint8_t reserved;
+} __attribute__((packed)) peer_record_t;
+
+static nvs_handle_t gnvs_handle;
+static SemaphoreHandle_t s_peer_lock = NULL;   // Guards the RAM peer list.
+static SemaphoreHandle_t s_flush_lock = NULL;  // Serializes flushes, owns s_blob while writing.
+static esp_timer_handle_t s_flush_timer = NULL;
+static TaskHandle_t s_flush_task = NULL;
+static uint8_t s_peer_macs[MAX_PEERS][6];
+static size_t s_peer_count = 0;
+static size_t s_dirty_count = 0;          // Peers added since the last flush.
+static bool s_legacy_key = false;         // Version 1 blob still present in flash.
+static bool s_load_failed = false;        // The list in flash could not be read; never overwrite it.
+static uint8_t s_blob[sizeof(peer_blob_hdr_t) + MAX_PEERS * sizeof(peer_record_t)];
+
+/* Take the peers from a version 2 list. Peers beyond MAX_PEERS are not
+   loaded, and the list is reported as unreadable so that it is kept. */
+static esp_err_t nvs_parse_peers(const uint8_t *blob, size_t len) {
+    peer_blob_hdr_t hdr;
+
+    if (len < sizeof(hdr)) {
+        ESP_LOGE(TAG, "Peer list of %d bytes has no header", (int)len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&hdr, blob, sizeof(hdr));
+    if (hdr.version != PEER_BLOB_VERSION) {
+        ESP_LOGE(TAG, "Unknown peer list version %d", hdr.version);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (hdr.record_size < 6 || sizeof(hdr) + (size_t)hdr.count * hdr.record_size > len) {
+        ESP_LOGE(TAG, "Invalid peer list v%d, %d records of %d bytes", hdr.version, hdr.count, hdr.record_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (int i = 0; i < hdr.count && s_peer_count < MAX_PEERS; i++) {
+        memcpy(s_peer_macs[s_peer_count++], blob + sizeof(hdr) + i * hdr.record_size, 6);
+    }
+    if (hdr.count > MAX_PEERS) {
+        ESP_LOGE(TAG, "Peer list holds %d peers, only %d fit", hdr.count, MAX_PEERS);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* Migrate the version 1 list; it is rewritten in the new format on the first flush. */
+static esp_err_t nvs_load_legacy_peers(void) {
+    size_t required_size = 0;
+    esp_err_t ret = nvs_get_blob(gnvs_handle, PEER_MAC_KEY, NULL, &required_size);
+
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret == ESP_OK && (required_size % 6 != 0 || required_size > sizeof(s_peer_macs))) {
+        ESP_LOGE(TAG, "Invalid version 1 peer list of %d bytes", (int)required_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(gnvs_handle, PEER_MAC_KEY, s_peer_macs, &required_size);
+    }
+    if (ret == ESP_OK) {
+        s_peer_count = required_size / 6;
+        s_legacy_key = true;
+        s_dirty_count = s_peer_count;
+    }
+    return ret;
+}
+
+/* Load the peer list from flash into RAM. The blob is read at the size
+   stored, since records written by newer firmware may be longer. */
+static esp_err_t nvs_load_peers(void) {
+    size_t required_size = 0;
+    uint8_t *blob;
+    esp_err_t ret = nvs_get_blob(gnvs_handle, PEER_LIST_KEY, NULL, &required_size);
+
+    s_peer_count = 0;
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return nvs_load_legacy_peers();
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    blob = malloc(required_size ? required_size : 1);
+    if (blob == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = nvs_get_blob(gnvs_handle, PEER_LIST_KEY, blob, &required_size);
+    if (ret == ESP_OK) {
+        ret = nvs_parse_peers(blob, required_size);
+    }
+    free(blob);
+    return ret;
+}
+
+/* Write the RAM peer list to flash if anything changed. The list is copied
+   under s_peer_lock and written outside it, so registrations never wait on flash. */
+esp_err_t nvs_flush_peers(void) {
+    esp_err_t ret = ESP_OK;
+    size_t dirty;
+    bool legacy;
+    bool blocked;
+    size_t blob_len;
+
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+    dirty = s_dirty_count;
+    legacy = s_legacy_key;
+    blocked = s_load_failed;
+    peer_blob_hdr_t hdr = {
+        .version = PEER_BLOB_VERSION,
+        .record_size = sizeof(peer_record_t),
+        .count = s_peer_count,
+    };
+    memcpy(s_blob, &hdr, sizeof(hdr));
+    for (int i = 0; i < s_peer_count; i++) {
+        peer_record_t rec = { 0 };
+        memcpy(rec.mac, s_peer_macs[i], 6);
+        memcpy(s_blob + sizeof(hdr) + i * sizeof(rec), &rec, sizeof(rec));
+    }
+    blob_len = sizeof(hdr) + s_peer_count * sizeof(peer_record_t);
+    xSemaphoreGive(s_peer_lock);
+
+    if (dirty == 0 && !legacy) {
+        xSemaphoreGive(s_flush_lock);
+        return ESP_OK;
+    }
+    if (blocked) {
+        // Writing now would replace the peers that could not be loaded
+        xSemaphoreGive(s_flush_lock);
+        ESP_LOGW(TAG, "Peer list in flash unreadable, %d new peers kept in RAM only", (int)dirty);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ret = nvs_set_blob(gnvs_handle, PEER_LIST_KEY, s_blob, blob_len);
+    if (ret == ESP_OK && legacy) {
+        ret = nvs_erase_key(gnvs_handle, PEER_MAC_KEY);
+        if (ret == ESP_ERR_NVS_NOT_FOUND) {
+            ret = ESP_OK;
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(gnvs_handle);
+    }
+    if (ret == ESP_OK) {
+        xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+        s_dirty_count = s_dirty_count > dirty ? s_dirty_count - dirty : 0;
+        s_legacy_key = false;
+        xSemaphoreGive(s_peer_lock);
+        ESP_LOGI(TAG, "Flushed %d peers (%d new)", hdr.count, (int)dirty);
+    } else {
+        ESP_LOGE(TAG, "Error storing peer list: %s", esp_err_to_name(ret));
+    }
+    xSemaphoreGive(s_flush_lock);
+    return ret;
+}
+
+static void nvs_flush_timer_cb(void *arg) {
+    xTaskNotifyGive(s_flush_task);
+}
+
+static void nvs_flush_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        esp_err_t ret = nvs_flush_peers();
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            // Otherwise only the next new peer would trigger another attempt
+            xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+            if (!esp_timer_is_active(s_flush_timer)) {
+                esp_timer_start_once(s_flush_timer, PEER_FLUSH_DELAY_US);
+            }
+            xSemaphoreGive(s_peer_lock);
+        }
+    }
+}
+
+/* Arm the write-behind timer. Caller holds s_peer_lock. */
+static void nvs_schedule_flush(void) {
+    if (s_dirty_count >= CONFIG_GATEWAY_PEER_FLUSH_THRESHOLD) {
+        esp_timer_stop(s_flush_timer);
+        esp_timer_start_once(s_flush_timer, 0);
+    } else if (!esp_timer_is_active(s_flush_timer)) {
+        esp_timer_start_once(s_flush_timer, PEER_FLUSH_DELAY_US);
+    }
+}
+
+/* One-time setup of the NVS partition, the locks and the flush task. */
+static esp_err_t nvs_setup(void) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // NVS partition was truncated and needs to be erased
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+    // Open NVS namespace
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &gnvs_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_peer_lock = xSemaphoreCreateMutex();
+    s_flush_lock = xSemaphoreCreateMutex();
+    if (s_peer_lock == NULL || s_flush_lock == NULL) {
+        ESP_LOGE(TAG, "Error creating peer lock");
+        return ESP_ERR_NO_MEM;
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = nvs_flush_timer_cb,
+        .name = "peer_flush",
+    };
+    ret = esp_timer_create(&timer_args, &s_flush_timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error creating flush timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    if (GATEWAY_TASK_CREATE(nvs_flush_task, "peer_flush", GATEWAY_TASK_STACK(3072),
+                            GATEWAY_PEER_FLUSH_TASK_PRIO, &s_flush_task, GATEWAY_SERIAL_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Error creating flush task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_init(void) {
+    esp_err_t ret;
+
+    if (s_peer_lock == NULL) {
+        ret = nvs_setup();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+    esp_timer_stop(s_flush_timer);
+    s_dirty_count = 0;
+    s_legacy_key = false;
+    ret = nvs_load_peers();
+    s_load_failed = (ret != ESP_OK);
+    if (s_load_failed) {
+        ESP_LOGE(TAG, "Error loading peer list: %s, not writing it back", esp_err_to_name(ret));
+    }
+    ESP_LOGI(TAG, "Loaded %d peers from storage", (int)s_peer_count);
+    if (s_legacy_key) {
+        nvs_schedule_flush();
+    }
+    xSemaphoreGive(s_peer_lock);
+    xSemaphoreGive(s_flush_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_store_peer_mac(const uint8_t *mac) {
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+    // Check if MAC already exists
+    for (int i = 0; i < s_peer_count; i++) {
+        if (memcmp(s_peer_macs[i], mac, 6) == 0) {
+            xSemaphoreGive(s_peer_lock);
+            ESP_LOGW(TAG, "MAC already exists in storage");
+            return ESP_OK; // MAC already exists
+        }
+    }
+
+    // Check if we have space for new peer
+    if (s_peer_count >= MAX_PEERS) {
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        memcpy(s_peer_macs[s_peer_count++], mac, 6);
+        s_dirty_count++;
+        nvs_schedule_flush();
+    }
+    xSemaphoreGive(s_peer_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Peer storage full (max %d peers)", MAX_PEERS);
+        return ret;
+    }
+    ESP_LOGI(TAG, "Stored peer MAC: %02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return ESP_OK;
+}
+
+esp_err_t nvs_load_peer_mac(uint8_t *mac_out) {
+    // This function loads the first peer MAC
+    xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+    if (s_peer_count == 0) {
+        xSemaphoreGive(s_peer_lock);
+        ESP_LOGE(TAG, "No peer MACs found in storage");
+        return ESP_ERR_NOT_FOUND;
+    }
+    memcpy(mac_out, s_peer_macs[0], 6);
+    xSemaphoreGive(s_peer_lock);
+
+    ESP_LOGI(TAG, "Loaded peer MAC: %02X:%02X:%02X:%02X:%02X:%02X",
+             mac_out[0], mac_out[1], mac_out[2], mac_out[3], mac_out[4], mac_out[5]);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_peer_mac(void) {
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+    s_peer_count = 0;
+    s_dirty_count = 0;
+    s_legacy_key = false;
+    s_load_failed = false;
+    esp_timer_stop(s_flush_timer);
+
+    esp_err_t ret = nvs_erase_key(gnvs_handle, PEER_LIST_KEY);
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = nvs_erase_key(gnvs_handle, PEER_MAC_KEY);
+    }
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) {
+        ret = nvs_commit(gnvs_handle);
+    }
+    xSemaphoreGive(s_peer_lock);
+    xSemaphoreGive(s_flush_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error erasing peer list: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "Erased all peer MACs from storage");
+    return ESP_OK;
+}
+
+// Additional function to get all stored peers. *count is the capacity of
+// mac_list on entry and the number of peers copied on return.
+esp_err_t nvs_get_all_peers(uint8_t mac_list[][6], size_t *count) {
+    xSemaphoreTake(s_peer_lock, portMAX_DELAY);
+    size_t n = s_peer_count < *count ? s_peer_count : *count;
+    memcpy(mac_list, s_peer_macs, n * 6);
+    xSemaphoreGive(s_peer_lock);
+
+    *count = n;
+    return n > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// Close NVS when done (optional)
+// void nvs_close(void) {
+//     nvs_close(nvs_handle);
+// }
@@ -0,0 +1,577 @@
+/* OTA_RELAY.C
+   Firmware relay from the host to client nodes
+
+   With CONFIG_GATEWAY_OTA_RELAY the host can stream a firmware image to one
+   or more nodes through the gateway. ota_begin offers the image to every
+   target; once they have all answered, the host is granted credit and sends
+   the image in binary HOST_FRAME_OTA_CHUNK frames, strictly in order. Only
+   the last OTA_RELAY_WINDOW chunks are kept, one slot each, so the RAM used
+   does not depend on the image size.
+
+   A new chunk goes out once, broadcast when more than one node still takes
+   part, so a whole fleet is served by the same frames. Nodes answer with
+   selective acks: the first chunk they miss plus a bitmap of the chunks after
+   it. A node that stays silent for OTA_RELAY_RETRY_MS gets exactly the chunks
+   its last ack reported missing, by unicast, and is dropped after
+   OTA_RELAY_MAX_RETRIES rounds without progress. The window only slides as
+   far as the slowest remaining node has acked, and the host is given credit
+   up to the end of the window, so a slow node throttles the host instead of
+   overflowing the gateway. A frame the outbound scheduler has no room for is
+   counted and sent again later: new chunks wait in their slot and the host
+   gets no more credit until they are out, and a retransmit round that got
+   nothing queued is repeated on the next timer tick without counting
+   against the node.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_crc.h"
+#include "espnow_example.h"
+#include "host_proto.h"
+#include "gateway_stats.h"
+#include "ota_relay.h"
+
+#if CONFIG_GATEWAY_OTA_RELAY
+
+static const char *TAG = "ota_relay";
+
+#define OTA_RETRY_US              ((int64_t)OTA_RELAY_RETRY_MS * 1000)
+#define OTA_ACK_EVERY             (OTA_RELAY_WINDOW / 2)
+#define OTA_CREDIT_STEP           (OTA_RELAY_WINDOW / 4 > 0 ? OTA_RELAY_WINDOW / 4 : 1)
+#define OTA_HOST_CHUNK_HDR_LEN    6       // session(2) | index(4)
+#define OTA_NONE                  UINT32_MAX
+#define OTA_FRAME_MAX             (sizeof(espnow_data_t) + sizeof(ota_data_t) + OTA_RELAY_CHUNK_LEN)
+
+_Static_assert(OTA_FRAME_MAX <= ESPNOW_FRAME_MAX, "GATEWAY_OTA_CHUNK_LEN does not fit one ESP-NOW frame");
+/* A full window of chunks must fit the outbound scheduler at once. */
+_Static_assert(OTA_RELAY_WINDOW * OTA_FRAME_MAX <= CONFIG_GATEWAY_TX_QUEUE_BYTES,
+               "GATEWAY_OTA_WINDOW * (GATEWAY_OTA_CHUNK_LEN + 11) exceeds GATEWAY_TX_QUEUE_BYTES");
+_Static_assert(OTA_RELAY_WINDOW <= CONFIG_GATEWAY_TX_QUEUE_FRAMES, "GATEWAY_OTA_WINDOW exceeds GATEWAY_TX_QUEUE_FRAMES");
+
+typedef enum {
+    TARGET_OFFERED,                       // Offer sent, waiting for the node to accept.
+    TARGET_ACTIVE,                        // Receiving chunks.
+    TARGET_OK,                            // Image confirmed by the node.
+    TARGET_FAILED,                        // Error reported, silent too long or aborted.
+} target_state_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    target_state_t state;
+    uint8_t retries;                      // Retry rounds since the node last made progress.
+    uint32_t next;                        // First chunk the node is missing.
+    uint32_t bitmap;                      // Chunks after next it has, as in ota_ack_t.
+    uint32_t retransmits;
+    int64_t heard_us;                     // Last ack, chunk sent while idle, or retry round.
+    int64_t done_us;
+} ota_target_t;
+
+typedef struct {
+    bool active;
+    bool streaming;                       // Every target answered the offer; the host has credit.
+    uint16_t session;
+    uint32_t ref;
+    uint32_t size;
+    uint32_t crc32;
+    uint32_t chunks;
+    uint32_t host_next;                   // Next chunk expected from the host.
+    uint32_t sent_next;                   // Next chunk to go out for the first time.
+    uint32_t credit_end;                  // The host may send chunks below this.
+    uint32_t rewind_at;                   // host_next of the last rewind credit, OTA_NONE if none.
+    int64_t start_us;
+    int target_count;
+    ota_target_t targets[OTA_RELAY_TARGETS];
+} ota_session_t;
+
+static ota_session_t s_ota;
+/* Chunk i lives in slot i % OTA_RELAY_WINDOW until every node has it. */
+static uint8_t s_chunks[OTA_RELAY_WINDOW][OTA_RELAY_CHUNK_LEN];
+static uint16_t s_session_id;
+static ota_relay_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_retry_timer = NULL;
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t chunk_len(uint32_t index) {
+    return (index + 1 < s_ota.chunks) ? OTA_RELAY_CHUNK_LEN : s_ota.size - index * OTA_RELAY_CHUNK_LEN;
+}
+
+/* ,"id":N when the host command had an id, else nothing. */
+static const char *id_member(char *buf, size_t size) {
+    buf[0] = 0;
+    if (s_ota.ref) {
+        snprintf(buf, size, ",\"id\":%" PRIu32, s_ota.ref);
+    }
+    return buf;
+}
+
+/* Queue an OTA frame: hdr followed by data. False, and counted, if it could
+   not be queued; the caller sends it again later. */
+static bool send_frame(const uint8_t *mac, const void *hdr, size_t hdr_len, const uint8_t *data, size_t data_len) {
+    size_t total_len = sizeof(espnow_data_t) + hdr_len + data_len;
+    espnow_data_t *frame = malloc(total_len);
+
+    if (frame == NULL) {
+        ESP_LOGE(TAG, "Malloc send buffer fail");
+        gateway_stats_inc(GATEWAY_STAT_ALLOC_FAIL);
+        s_stats.send_dropped++;
+        return false;
+    }
+    frame->type = ESPNOW_DATA_OTA;
+    frame->crc = 0;
+    memcpy(frame->payload, hdr, hdr_len);
+    if (data_len > 0) {
+        memcpy(frame->payload + hdr_len, data, data_len);
+    }
+    frame->crc = esp_crc16_le(UINT16_MAX, (uint8_t const *)frame, total_len);
+    if (espnow_sched_submit(mac, (uint8_t *)frame, total_len, ESPNOW_TX_BULK, 0) != ESP_OK) {
+        s_stats.send_dropped++;
+        return false;
+    }
+    s_stats.frames_sent++;
+    return true;
+}
+
+static bool send_offer(const ota_target_t *t) {
+    ota_offer_t offer = {
+        .op = OTA_OP_OFFER,
+        .session = s_ota.session,
+        .size = s_ota.size,
+        .chunk_len = OTA_RELAY_CHUNK_LEN,
+        .window = OTA_RELAY_WINDOW,
+        .crc32 = s_ota.crc32,
+    };
+    return send_frame(t->mac, &offer, sizeof(offer), NULL, 0);
+}
+
+static bool send_chunk(const uint8_t *mac, uint32_t index, uint8_t flags) {
+    ota_data_t hdr = {
+        .op = OTA_OP_DATA,
+        .session = s_ota.session,
+        .index = index,
+        .flags = flags,
+    };
+    return send_frame(mac, &hdr, sizeof(hdr), s_chunks[index % OTA_RELAY_WINDOW], chunk_len(index));
+}
+
+static bool target_pending(const ota_target_t *t) {
+    return t->state == TARGET_OFFERED || t->state == TARGET_ACTIVE;
+}
+
+/* First chunk some remaining node still misses; the window starts here. */
+static uint32_t window_base(void) {
+    uint32_t base = s_ota.chunks;
+
+    for (int i = 0; i < s_ota.target_count; i++) {
+        if (target_pending(&s_ota.targets[i]) && s_ota.targets[i].next < base) {
+            base = s_ota.targets[i].next;
+        }
+    }
+    return base;
+}
+
+static void emit_credit(void) {
+    char msg[128];
+    int n = snprintf(msg, sizeof(msg), "{\"type\":\"ota_credit\",\"session\":%u,\"next\":%" PRIu32 ",\"end\":%" PRIu32 "}",
+                     s_ota.session, s_ota.host_next, s_ota.credit_end);
+    host_proto_emit_status(msg, n);
+}
+
+/* Extend the host's credit to the end of the window. Credit goes out in
+   steps, or at once when the host has used all it had. */
+static void update_credit(void) {
+    uint32_t end = window_base() + OTA_RELAY_WINDOW;
+
+    // No new credit while chunks the host sent are still waiting to go out
+    if (!s_ota.streaming || s_ota.sent_next < s_ota.host_next) {
+        return;
+    }
+    if (end > s_ota.chunks) {
+        end = s_ota.chunks;
+    }
+    if (end > s_ota.credit_end &&
+        (end - s_ota.credit_end >= OTA_CREDIT_STEP || s_ota.host_next >= s_ota.credit_end)) {
+        s_ota.credit_end = end;
+        emit_credit();
+    }
+}
+
+static void target_finish(ota_target_t *t, target_state_t state) {
+    char msg[192];
+
+    t->state = state;
+    t->done_us = esp_timer_get_time();
+    if (state == TARGET_OK) {
+        s_stats.targets_ok++;
+    } else {
+        s_stats.targets_failed++;
+    }
+    int n = snprintf(msg, sizeof(msg),
+                     "{\"type\":\"ota_target\",\"session\":%u,\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+                     "\"status\":\"%s\",\"elapsed_ms\":%" PRId64 ",\"retransmits\":%" PRIu32 "}",
+                     s_ota.session, t->mac[0], t->mac[1], t->mac[2], t->mac[3], t->mac[4], t->mac[5],
+                     state == TARGET_OK ? "ok" : "failed", (t->done_us - s_ota.start_us) / 1000, t->retransmits);
+    host_proto_emit_status(msg, n);
+}
+
+/* End the session with an ota_result summary. */
+static void session_finish(bool aborted) {
+    char msg[320];
+    char id[24];
+    uint32_t ok = 0;
+    uint32_t failed = 0;
+    uint32_t retransmits = 0;
+    int64_t elapsed_ms = (esp_timer_get_time() - s_ota.start_us) / 1000;
+
+    esp_timer_stop(s_retry_timer);
+    if (elapsed_ms < 1) {
+        elapsed_ms = 1;
+    }
+    for (int i = 0; i < s_ota.target_count; i++) {
+        if (s_ota.targets[i].state == TARGET_OK) {
+            ok++;
+        } else {
+            failed++;
+        }
+        retransmits += s_ota.targets[i].retransmits;
+    }
+    int n = snprintf(msg, sizeof(msg),
+                     "{\"type\":\"ota_result\",\"session\":%u%s,\"status\":\"%s\",\"size\":%" PRIu32
+                     ",\"elapsed_ms\":%" PRId64 ",\"image_Bps\":%" PRIu64 ",\"delivered_Bps\":%" PRIu64
+                     ",\"ok\":%" PRIu32 ",\"failed\":%" PRIu32 ",\"retransmits\":%" PRIu32 "}",
+                     s_ota.session, id_member(id, sizeof(id)), aborted ? "aborted" : "done", s_ota.size, elapsed_ms,
+                     (uint64_t)s_ota.size * 1000 / elapsed_ms, (uint64_t)s_ota.size * ok * 1000 / elapsed_ms,
+                     ok, failed, retransmits);
+    host_proto_emit_status(msg, n);
+    ESP_LOGI(TAG, "Session %u %s: %" PRIu32 " ok, %" PRIu32 " failed in %" PRId64 " ms", s_ota.session,
+             aborted ? "aborted" : "done", ok, failed, elapsed_ms);
+    s_ota.active = false;
+}
+
+/* Start streaming once every offer is answered, finish when no node is
+   left, and pass window progress on to the host. */
+static void session_update(void) {
+    bool offered = false;
+    bool pending = false;
+
+    for (int i = 0; i < s_ota.target_count; i++) {
+        offered |= (s_ota.targets[i].state == TARGET_OFFERED);
+        pending |= target_pending(&s_ota.targets[i]);
+    }
+    if (!pending) {
+        session_finish(false);
+        return;
+    }
+    if (!s_ota.streaming && !offered) {
+        s_ota.streaming = true;
+    }
+    update_credit();
+}
+
+/* Send target the chunks its last ack reported missing, the last one with an
+   ack request. A node that has every chunk but has not confirmed the image
+   gets the last chunk again as a poll. Stops at the first frame the
+   scheduler refuses; false if nothing was queued. */
+static bool retransmit_missing(ota_target_t *t) {
+    uint32_t end = t->next + OTA_RELAY_WINDOW;
+    uint32_t last = OTA_NONE;
+    bool sent = false;
+
+    if (end > s_ota.sent_next) {
+        end = s_ota.sent_next;
+    }
+    for (uint32_t i = t->next; i < end; i++) {
+        if (i > t->next && (t->bitmap & (1UL << (i - t->next - 1)))) {
+            continue;
+        }
+        if (last != OTA_NONE) {
+            if (!send_chunk(t->mac, last, 0)) {
+                return sent;
+            }
+            sent = true;
+            t->retransmits++;
+            s_stats.retransmits++;
+        }
+        last = i;
+    }
+    if (last == OTA_NONE) {
+        last = s_ota.chunks - 1;
+    }
+    if (!send_chunk(t->mac, last, OTA_DATA_ACK_REQ)) {
+        return sent;
+    }
+    t->retransmits++;
+    s_stats.retransmits++;
+    return true;
+}
+
+/* Send chunk index to every active node for the first time: one broadcast
+   when several take part, retransmits are per node. */
+static bool send_new_chunk(uint32_t index) {
+    int64_t now = esp_timer_get_time();
+    uint8_t flags = ((index + 1) % OTA_ACK_EVERY == 0 || index + 1 == s_ota.chunks) ? OTA_DATA_ACK_REQ : 0;
+    const uint8_t *mac = NULL;
+    int active = 0;
+
+    for (int i = 0; i < s_ota.target_count; i++) {
+        if (s_ota.targets[i].state == TARGET_ACTIVE) {
+            mac = s_ota.targets[i].mac;
+            active++;
+        }
+    }
+    if (active > 1) {
+        mac = s_broadcast_mac;
+    }
+    if (active > 0 && !send_chunk(mac, index, flags)) {
+        return false;
+    }
+    for (int i = 0; i < s_ota.target_count; i++) {
+        ota_target_t *t = &s_ota.targets[i];
+        if (t->state == TARGET_ACTIVE && t->next == index) {
+            t->heard_us = now; // was idle, give the node its retry period
+        }
+    }
+    return true;
+}
+
+/* Send the chunks from the host that have not gone out yet, in order. */
+static void send_new_chunks(void) {
+    while (s_ota.sent_next < s_ota.host_next && send_new_chunk(s_ota.sent_next)) {
+        s_ota.sent_next++;
+    }
+}
+
+static void retry_timer_cb(void *arg) {
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_ota.active) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    for (int i = 0; i < s_ota.target_count; i++) {
+        ota_target_t *t = &s_ota.targets[i];
+        // Active nodes that have every chunk sent so far are just waiting
+        bool waiting = t->state == TARGET_OFFERED ||
+                       (t->state == TARGET_ACTIVE && (t->next < s_ota.sent_next || t->next >= s_ota.chunks));
+        if (!waiting || now - t->heard_us < OTA_RETRY_US) {
+            continue;
+        }
+        if (t->retries >= OTA_RELAY_MAX_RETRIES) {
+            ESP_LOGW(TAG, "No progress from "MACSTR", dropped at chunk %" PRIu32, MAC2STR(t->mac), t->next);
+            target_finish(t, TARGET_FAILED);
+            continue;
+        }
+        // A round the scheduler had no room for is tried again next tick
+        if (t->state == TARGET_OFFERED ? send_offer(t) : retransmit_missing(t)) {
+            t->retries++;
+            t->heard_us = now;
+        }
+    }
+    send_new_chunks();
+    session_update();
+    xSemaphoreGive(s_lock);
+}
+
+static void emit_error(const char *reason, uint32_t ref) {
+    char msg[96];
+    int n;
+
+    if (ref) {
+        n = snprintf(msg, sizeof(msg), "{\"type\":\"ota_error\",\"id\":%" PRIu32 ",\"reason\":\"%s\"}", ref, reason);
+    } else {
+        n = snprintf(msg, sizeof(msg), "{\"type\":\"ota_error\",\"reason\":\"%s\"}", reason);
+    }
+    host_proto_emit_status(msg, n);
+}
+
+esp_err_t ota_relay_init(void) {
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_timer_cb,
+        .name = "ota_retry",
+    };
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(&s_ota, 0, sizeof(s_ota));
+    memset(&s_stats, 0, sizeof(s_stats));
+    return esp_timer_create(&timer_args, &s_retry_timer);
+}
+
+void ota_relay_begin(const uint8_t *targets, int count, uint32_t size, uint32_t crc32, uint32_t ref) {
+    char msg[160];
+    char id[24];
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_ota.active) {
+        xSemaphoreGive(s_lock);
+        emit_error("busy", ref);
+        return;
+    }
+    if (host_proto_get_mode() != HOST_PROTO_BINARY) {
+        xSemaphoreGive(s_lock);
+        emit_error("binary_protocol_required", ref);
+        return;
+    }
+    if (count < 1 || count > OTA_RELAY_TARGETS || size == 0) {
+        xSemaphoreGive(s_lock);
+        emit_error("bad_request", ref);
+        return;
+    }
+
+    memset(&s_ota, 0, sizeof(s_ota));
+    s_ota.active = true;
+    if (++s_session_id == 0) {
+        s_session_id = 1;
+    }
+    s_ota.session = s_session_id;
+    s_ota.ref = ref;
+    s_ota.size = size;
+    s_ota.crc32 = crc32;
+    s_ota.chunks = (size + OTA_RELAY_CHUNK_LEN - 1) / OTA_RELAY_CHUNK_LEN;
+    s_ota.rewind_at = OTA_NONE;
+    s_ota.start_us = now;
+    s_ota.target_count = count;
+    s_stats.sessions++;
+
+    int n = snprintf(msg, sizeof(msg),
+                     "{\"type\":\"ota_started\",\"session\":%u%s,\"chunks\":%" PRIu32 ",\"chunk_len\":%d,\"window\":%d}",
+                     s_ota.session, id_member(id, sizeof(id)), s_ota.chunks, OTA_RELAY_CHUNK_LEN, OTA_RELAY_WINDOW);
+    host_proto_emit_status(msg, n);
+    ESP_LOGI(TAG, "Session %u: %" PRIu32 " bytes to %d nodes", s_ota.session, size, count);
+
+    for (int i = 0; i < count; i++) {
+        ota_target_t *t = &s_ota.targets[i];
+        memcpy(t->mac, targets + i * ESP_NOW_ETH_ALEN, ESP_NOW_ETH_ALEN);
+        t->state = TARGET_OFFERED;
+        t->heard_us = now;
+        send_offer(t);
+    }
+    esp_timer_start_periodic(s_retry_timer, OTA_RETRY_US / 2);
+    xSemaphoreGive(s_lock);
+}
+
+void ota_relay_abort(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_ota.active) {
+        ota_abort_t abort_msg = { .op = OTA_OP_ABORT, .session = s_ota.session };
+        for (int i = 0; i < s_ota.target_count; i++) {
+            ota_target_t *t = &s_ota.targets[i];
+            if (target_pending(t)) {
+                send_frame(t->mac, &abort_msg, sizeof(abort_msg), NULL, 0);
+                t->state = TARGET_FAILED;
+                s_stats.targets_failed++;
+            }
+        }
+        session_finish(true);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void ota_relay_host_chunk(const uint8_t *data, size_t len) {
+    uint16_t session;
+    uint32_t index;
+
+    if (len <= OTA_HOST_CHUNK_HDR_LEN) {
+        return;
+    }
+    session = data[0] | (data[1] << 8);
+    index = get_le32(&data[2]);
+    data += OTA_HOST_CHUNK_HDR_LEN;
+    len -= OTA_HOST_CHUNK_HDR_LEN;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_ota.active || !s_ota.streaming || session != s_ota.session || index >= s_ota.credit_end ||
+        index != s_ota.host_next || len != chunk_len(index)) {
+        s_stats.chunks_rejected++;
+        // A chunk was lost on the serial link: tell the host once where to go on
+        if (s_ota.active && s_ota.streaming && session == s_ota.session && index > s_ota.host_next &&
+            s_ota.rewind_at != s_ota.host_next) {
+            ESP_LOGW(TAG, "Chunk %" PRIu32 " from host, expected %" PRIu32, index, s_ota.host_next);
+            s_ota.rewind_at = s_ota.host_next;
+            emit_credit();
+        }
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    memcpy(s_chunks[index % OTA_RELAY_WINDOW], data, len);
+    s_ota.host_next++;
+    s_stats.chunks_in++;
+    send_new_chunks();
+    update_credit();
+    xSemaphoreGive(s_lock);
+}
+
+void ota_relay_on_frame(const uint8_t *mac, const uint8_t *data, size_t len) {
+    const ota_ack_t *ack = (const ota_ack_t *)data;
+    ota_target_t *t = NULL;
+
+    if (len < sizeof(ota_ack_t) || ack->op != OTA_OP_ACK) {
+        ESP_LOGI(TAG, "Bad OTA frame from "MACSTR, MAC2STR(mac));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; s_ota.active && ack->session == s_ota.session && i < s_ota.target_count; i++) {
+        if (memcmp(s_ota.targets[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            t = &s_ota.targets[i];
+            break;
+        }
+    }
+    if (t == NULL || !target_pending(t)) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    s_stats.acks++;
+    if (t->state == TARGET_OFFERED) {
+        ESP_LOGI(TAG, "Session %u accepted by "MACSTR, s_ota.session, MAC2STR(mac));
+        t->state = TARGET_ACTIVE;
+    }
+    // Acks can be reordered; only newer ones count. A node can not have
+    // chunks that were never sent.
+    uint32_t next = ack->next < s_ota.sent_next ? ack->next : s_ota.sent_next;
+    if (next > t->next || (next == t->next && ack->bitmap != t->bitmap)) {
+        t->retries = 0;
+    }
+    if (next >= t->next) {
+        t->next = next;
+        t->bitmap = ack->bitmap;
+    }
+    t->heard_us = esp_timer_get_time();
+    if (ack->status == OTA_STATUS_OK && t->next >= s_ota.chunks) {
+        target_finish(t, TARGET_OK);
+    } else if (ack->status == OTA_STATUS_ERROR) {
+        ESP_LOGW(TAG, "Node "MACSTR" failed at chunk %" PRIu32, MAC2STR(mac), t->next);
+        target_finish(t, TARGET_FAILED);
+    }
+    send_new_chunks();
+    session_update();
+    xSemaphoreGive(s_lock);
+}
+
+void ota_relay_get_stats(ota_relay_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+#endif // CONFIG_GATEWAY_OTA_RELAY
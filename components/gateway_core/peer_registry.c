@@ -0,0 +1,253 @@
+/* PEER_REGISTRY.C
+   Gateway-side peer registry
+
+   The ESP-NOW driver only holds a handful of encrypted peers, far fewer than a
+   site has nodes. The registry keeps every known node in RAM behind a hashed
+   MAC index. Peers are loaded into the driver table as long as it has free
+   slots, so a small site keeps every node resident and encrypted uplinks can
+   always be decrypted. Beyond that a peer is loaded when a unicast send needs
+   it, evicting the least recently used one. With CONFIG_GATEWAY_PEER_ENCRYPT
+   a peer can be switched to plain for a while, so that a node which does not
+   have the key yet can read its register_ack.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "espnow_example.h"
+#include "peer_registry.h"
+
+static const char *TAG = "peer_registry";
+
+#if CONFIG_GATEWAY_PEER_ENCRYPT && defined(CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM) && \
+    (PEER_DRIVER_SLOTS > CONFIG_ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM)
+#error "GATEWAY_PEER_DRIVER_SLOTS exceeds ESP_WIFI_ESPNOW_MAX_ENCRYPT_NUM"
+#endif
+
+/* Open addressing index, kept at most half full. */
+#if PEER_REGISTRY_SIZE <= 64
+#define PEER_INDEX_SIZE   128
+#elif PEER_REGISTRY_SIZE <= 256
+#define PEER_INDEX_SIZE   512
+#else
+#define PEER_INDEX_SIZE   2048
+#endif
+#define PEER_INDEX_MASK   (PEER_INDEX_SIZE - 1)
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int8_t slot;                          // Driver slot, -1 when not loaded.
+    bool plain;                           // Loaded without encryption despite CONFIG_GATEWAY_PEER_ENCRYPT.
+    uint32_t last_used;                   // Value of s_use_clock at the last send.
+} peer_entry_t;
+
+static peer_entry_t s_peers[PEER_REGISTRY_SIZE];
+static uint16_t s_peer_count;
+static int16_t s_index[PEER_INDEX_SIZE];
+static int16_t s_slots[PEER_DRIVER_SLOTS];
+static uint32_t s_use_clock;
+static peer_registry_stats_t s_stats;
+static SemaphoreHandle_t s_lock = NULL;
+
+static uint32_t mac_hash(const uint8_t *mac) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (int i = 0; i < ESP_NOW_ETH_ALEN; i++) {
+        h = (h ^ mac[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Index slot holding mac, or the empty slot where it would go. */
+static uint32_t index_probe(const uint8_t *mac) {
+    uint32_t h = mac_hash(mac) & PEER_INDEX_MASK;
+    while (s_index[h] >= 0 && memcmp(s_peers[s_index[h]].mac, mac, ESP_NOW_ETH_ALEN) != 0) {
+        h = (h + 1) & PEER_INDEX_MASK;
+    }
+    return h;
+}
+
+static void driver_peer_info(const peer_entry_t *p, esp_now_peer_info_t *peer) {
+    memset(peer, 0, sizeof(esp_now_peer_info_t));
+    peer->channel = CONFIG_ESPNOW_CHANNEL;
+    peer->ifidx = ESPNOW_WIFI_IF;
+#if CONFIG_GATEWAY_PEER_ENCRYPT
+    if (!p->plain) {
+        peer->encrypt = true;
+        memcpy(peer->lmk, CONFIG_ESPNOW_LMK, ESP_NOW_KEY_LEN);
+    }
+#endif
+    memcpy(peer->peer_addr, p->mac, ESP_NOW_ETH_ALEN);
+}
+
+static esp_err_t driver_add_peer(const peer_entry_t *p) {
+    esp_now_peer_info_t peer;
+
+    driver_peer_info(p, &peer);
+    esp_err_t err = esp_now_add_peer(&peer);
+    return err == ESP_ERR_ESPNOW_EXIST ? esp_now_mod_peer(&peer) : err;
+}
+
+esp_err_t peer_registry_init(void) {
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        ESP_LOGE(TAG, "Create mutex fail");
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_index, 0xFF, sizeof(s_index));
+    memset(s_slots, 0xFF, sizeof(s_slots));
+    s_peer_count = 0;
+    s_use_clock = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+    return ESP_OK;
+}
+
+esp_err_t peer_registry_add(const uint8_t *mac, bool *is_new) {
+    esp_err_t ret = ESP_OK;
+
+    if (is_new) {
+        *is_new = false;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t h = index_probe(mac);
+    if (s_index[h] < 0) {
+        if (s_peer_count >= PEER_REGISTRY_SIZE) {
+            s_stats.full_rejects++;
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            peer_entry_t *p = &s_peers[s_peer_count];
+            memcpy(p->mac, mac, ESP_NOW_ETH_ALEN);
+            p->slot = -1;
+            p->plain = false;
+            p->last_used = 0;
+            s_index[h] = s_peer_count++;
+            s_stats.peers = s_peer_count;
+            if (is_new) {
+                *is_new = true;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret == ESP_ERR_NO_MEM) {
+        ESP_LOGE(TAG, "Peer registry full (max %d peers)", PEER_REGISTRY_SIZE);
+    }
+    return ret;
+}
+
+bool peer_registry_contains(const uint8_t *mac) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = s_index[index_probe(mac)] >= 0;
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+/* Load mac into a driver slot. Without evict only a free slot is used, and
+   ESP_ERR_NO_MEM is returned if there is none. */
+static esp_err_t acquire_slot(const uint8_t *mac, bool evict) {
+    esp_err_t ret = ESP_OK;
+    int slot = -1;
+    int lru = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int16_t idx = s_index[index_probe(mac)];
+    if (idx < 0) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    peer_entry_t *p = &s_peers[idx];
+    p->last_used = ++s_use_clock;
+    if (p->slot >= 0) {
+        s_stats.slot_hits++;
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < PEER_DRIVER_SLOTS; i++) {
+        if (s_slots[i] < 0) {
+            slot = i;
+            break;
+        }
+        if (s_peers[s_slots[i]].last_used < s_peers[s_slots[lru]].last_used) {
+            lru = i;
+        }
+    }
+    if (slot < 0) {
+        if (!evict) {
+            xSemaphoreGive(s_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        peer_entry_t *victim = &s_peers[s_slots[lru]];
+        ESP_LOGD(TAG, "Evict peer "MACSTR, MAC2STR(victim->mac));
+        esp_now_del_peer(victim->mac);
+        victim->slot = -1;
+        s_slots[lru] = -1;
+        s_stats.slot_evictions++;
+        s_stats.resident--;
+        slot = lru;
+    }
+
+    ret = driver_add_peer(p);
+    if (ret == ESP_OK) {
+        s_slots[slot] = idx;
+        p->slot = slot;
+        s_stats.slot_loads++;
+        s_stats.resident++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Add peer "MACSTR" fail: %s", MAC2STR(mac), esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t peer_registry_acquire_slot(const uint8_t *mac) {
+    return acquire_slot(mac, true);
+}
+
+esp_err_t peer_registry_preload(const uint8_t *mac) {
+    return acquire_slot(mac, false);
+}
+
+esp_err_t peer_registry_set_encrypt(const uint8_t *mac, bool encrypt) {
+#if CONFIG_GATEWAY_PEER_ENCRYPT
+    esp_err_t ret = ESP_OK;
+    esp_now_peer_info_t peer;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int16_t idx = s_index[index_probe(mac)];
+    if (idx < 0) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else if (s_peers[idx].plain == encrypt) {
+        peer_entry_t *p = &s_peers[idx];
+        p->plain = !encrypt;
+        if (p->slot >= 0) {
+            driver_peer_info(p, &peer);
+            ret = esp_now_mod_peer(&peer);
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Modify peer "MACSTR" fail: %s", MAC2STR(mac), esp_err_to_name(ret));
+    }
+    return ret;
+#else
+    return ESP_OK;
+#endif
+}
+
+void peer_registry_get_stats(peer_registry_stats_t *stats) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
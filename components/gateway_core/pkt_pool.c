@@ -0,0 +1,82 @@
+/* PKT_POOL.C
+   Fixed-block receive buffer pool
+
+   Replaces the per-frame malloc in espnow_recv_cb. Blocks are statically
+   allocated and handed out from a free stack guarded by a spinlock, so the
+   Wi-Fi task never touches the heap on the receive path.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "pkt_pool.h"
+
+static const char *TAG = "pkt_pool";
+
+static uint8_t s_blocks[PKT_POOL_BLOCKS][PKT_POOL_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint16_t s_free[PKT_POOL_BLOCKS];
+static uint32_t s_free_count;
+static pkt_pool_stats_t s_stats;
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t pkt_pool_init(void) {
+    portENTER_CRITICAL_SAFE(&s_pool_lock);
+    for (int i = 0; i < PKT_POOL_BLOCKS; i++) {
+        s_free[i] = PKT_POOL_BLOCKS - 1 - i;
+    }
+    s_free_count = PKT_POOL_BLOCKS;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.blocks = PKT_POOL_BLOCKS;
+    portEXIT_CRITICAL_SAFE(&s_pool_lock);
+
+    ESP_LOGI(TAG, "Receive pool: %d blocks of %d bytes", PKT_POOL_BLOCKS, PKT_POOL_BLOCK_SIZE);
+    return ESP_OK;
+}
+
+uint8_t *pkt_pool_take(void) {
+    uint8_t *block = NULL;
+
+    portENTER_CRITICAL_SAFE(&s_pool_lock);
+    if (s_free_count > 0) {
+        block = s_blocks[s_free[--s_free_count]];
+        s_stats.taken++;
+        s_stats.in_use++;
+        if (s_stats.in_use > s_stats.high_water) {
+            s_stats.high_water = s_stats.in_use;
+        }
+    } else {
+        s_stats.exhausted++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_pool_lock);
+
+    return block;
+}
+
+void pkt_pool_give(uint8_t *block) {
+    if (block == NULL) {
+        return;
+    }
+    if (block < &s_blocks[0][0] || block >= &s_blocks[PKT_POOL_BLOCKS][0]) {
+        ESP_LOGE(TAG, "Give of foreign block %p", block);
+        return;
+    }
+    uint32_t idx = (block - &s_blocks[0][0]) / PKT_POOL_BLOCK_SIZE;
+
+    portENTER_CRITICAL_SAFE(&s_pool_lock);
+    if (s_free_count < PKT_POOL_BLOCKS) {
+        s_free[s_free_count++] = (uint16_t)idx;
+        s_stats.in_use--;
+    }
+    portEXIT_CRITICAL_SAFE(&s_pool_lock);
+}
+
+void pkt_pool_get_stats(pkt_pool_stats_t *stats) {
+    portENTER_CRITICAL_SAFE(&s_pool_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL_SAFE(&s_pool_lock);
+}
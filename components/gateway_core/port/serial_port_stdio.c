@@ -0,0 +1,127 @@
+/* SERIAL_PORT_STDIO.C
+   Host serial port for the linux target
+
+   By default the protocol runs over stdin/stdout and the log is moved to
+   stderr so the two do not mix. With GATEWAY_PTY set in the environment a
+   pseudo terminal is opened instead and its path is printed, so Node-RED or
+   any serial tool can attach to the simulated gateway like to a board.
+
+   The descriptors are non-blocking and polled: a task blocked in read()
+   would keep the POSIX FreeRTOS port from scheduling the other tasks.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "serial_port.h"
+
+static const char *TAG = "serial_port";
+
+#define STDIO_POLL_TICKS   pdMS_TO_TICKS(2)
+
+static int s_rx_fd = -1;
+static int s_tx_fd = -1;
+static void (*s_sink)(const uint8_t *data, size_t len);
+
+static int log_to_stderr(const char *fmt, va_list args) {
+    return vfprintf(stderr, fmt, args);
+}
+
+static int open_pty(void) {
+    struct termios tio;
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        ESP_LOGE(TAG, "Open pty fail: %d", errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    fprintf(stderr, "Gateway serial port: %s\n", ptsname(fd));
+    return fd;
+}
+
+esp_err_t serial_port_init(void) {
+    esp_log_set_vprintf(log_to_stderr);
+
+    if (getenv("GATEWAY_PTY")) {
+        s_rx_fd = open_pty();
+        if (s_rx_fd < 0) {
+            return ESP_FAIL;
+        }
+        s_tx_fd = s_rx_fd;
+    } else {
+        s_rx_fd = STDIN_FILENO;
+        s_tx_fd = STDOUT_FILENO;
+    }
+    fcntl(s_rx_fd, F_SETFL, fcntl(s_rx_fd, F_GETFL) | O_NONBLOCK);
+    return ESP_OK;
+}
+
+int serial_port_read(uint8_t *buf, size_t len, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+
+    while (1) {
+        ssize_t r = read(s_rx_fd, buf, len);
+        if (r > 0) {
+            return r;
+        }
+        if (r == 0 && s_rx_fd == STDIN_FILENO) {
+            // stdin closed, e.g. the end of a piped script: nothing will follow
+            vTaskDelay(portMAX_DELAY);
+        }
+        if (timeout != portMAX_DELAY && xTaskGetTickCount() - start >= timeout) {
+            return 0;
+        }
+        vTaskDelay(STDIO_POLL_TICKS);
+    }
+}
+
+int serial_port_write(const uint8_t *data, size_t len, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    size_t done = 0;
+
+    if (s_sink) {
+        s_sink(data, len);
+        return len;
+    }
+    while (done < len) {
+        ssize_t w = write(s_tx_fd, data + done, len - done);
+        if (w >= 0) {
+            done += w;
+        } else if (errno == EAGAIN && xTaskGetTickCount() - start < timeout) {
+            // A terminal shares one file description for stdin and stdout, so
+            // the output is non-blocking too
+            vTaskDelay(STDIO_POLL_TICKS);
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+    return done;
+}
+
+bool serial_port_connected(void) {
+    return s_tx_fd >= 0;
+}
+
+void serial_port_set_sink(void (*sink)(const uint8_t *data, size_t len)) {
+    s_sink = sink;
+}
@@ -0,0 +1,127 @@
+/* SERIAL_PORT_UART.C
+   Host serial port on UART0
+
+   The reader sleeps on the driver event queue. Pattern detection on '\n'
+   raises an event as soon as a JSON line is complete, the RX timeout covers
+   binary frames. Each event is drained completely before the next one is
+   taken. Pattern positions are popped as they are reported, since the
+   reader reads everything buffered anyway; the pattern queue is only
+   allocated once. Output goes straight into the TX FIFO without a driver
+   ring, so a write can give up once the FIFO has taken nothing for its
+   timeout.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "driver/uart.h"
+#include "serial_port.h"
+
+static const char *TAG = "serial_port";
+
+#define RX_BUF_SIZE             2048
+#define TXD_PIN                 (CONFIG_EXAMPLE_UART_TXD)
+#define RXD_PIN                 (CONFIG_EXAMPLE_UART_RXD)
+#define UART_EVENT_QUEUE_LEN    20
+#define UART_PATTERN_QUEUE_LEN  20
+
+static QueueHandle_t s_uart_evt_q = NULL;
+static size_t s_avail;                    // Bytes announced by the last event, not read yet.
+
+/* Positions are only consumed to keep the driver's queue from filling up. */
+static void pattern_drop_positions(void) {
+    while (uart_pattern_pop_pos(UART_NUM_0) >= 0) {
+    }
+}
+
+esp_err_t serial_port_init(void) {
+    const uart_config_t uart_config = {
+        .baud_rate = CONFIG_EXAMPLE_UART_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    // We won't use a buffer for sending data.
+    esp_err_t err = uart_driver_install(UART_NUM_0, RX_BUF_SIZE, 0, UART_EVENT_QUEUE_LEN, &s_uart_evt_q, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Install UART driver fail: %s", esp_err_to_name(err));
+        return err;
+    }
+    uart_param_config(UART_NUM_0, &uart_config);
+    uart_set_pin(UART_NUM_0, TXD_PIN, RXD_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    // Wake the reader at the end of every JSON line
+    uart_enable_pattern_det_baud_intr(UART_NUM_0, '\n', 1, 9, 0, 0);
+    uart_pattern_queue_reset(UART_NUM_0, UART_PATTERN_QUEUE_LEN);
+    return ESP_OK;
+}
+
+int serial_port_read(uint8_t *buf, size_t len, TickType_t timeout) {
+    uart_event_t event;
+
+    while (s_avail == 0) {
+        if (xQueueReceive(s_uart_evt_q, &event, timeout) != pdTRUE) {
+            return 0;
+        }
+        switch (event.type) {
+            case UART_DATA:
+            case UART_PATTERN_DET:
+                uart_get_buffered_data_len(UART_NUM_0, &s_avail);
+                if (event.type == UART_PATTERN_DET) {
+                    pattern_drop_positions();
+                }
+                break;
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                ESP_LOGW(TAG, "UART RX overflow, input flushed");
+                uart_flush_input(UART_NUM_0);
+                xQueueReset(s_uart_evt_q);
+                pattern_drop_positions();
+                break;
+            default:
+                break;
+        }
+    }
+
+    int r = uart_read_bytes(UART_NUM_0, buf, s_avail < len ? s_avail : len, 0);
+    if (r <= 0) {
+        s_avail = 0;
+        return 0;
+    }
+    s_avail -= r;
+    return r;
+}
+
+int serial_port_write(const uint8_t *data, size_t len, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    size_t sent = 0;
+
+    while (sent < len) {
+        int n = uart_tx_chars(UART_NUM_0, (const char *)data + sent, len - sent);
+        if (n < 0) {
+            break;
+        }
+        sent += n;
+        if (n > 0) {
+            start = xTaskGetTickCount();  // The timeout bounds a stall, not the line time of len
+        }
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (sent == len || waited >= timeout) {
+            break;
+        }
+        // FIFO full: sleep until it has drained, then refill
+        uart_wait_tx_done(UART_NUM_0, timeout - waited);
+    }
+    return sent;
+}
+
+bool serial_port_connected(void) {
+    return true;
+}
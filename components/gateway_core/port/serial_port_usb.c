@@ -0,0 +1,41 @@
+/* SERIAL_PORT_USB.C
+   Host serial port on USB Serial/JTAG
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "driver/usb_serial_jtag.h"
+#include "serial_port.h"
+
+static const char *TAG = "serial_port";
+
+esp_err_t serial_port_init(void) {
+    usb_serial_jtag_driver_config_t usb_cfg = {
+        .tx_buffer_size = 4096,
+        .rx_buffer_size = 4096
+    };
+    esp_err_t err = usb_serial_jtag_driver_install(&usb_cfg);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Install USB Serial/JTAG driver fail: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+int serial_port_read(uint8_t *buf, size_t len, TickType_t timeout) {
+    int r = usb_serial_jtag_read_bytes(buf, len, timeout);
+    return r > 0 ? r : 0;
+}
+
+int serial_port_write(const uint8_t *data, size_t len, TickType_t timeout) {
+    return usb_serial_jtag_write_bytes(data, len, timeout);
+}
+
+bool serial_port_connected(void) {
+    return usb_serial_jtag_is_connected();
+}
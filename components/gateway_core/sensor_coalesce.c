@@ -0,0 +1,173 @@
+/* SENSOR_COALESCE.C
+   Per-node coalescing of sensor events
+
+   With CONFIG_GATEWAY_SENSOR_COALESCE a sensor event from a node opens a
+   window of SENSOR_COALESCE_MS and is forwarded as usual. Further events with
+   the same status inside the window are only counted. When the window runs
+   out, or an event with the other status arrives, the window is closed with
+   one sensor_summary message holding the count, the first and last event
+   times and the final status; a window with a single event closes silently.
+   The windows are fixed, not extended by each event, so a node that keeps
+   firing still reports once per window. Everything runs in espnow_task,
+   which also wakes up for the oldest open window.
+
+   Only canonical sensor messages, as sent by the client and rendered from
+   compact frames, are coalesced; anything else is forwarded unchanged.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "host_proto.h"
+#include "sensor_coalesce.h"
+
+#if CONFIG_GATEWAY_SENSOR_COALESCE
+
+static const char *TAG = "sensor_coalesce";
+
+#define COALESCE_WINDOW_US        ((int64_t)SENSOR_COALESCE_MS * 1000)
+#define COALESCE_NONE             INT64_MAX
+
+typedef struct {
+    bool open;
+    bool status;                          // Status of every event in the window.
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t count;                       // Events in the window, the forwarded first one included.
+    int64_t first_us;
+    int64_t last_us;
+} coalesce_window_t;
+
+static coalesce_window_t s_windows[SENSOR_COALESCE_NODES];
+static int64_t s_next_expiry = COALESCE_NONE; // Earliest end of an open window.
+static sensor_coalesce_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* True if json is exactly the canonical sensor message for mac. */
+static bool sensor_status(const uint8_t *mac, const char *json, size_t len, bool *status) {
+    return host_proto_canonical_type(mac, json, len, status) == HOST_FRAME_NODE_SENSOR;
+}
+
+static void stats_add(uint32_t *counter) {
+    portENTER_CRITICAL(&s_stats_lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Close w, sending its summary if it absorbed anything. */
+static void window_close(coalesce_window_t *w) {
+    char msg[192];
+
+    w->open = false;
+    if (w->count < 2) {
+        return;
+    }
+    int n = snprintf(msg, sizeof(msg),
+                     "{\"type\":\"sensor_summary\",\"payload\":{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+                     "\"status\":%s,\"count\":%" PRIu32 ",\"first_ms\":%" PRId64 ",\"last_ms\":%" PRId64 "}}",
+                     w->mac[0], w->mac[1], w->mac[2], w->mac[3], w->mac[4], w->mac[5],
+                     w->status ? "true" : "false", w->count, w->first_us / 1000, w->last_us / 1000);
+    if (host_proto_emit_node(w->mac, msg, n)) {
+        stats_add(&s_stats.summaries);
+    }
+}
+
+bool sensor_coalesce_event(const uint8_t *mac, const char *json, size_t len) {
+    coalesce_window_t *w = NULL;
+    coalesce_window_t *free_slot = NULL;
+    int64_t now;
+    bool status;
+
+    if (!sensor_status(mac, json, len, &status)) {
+        return false;
+    }
+    now = esp_timer_get_time();
+    for (int i = 0; i < SENSOR_COALESCE_NODES; i++) {
+        if (!s_windows[i].open) {
+            if (free_slot == NULL) {
+                free_slot = &s_windows[i];
+            }
+        } else if (memcmp(s_windows[i].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            w = &s_windows[i];
+            break;
+        }
+    }
+
+    if (w != NULL) {
+        if (w->status == status && now - w->first_us < COALESCE_WINDOW_US) {
+            w->count++;
+            w->last_us = now;
+            stats_add(&s_stats.absorbed);
+            return true;
+        }
+        window_close(w);
+    } else if (free_slot != NULL) {
+        w = free_slot;
+    } else {
+        ESP_LOGD(TAG, "No window for "MACSTR, MAC2STR(mac));
+        stats_add(&s_stats.untracked);
+        return false;
+    }
+
+    // Forward this event and count the ones that follow
+    w->open = true;
+    w->status = status;
+    memcpy(w->mac, mac, ESP_NOW_ETH_ALEN);
+    w->count = 1;
+    w->first_us = now;
+    w->last_us = now;
+    if (now + COALESCE_WINDOW_US < s_next_expiry) {
+        s_next_expiry = now + COALESCE_WINDOW_US;
+    }
+    return false;
+}
+
+void sensor_coalesce_flush_expired(void) {
+    int64_t now = esp_timer_get_time();
+
+    if (now < s_next_expiry) {
+        return;
+    }
+    s_next_expiry = COALESCE_NONE;
+    for (int i = 0; i < SENSOR_COALESCE_NODES; i++) {
+        coalesce_window_t *w = &s_windows[i];
+        if (!w->open) {
+            continue;
+        }
+        int64_t expiry = w->first_us + COALESCE_WINDOW_US;
+        if (expiry <= now) {
+            window_close(w);
+        } else if (expiry < s_next_expiry) {
+            s_next_expiry = expiry;
+        }
+    }
+}
+
+TickType_t sensor_coalesce_wait(void) {
+    if (s_next_expiry == COALESCE_NONE) {
+        return portMAX_DELAY;
+    }
+    int64_t left_us = s_next_expiry - esp_timer_get_time();
+    if (left_us <= 0) {
+        return 0;
+    }
+    return pdMS_TO_TICKS((left_us + 999) / 1000) + 1;
+}
+
+void sensor_coalesce_get_stats(sensor_coalesce_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#endif // CONFIG_GATEWAY_SENSOR_COALESCE
@@ -0,0 +1,95 @@
+/* SPSC_RING.C
+   Single-producer single-consumer ring
+
+   Each record is a 4-byte length followed by the data, padded to 4 bytes.
+   A record that does not fit before the end of the buffer goes to the start,
+   and a wrap marker in place of a length tells the consumer to follow it.
+   head and tail are only ever written by their own side, so publishing a
+   record is one release store and no critical section is needed; head ==
+   tail means empty, and the producer always leaves a gap so a full ring can
+   not look empty.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include "spsc_ring.h"
+
+#define SPSC_HDR_LEN              4
+#define SPSC_WRAP                 UINT32_MAX
+
+static size_t record_size(size_t len) {
+    return SPSC_RING_RECORD_SIZE(len);
+}
+
+void spsc_ring_init(spsc_ring_t *ring, void *buf, size_t size) {
+    ring->buf = buf;
+    ring->size = size & ~(size_t)3;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+void *spsc_ring_acquire(spsc_ring_t *ring, size_t len) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t need = record_size(len);
+    size_t pos;
+
+    if (head >= tail) {
+        size_t end_free = ring->size - head;
+        if (need < end_free || (need == end_free && tail != 0)) {
+            pos = head;
+        } else if (need < tail) {
+            // Consumer follows the marker once the record is committed
+            *(uint32_t *)(ring->buf + head) = SPSC_WRAP;
+            pos = 0;
+        } else {
+            return NULL;
+        }
+    } else if (need < tail - head) {
+        pos = head;
+    } else {
+        return NULL;
+    }
+    *(uint32_t *)(ring->buf + pos) = (uint32_t)len;
+    return ring->buf + pos + SPSC_HDR_LEN;
+}
+
+void spsc_ring_commit(spsc_ring_t *ring, void *item) {
+    uint8_t *rec = (uint8_t *)item - SPSC_HDR_LEN;
+    size_t next = (rec - ring->buf) + record_size(*(uint32_t *)rec);
+
+    atomic_store_explicit(&ring->head, next == ring->size ? 0 : next, memory_order_release);
+}
+
+void *spsc_ring_peek(spsc_ring_t *ring, size_t *len) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail == head) {
+        return NULL;
+    }
+    uint32_t hdr = *(uint32_t *)(ring->buf + tail);
+    if (hdr == SPSC_WRAP) {
+        tail = 0;
+        hdr = *(uint32_t *)ring->buf;
+    }
+    *len = hdr;
+    return ring->buf + tail + SPSC_HDR_LEN;
+}
+
+void spsc_ring_release(spsc_ring_t *ring, void *item) {
+    uint8_t *rec = (uint8_t *)item - SPSC_HDR_LEN;
+    size_t next = (rec - ring->buf) + record_size(*(uint32_t *)rec);
+
+    atomic_store_explicit(&ring->tail, next == ring->size ? 0 : next, memory_order_release);
+}
+
+size_t spsc_ring_used(spsc_ring_t *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    return head >= tail ? head - tail : ring->size - tail + head;
+}
@@ -0,0 +1,301 @@
+/* ESP_NOW_MOCK.C
+   ESP-NOW driver for the linux target
+
+   Keeps a peer table with the limits of the real driver and puts sent frames
+   on a simulated air: the TX hook sees every frame, and the send callback is
+   raised later from a driver task, like the Wi-Fi task does on a board.
+   Unicast frames are acknowledged unless the configured loss rate drops
+   them; broadcasts always report success. Frames from nodes are injected
+   with esp_now_mock_inject.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_now_mock.h"
+
+static const char *TAG = "esp_now_mock";
+
+#define MOCK_TX_QUEUE_LEN   32
+#define MOCK_TASK_PRIO      (configMAX_PRIORITIES - 2)
+
+typedef struct {
+    uint8_t dest[ESP_NOW_ETH_ALEN];
+    uint16_t len;
+} mock_tx_t;
+
+static const uint8_t s_broadcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t s_own_mac[ESP_NOW_ETH_ALEN] = ESP_NOW_MOCK_OWN_MAC;
+
+static bool s_init;
+static esp_now_peer_info_t s_peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static bool s_peer_used[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static esp_now_recv_cb_t s_recv_cb;
+static esp_now_send_cb_t s_send_cb;
+static esp_now_mock_tx_hook_t s_tx_hook;
+static uint8_t s_loss_percent;
+static esp_now_mock_stats_t s_stats;
+static QueueHandle_t s_tx_q = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+
+static int peer_find(const uint8_t *mac) {
+    for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+        if (s_peer_used[i] && memcmp(s_peers[i].peer_addr, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Raises the send callbacks, one per frame in send order. */
+static void mock_air_task(void *arg) {
+    mock_tx_t tx;
+
+    while (1) {
+        if (xQueueReceive(s_tx_q, &tx, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        esp_now_send_status_t status = ESP_NOW_SEND_SUCCESS;
+        if (memcmp(tx.dest, s_broadcast, ESP_NOW_ETH_ALEN) != 0 && s_loss_percent &&
+            (uint8_t)(rand() % 100) < s_loss_percent) {
+            status = ESP_NOW_SEND_FAIL;
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (status == ESP_NOW_SEND_SUCCESS) {
+            s_stats.acked++;
+        } else {
+            s_stats.lost++;
+        }
+        esp_now_send_cb_t cb = s_send_cb;
+        xSemaphoreGive(s_lock);
+
+        if (cb) {
+            esp_now_send_info_t info = {
+                .des_addr = tx.dest,
+                .src_addr = s_own_mac,
+                .ifidx = WIFI_IF_STA,
+                .data_len = tx.len,
+            };
+            cb(&info, status);
+        }
+    }
+}
+
+esp_err_t esp_now_init(void) {
+    if (s_init) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    s_tx_q = xQueueCreate(MOCK_TX_QUEUE_LEN, sizeof(mock_tx_t));
+    if (s_lock == NULL || s_tx_q == NULL) {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    if (xTaskCreate(mock_air_task, "esp_now_mock", 4096, NULL, MOCK_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_ESPNOW_INTERNAL;
+    }
+    memset(s_peer_used, 0, sizeof(s_peer_used));
+    s_init = true;
+    ESP_LOGI(TAG, "Mock ESP-NOW driver started");
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void) {
+    // The air task and queue are kept; a later esp_now_init reuses them
+    s_recv_cb = NULL;
+    s_send_cb = NULL;
+    memset(s_peer_used, 0, sizeof(s_peer_used));
+    s_stats.peers = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+    if (!s_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    s_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_recv_cb(void) {
+    s_recv_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+    if (!s_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    s_send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb(void) {
+    s_send_cb = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+    mock_tx_t tx;
+
+    if (!s_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (peer_addr == NULL || data == NULL || len == 0 || len > ESP_NOW_MAX_DATA_LEN_V2) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (peer_find(peer_addr) < 0) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    s_stats.sent++;
+    esp_now_mock_tx_hook_t hook = s_tx_hook;
+    xSemaphoreGive(s_lock);
+
+    if (hook) {
+        hook(peer_addr, data, len);
+    }
+    memcpy(tx.dest, peer_addr, ESP_NOW_ETH_ALEN);
+    tx.len = len;
+    if (xQueueSend(s_tx_q, &tx, 0) != pdTRUE) {
+        return ESP_ERR_ESPNOW_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+    esp_err_t err = ESP_ERR_ESPNOW_FULL;
+
+    if (!s_init) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (peer_find(peer->peer_addr) >= 0) {
+        err = ESP_ERR_ESPNOW_EXIST;
+    } else {
+        for (int i = 0; i < ESP_NOW_MAX_TOTAL_PEER_NUM; i++) {
+            if (!s_peer_used[i]) {
+                s_peers[i] = *peer;
+                s_peer_used[i] = true;
+                s_stats.peers++;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer) {
+    esp_err_t err = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = peer_find(peer->peer_addr);
+    if (i >= 0) {
+        s_peers[i] = *peer;
+        err = ESP_OK;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer) {
+    esp_err_t err = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = peer_find(peer_addr);
+    if (i >= 0) {
+        *peer = s_peers[i];
+        err = ESP_OK;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+    esp_err_t err = ESP_ERR_ESPNOW_NOT_FOUND;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = peer_find(peer_addr);
+    if (i >= 0) {
+        s_peer_used[i] = false;
+        s_stats.peers--;
+        err = ESP_OK;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool found = peer_find(peer_addr) >= 0;
+    xSemaphoreGive(s_lock);
+    return found;
+}
+
+esp_err_t esp_now_set_pmk(const uint8_t *pmk) {
+    return pmk ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+esp_err_t esp_now_set_wake_window(uint16_t window) {
+    return ESP_OK;
+}
+
+esp_err_t esp_now_mock_inject(const uint8_t *src, const uint8_t *data, size_t len, int8_t rssi) {
+    uint8_t src_addr[ESP_NOW_ETH_ALEN];
+    uint8_t des_addr[ESP_NOW_ETH_ALEN];
+    wifi_pkt_rx_ctrl_t rx_ctrl = {
+        .rssi = rssi,
+    };
+    esp_now_recv_info_t info = {
+        .src_addr = src_addr,
+        .des_addr = des_addr,
+        .rx_ctrl = &rx_ctrl,
+    };
+
+    if (s_recv_cb == NULL) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (len == 0 || len > ESP_NOW_MAX_DATA_LEN_V2) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    memcpy(src_addr, src, ESP_NOW_ETH_ALEN);
+    memcpy(des_addr, s_own_mac, ESP_NOW_ETH_ALEN);
+    s_recv_cb(&info, data, len);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.injected++;
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void esp_now_mock_set_tx_hook(esp_now_mock_tx_hook_t hook) {
+    s_tx_hook = hook;
+}
+
+void esp_now_mock_set_loss(uint8_t percent) {
+    s_loss_percent = percent > 100 ? 100 : percent;
+}
+
+void esp_now_mock_get_stats(esp_now_mock_stats_t *stats) {
+    if (s_lock == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
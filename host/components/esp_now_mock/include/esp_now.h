@@ -0,0 +1,95 @@
+/* ESP-NOW Mock Header File
+
+   Stand-in for the esp_wifi esp_now.h on the linux target. Types, constants
+   and functions mirror the ESP-IDF 5.5 API the gateway core uses; see
+   esp_now_mock.h for the calls a test or benchmark uses to drive it.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESP_NOW_H
+#define ESP_NOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_interface.h"
+
+#define ESP_ERR_ESPNOW_BASE         (ESP_ERR_WIFI_BASE + 100)
+#define ESP_ERR_ESPNOW_NOT_INIT     (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG          (ESP_ERR_ESPNOW_BASE + 2)
+#define ESP_ERR_ESPNOW_NO_MEM       (ESP_ERR_ESPNOW_BASE + 3)
+#define ESP_ERR_ESPNOW_FULL         (ESP_ERR_ESPNOW_BASE + 4)
+#define ESP_ERR_ESPNOW_NOT_FOUND    (ESP_ERR_ESPNOW_BASE + 5)
+#define ESP_ERR_ESPNOW_INTERNAL     (ESP_ERR_ESPNOW_BASE + 6)
+#define ESP_ERR_ESPNOW_EXIST        (ESP_ERR_ESPNOW_BASE + 7)
+#define ESP_ERR_ESPNOW_IF           (ESP_ERR_ESPNOW_BASE + 8)
+
+#define ESP_NOW_ETH_ALEN            6
+#define ESP_NOW_KEY_LEN             16
+#define ESP_NOW_MAX_TOTAL_PEER_NUM  20
+#define ESP_NOW_MAX_ENCRYPT_PEER_NUM 6
+#define ESP_NOW_MAX_DATA_LEN        250
+#define ESP_NOW_MAX_DATA_LEN_V2     1470
+
+typedef enum {
+    WIFI_IF_STA = ESP_IF_WIFI_STA,
+    WIFI_IF_AP  = ESP_IF_WIFI_AP,
+} wifi_interface_t;
+
+typedef struct {
+    signed rssi;                          // dBm of the simulated frame.
+    unsigned channel;
+} wifi_pkt_rx_ctrl_t;
+
+typedef struct {
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[ESP_NOW_KEY_LEN];
+    uint8_t channel;
+    wifi_interface_t ifidx;
+    bool encrypt;
+    void *priv;
+} esp_now_peer_info_t;
+
+typedef struct {
+    uint8_t *src_addr;
+    uint8_t *des_addr;
+    wifi_pkt_rx_ctrl_t *rx_ctrl;
+} esp_now_recv_info_t;
+
+typedef struct {
+    const uint8_t *des_addr;
+    const uint8_t *src_addr;
+    wifi_interface_t ifidx;
+    uint8_t *data;
+    uint16_t data_len;
+} esp_now_send_info_t;
+
+typedef enum {
+    ESP_NOW_SEND_SUCCESS = 0,
+    ESP_NOW_SEND_FAIL,
+} esp_now_send_status_t;
+
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len);
+typedef void (*esp_now_send_cb_t)(const esp_now_send_info_t *tx_info, esp_now_send_status_t status);
+
+esp_err_t esp_now_init(void);
+esp_err_t esp_now_deinit(void);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_unregister_recv_cb(void);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_unregister_send_cb(void);
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr);
+esp_err_t esp_now_mod_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_get_peer(const uint8_t *peer_addr, esp_now_peer_info_t *peer);
+bool esp_now_is_peer_exist(const uint8_t *peer_addr);
+esp_err_t esp_now_set_pmk(const uint8_t *pmk);
+esp_err_t esp_now_set_wake_window(uint16_t window);
+
+#endif // ESP_NOW_H
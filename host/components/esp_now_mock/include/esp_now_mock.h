@@ -0,0 +1,40 @@
+/* ESP-NOW Mock Control Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef ESP_NOW_MOCK_H
+#define ESP_NOW_MOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_now.h"
+
+/* Locally administered address of the simulated gateway radio. */
+#define ESP_NOW_MOCK_OWN_MAC    {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}
+
+/* Called for every frame the gateway puts on the simulated air. */
+typedef void (*esp_now_mock_tx_hook_t)(const uint8_t *dest, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint32_t sent;              // Frames accepted by esp_now_send.
+    uint32_t acked;             // Send callbacks reported as ESP_NOW_SEND_SUCCESS.
+    uint32_t lost;              // Unicast frames reported as ESP_NOW_SEND_FAIL.
+    uint32_t injected;          // Frames handed to the receive callback.
+    uint32_t peers;             // Peers in the driver table.
+} esp_now_mock_stats_t;
+
+/* Global Functions */
+/* Deliver a frame from src to the registered receive callback, in the
+   caller's context like the Wi-Fi task does on a board. */
+esp_err_t esp_now_mock_inject(const uint8_t *src, const uint8_t *data, size_t len, int8_t rssi);
+void esp_now_mock_set_tx_hook(esp_now_mock_tx_hook_t hook);
+/* Percentage of unicast frames reported as not acknowledged, 0 by default. */
+void esp_now_mock_set_loss(uint8_t percent);
+void esp_now_mock_get_stats(esp_now_mock_stats_t *stats);
+
+#endif // ESP_NOW_MOCK_H
@@ -0,0 +1,345 @@
+/* GATEWAY_BENCH.C
+   Synthetic multi-node load generator and latency benchmark
+
+   Simulates BENCH_NODES client nodes, each sending BENCH_RATE messages per
+   second for BENCH_SECONDS, and injects their frames through the mock
+   driver into the real espnow_recv_cb. Every JSON message carries a
+   "bench" number; the serial output is captured and the time from injection
+   to the line reaching the serial port is recorded per message.
+
+   The message kinds are weighted by BENCH_MIX, e.g.
+   "sensor=80,heartbeat=10,compact=10,aggregate=0": JSON sensor events,
+   JSON heartbeats, compact TLV sensor events (counted, not timed, as the
+   TLV form has no room for the number) and aggregate frames of
+   BENCH_AGGR_RECORDS sensor events. BENCH_PAD adds bytes to each JSON
+   sensor event. BENCH_SEED fixes the random sequence.
+
+   At the end one JSON report goes to stdout and the process exits:
+   throughput, latency percentiles, drops and high-water marks at every
+   queue on the receive path, and peak heap use.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "esp_mac.h"
+#include "esp_now_mock.h"
+
+#include "espnow_example.h"
+#include "pkt_pool.h"
+#include "host_tx.h"
+#include "serial_port.h"
+#include "gateway_stats.h"
+#include "gateway_bench.h"
+
+static const char *TAG = "gateway_bench";
+
+#define BENCH_TAG_RING      16384         // Injection times kept for matching lines.
+#define BENCH_MAX_SAMPLES   (1 << 20)
+#define BENCH_AGGR_RECORDS  4
+#define BENCH_PAD_MAX       200           // Keeps an aggregate of padded events in one frame.
+#define BENCH_DRAIN_US      (5 * 1000 * 1000)
+#define BENCH_IDLE_US       (200 * 1000)
+#define BENCH_TASK_PRIO     (configMAX_PRIORITIES - 2)
+
+typedef enum {
+    BENCH_SENSOR,
+    BENCH_HEARTBEAT,
+    BENCH_COMPACT,
+    BENCH_AGGREGATE,
+    BENCH_KIND_MAX,
+} bench_kind_t;
+
+static const char *const s_kind_names[BENCH_KIND_MAX] = {"sensor", "heartbeat", "compact", "aggregate"};
+
+typedef struct {
+    int nodes;
+    double rate;                          // Messages per second per node.
+    int seconds;
+    int pad;
+    unsigned seed;
+    int weight[BENCH_KIND_MAX];
+    int weight_total;
+} bench_cfg_t;
+
+static bench_cfg_t s_cfg;
+static int64_t s_inject_us[BENCH_TAG_RING];
+static uint32_t s_next_tag;
+static uint32_t *s_samples;
+static volatile uint32_t s_sample_count;
+static volatile uint32_t s_lines;
+static volatile int64_t s_last_line_us;
+static uint32_t s_frames;
+static uint32_t s_records;                // Messages that should come out as one line each.
+static uint32_t s_inject_fail;
+static uint32_t s_kind_count[BENCH_KIND_MAX];
+static size_t s_heap_start;
+static size_t s_heap_peak;
+static char s_pad[BENCH_PAD_MAX];
+
+static long env_long(const char *name, long def) {
+    const char *v = getenv(name);
+    return v ? strtol(v, NULL, 0) : def;
+}
+
+static void parse_mix(const char *mix) {
+    char buf[128];
+    char *save = NULL;
+
+    memset(s_cfg.weight, 0, sizeof(s_cfg.weight));
+    snprintf(buf, sizeof(buf), "%s", mix);
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        if (eq == NULL) {
+            continue;
+        }
+        *eq = '\0';
+        for (int k = 0; k < BENCH_KIND_MAX; k++) {
+            if (strcmp(tok, s_kind_names[k]) == 0) {
+                s_cfg.weight[k] = atoi(eq + 1);
+            }
+        }
+    }
+    s_cfg.weight_total = 0;
+    for (int k = 0; k < BENCH_KIND_MAX; k++) {
+        s_cfg.weight_total += s_cfg.weight[k];
+    }
+}
+
+static void heap_sample(void) {
+    struct mallinfo2 mi = mallinfo2();
+    if (mi.uordblks > s_heap_peak) {
+        s_heap_peak = mi.uordblks;
+    }
+}
+
+/* Serial output sink, runs in the host TX writer task. */
+static void bench_sink(const uint8_t *data, size_t len) {
+    int64_t now = esp_timer_get_time();
+    const uint8_t *end = data + len;
+    const uint8_t *p = data;
+
+    while (p < end) {
+        const uint8_t *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) {
+            break;
+        }
+        const char *tag = memmem(p, eol - p, "\"bench\":", 8);
+        if (tag) {
+            uint32_t n = strtoul(tag + 8, NULL, 10);
+            if (s_sample_count < BENCH_MAX_SAMPLES) {
+                s_samples[s_sample_count++] = now - s_inject_us[n % BENCH_TAG_RING];
+            }
+        }
+        s_lines++;
+        p = eol + 1;
+    }
+    s_last_line_us = now;
+}
+
+/* Wrap a payload in espnow_data_t. Returns the frame length. */
+static size_t frame_finish(uint8_t *frame, uint8_t type, size_t payload_len) {
+    espnow_data_t *hdr = (espnow_data_t *)frame;
+    size_t len = sizeof(espnow_data_t) + payload_len;
+
+    hdr->type = type;
+    hdr->crc = 0;
+    hdr->crc = esp_crc16_le(UINT16_MAX, frame, len);
+    return len;
+}
+
+static int json_record(char *out, size_t size, bench_kind_t kind, const uint8_t *mac) {
+    uint32_t tag = s_next_tag++;
+
+    s_inject_us[tag % BENCH_TAG_RING] = esp_timer_get_time();
+    if (kind == BENCH_HEARTBEAT) {
+        return snprintf(out, size, "{\"type\":\"heartbeat\",\"payload\":{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"},\"bench\":%" PRIu32 "}",
+                        MAC2STR(mac), tag);
+    }
+    return snprintf(out, size, "{\"type\":\"sensor\",\"payload\":{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"status\":true,\"pad\":\"%.*s\"},\"bench\":%" PRIu32 "}",
+                    MAC2STR(mac), s_cfg.pad, s_pad, tag);
+}
+
+static bench_kind_t pick_kind(unsigned *seed) {
+    int r = rand_r(seed) % s_cfg.weight_total;
+
+    for (int k = 0; k < BENCH_KIND_MAX; k++) {
+        if (r < s_cfg.weight[k]) {
+            return k;
+        }
+        r -= s_cfg.weight[k];
+    }
+    return BENCH_SENSOR;
+}
+
+static void inject_one(int node, unsigned *seed) {
+    static uint8_t frame[ESP_NOW_MAX_DATA_LEN_V2];
+    uint8_t mac[ESP_NOW_ETH_ALEN] = {0x02, 0xBE, 0x00, 0x00, (uint8_t)(node >> 8), (uint8_t)node};
+    uint8_t *payload = frame + sizeof(espnow_data_t);
+    size_t room = sizeof(frame) - sizeof(espnow_data_t);
+    bench_kind_t kind = pick_kind(seed);
+    size_t len;
+
+    switch (kind) {
+        case BENCH_COMPACT:
+        {
+            const uint8_t tlv[] = {0x01, 0x01, 0x01, 0x02, 0x01, 0x01};
+            memcpy(payload, tlv, sizeof(tlv));
+            len = frame_finish(frame, ESPNOW_DATA_COMPACT, sizeof(tlv));
+            s_records++;
+            break;
+        }
+        case BENCH_AGGREGATE:
+        {
+            size_t off = 0;
+            for (int i = 0; i < BENCH_AGGR_RECORDS; i++) {
+                espnow_aggr_hdr_t *rec = (espnow_aggr_hdr_t *)(payload + off);
+                int n = json_record((char *)rec + sizeof(*rec), room - off - sizeof(*rec), BENCH_SENSOR, mac);
+                rec->type = ESPNOW_DATA_UNICAST;
+                rec->len = n;
+                off += sizeof(*rec) + n;
+            }
+            len = frame_finish(frame, ESPNOW_DATA_AGGREGATE, off);
+            s_records += BENCH_AGGR_RECORDS;
+            break;
+        }
+        default:
+            len = frame_finish(frame, ESPNOW_DATA_UNICAST, json_record((char *)payload, room, kind, mac));
+            s_records++;
+            break;
+    }
+
+    s_kind_count[kind]++;
+    s_frames++;
+    if (esp_now_mock_inject(mac, frame, len, -50) != ESP_OK) {
+        s_inject_fail++;
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t count, int pct) {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t i = (uint64_t)count * pct / 100;
+    return s_samples[i < count ? i : count - 1];
+}
+
+static void report(int64_t elapsed_us) {
+    pkt_pool_stats_t pool;
+    host_tx_stats_t tx;
+    esp_now_mock_stats_t air;
+    uint32_t count = s_sample_count;
+
+    pkt_pool_get_stats(&pool);
+    host_tx_get_stats(&tx);
+    esp_now_mock_get_stats(&air);
+    qsort(s_samples, count, sizeof(uint32_t), cmp_u32);
+
+    printf("{\"type\":\"bench_report\",\"nodes\":%d,\"rate_hz\":%.3f,\"duration_s\":%d,\"pad\":%d,\"seed\":%u,\"mix\":{",
+           s_cfg.nodes, s_cfg.rate, s_cfg.seconds, s_cfg.pad, s_cfg.seed);
+    for (int k = 0; k < BENCH_KIND_MAX; k++) {
+        printf("%s\"%s\":%" PRIu32, k ? "," : "", s_kind_names[k], s_kind_count[k]);
+    }
+    printf("},\"frames\":%" PRIu32 ",\"messages\":%" PRIu32 ",\"lines\":%" PRIu32 ",\"lost\":%" PRId32
+           ",\"inject_fail\":%" PRIu32 ",\"elapsed_ms\":%" PRId64 ",\"throughput_eps\":%.1f",
+           s_frames, s_records, s_lines, (int32_t)(s_records - s_lines), s_inject_fail, elapsed_us / 1000,
+           elapsed_us > 0 ? s_lines * 1e6 / elapsed_us : 0.0);
+    printf(",\"latency_us\":{\"samples\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p90\":%" PRIu32 ",\"p99\":%" PRIu32 ",\"max\":%" PRIu32 "}",
+           count, percentile(count, 50), percentile(count, 90), percentile(count, 99), count ? s_samples[count - 1] : 0);
+    printf(",\"queues\":{\"rx_pool\":{\"size\":%" PRIu32 ",\"high_water\":%" PRIu32 ",\"dropped\":%" PRIu32 "}"
+           ",\"ctrl_queue\":{\"size\":%d,\"high_water\":%" PRIu32 ",\"dropped\":%" PRIu32 "}"
+           ",\"data_queue\":{\"size\":%d,\"high_water\":%" PRIu32 ",\"dropped\":%" PRIu32 "}"
+           ",\"host_tx\":{\"queued\":%" PRIu32 ",\"dropped\":%" PRIu32 ",\"writes\":%" PRIu32 "}}",
+           pool.blocks, pool.high_water, pool.exhausted,
+           ESPNOW_CTRL_QUEUE_SIZE, gateway_stats_get(GATEWAY_STAT_CTRL_QUEUE_HIGH_WATER),
+           gateway_stats_get(GATEWAY_STAT_CTRL_QUEUE_FULL),
+           ESPNOW_DATA_QUEUE_SIZE, gateway_stats_get(GATEWAY_STAT_DATA_QUEUE_HIGH_WATER),
+           gateway_stats_get(GATEWAY_STAT_DATA_DROPPED),
+           tx.queued, tx.dropped, tx.driver_writes);
+    printf(",\"heap\":{\"start_used\":%zu,\"peak_used\":%zu}}\n", s_heap_start, s_heap_peak);
+    fflush(stdout);
+}
+
+static void bench_task(void *arg) {
+    unsigned seed = s_cfg.seed;
+    double total_rate = s_cfg.nodes * s_cfg.rate;
+    int64_t start = esp_timer_get_time();
+    int64_t stop = start + (int64_t)s_cfg.seconds * 1000000;
+    uint64_t sent = 0;
+    int64_t now;
+
+    while ((now = esp_timer_get_time()) < stop) {
+        uint64_t due = (uint64_t)((now - start) * total_rate / 1e6);
+        while (sent < due) {
+            inject_one(sent % s_cfg.nodes, &seed);
+            sent++;
+        }
+        heap_sample();
+        vTaskDelay(1);
+    }
+
+    // Wait for the pipeline to drain: output idle, or the drain limit
+    while ((now = esp_timer_get_time()) - stop < BENCH_DRAIN_US) {
+        if (s_lines >= s_records || now - s_last_line_us > BENCH_IDLE_US) {
+            break;
+        }
+        heap_sample();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    report(now - start);
+    exit(0);
+}
+
+esp_err_t gateway_bench_start(void) {
+    if (getenv("GATEWAY_BENCH") == NULL) {
+        return ESP_OK;
+    }
+    const char *mix = getenv("BENCH_MIX");
+    const char *rate = getenv("BENCH_RATE");
+
+    s_cfg.nodes = env_long("BENCH_NODES", 16);
+    s_cfg.rate = rate ? strtod(rate, NULL) : 1.0;
+    s_cfg.seconds = env_long("BENCH_SECONDS", 10);
+    s_cfg.pad = env_long("BENCH_PAD", 0);
+    s_cfg.seed = env_long("BENCH_SEED", 1);
+    parse_mix(mix ? mix : "sensor=80,heartbeat=10,compact=10,aggregate=0");
+    if (s_cfg.nodes <= 0 || s_cfg.nodes > 65535 || s_cfg.rate <= 0 || s_cfg.seconds <= 0 ||
+        s_cfg.pad < 0 || s_cfg.pad > BENCH_PAD_MAX || s_cfg.weight_total <= 0) {
+        ESP_LOGE(TAG, "Invalid benchmark settings");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_samples = malloc(BENCH_MAX_SAMPLES * sizeof(uint32_t));
+    if (s_samples == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_pad, '.', sizeof(s_pad));
+    s_heap_start = mallinfo2().uordblks;
+    s_heap_peak = s_heap_start;
+    serial_port_set_sink(bench_sink);
+
+    ESP_LOGI(TAG, "%d nodes at %.2f msg/s for %d s", s_cfg.nodes, s_cfg.rate, s_cfg.seconds);
+    if (xTaskCreate(bench_task, "bench", 16384, NULL, BENCH_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,20 @@
+/* Gateway Benchmark Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef GATEWAY_BENCH_H
+#define GATEWAY_BENCH_H
+
+#include "esp_err.h"
+
+/* Global Functions */
+/* Start the load generator if GATEWAY_BENCH is set in the environment.
+   The gateway core must be running. The process exits with the report. */
+esp_err_t gateway_bench_start(void);
+
+#endif // GATEWAY_BENCH_H
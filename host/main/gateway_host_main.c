@@ -0,0 +1,46 @@
+// espnow_gateway/host/main.c
+// The gateway core on the ESP-IDF linux target, for CI machines without boards.
+// ESP-NOW is the mock driver from components/esp_now_mock, NVS is the file-backed
+// flash emulation of the linux target, and the host protocol runs over stdin/stdout
+// (or a pty with GATEWAY_PTY=1, see serial_port_stdio.c).
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now_mock.h"
+
+#include "espnow_example.h"
+#include "nvs_helper.h"
+#include "gateway_core.h"
+#include "gateway_bench.h"
+
+static const char *TAG = "gateway_host";
+
+static const uint8_t s_my_mac[ESP_NOW_ETH_ALEN] = ESP_NOW_MOCK_OWN_MAC;
+
+/* Frames the gateway puts on the simulated air. */
+static void air_tx_hook(const uint8_t *dest, const uint8_t *data, size_t len) {
+    ESP_LOGD(TAG, "Air TX to "MACSTR", len: %d", MAC2STR(dest), (int)len);
+}
+
+void app_main(void) {
+    ESP_LOGI(TAG, "Gateway (linux host) starting...");
+
+    nvs_init();
+    esp_now_mock_set_tx_hook(air_tx_hook);
+
+    if (gateway_core_init(s_my_mac) != ESP_OK) {
+        ESP_LOGE(TAG, "failed to start gateway core");
+        return;
+    }
+
+    char mymac[18]; mac_to_str(s_my_mac, mymac, sizeof(mymac));
+    ESP_LOGI(TAG, "Gateway ready, MAC %s", mymac);
+
+    // load generator, only when GATEWAY_BENCH is set
+    if (gateway_bench_start() != ESP_OK) {
+        ESP_LOGE(TAG, "failed to start benchmark");
+    }
+}
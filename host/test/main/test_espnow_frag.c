@@ -0,0 +1,144 @@
+// espnow_gateway/host/test/main/test_espnow_frag.c
+// espnow_frag: reassembly in and out of order, repeated fragments, fragments
+// that do not fit their message, interleaved senders and the timeout.
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "unity.h"
+#include "espnow_frag.h"
+#include "test_gateway.h"
+
+#if CONFIG_GATEWAY_FRAGMENTATION
+
+#define FRAG_LEN                  100
+
+static const uint8_t s_node_a[ESP_NOW_ETH_ALEN] = {0x02, 0xF0, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t s_node_b[ESP_NOW_ETH_ALEN] = {0x02, 0xF0, 0x00, 0x00, 0x00, 0x02};
+static uint8_t s_msg[ESPNOW_MESSAGE_MAX];
+static uint16_t s_msg_id = 1;
+
+static void message_fill(size_t len, uint8_t salt) {
+    for (size_t i = 0; i < len; i++) {
+        s_msg[i] = (uint8_t)(i * 31 + salt);
+    }
+}
+
+/* Fragment idx of a len byte message s_msg, cut into FRAG_LEN pieces. */
+static const uint8_t *add(const uint8_t *mac, uint16_t msg_id, size_t len, uint8_t idx, size_t *msg_len) {
+    espnow_data_v2_t hdr = {
+        .type = ESPNOW_DATA_UNICAST | ESPNOW_DATA_EXT,
+        .version = ESPNOW_HDR_V2,
+        .flags = ESPNOW_FLAG_FRAGMENT,
+        .msg_id = msg_id,
+        .frag_idx = idx,
+        .frag_count = (len + FRAG_LEN - 1) / FRAG_LEN,
+    };
+    size_t off = (size_t)idx * FRAG_LEN;
+    size_t frag_len = (len - off < FRAG_LEN) ? len - off : FRAG_LEN;
+
+    return espnow_frag_add(mac, &hdr, s_msg + off, frag_len, msg_len);
+}
+
+static void test_in_order(void) {
+    uint16_t id = s_msg_id++;
+    size_t msg_len = 0;
+
+    message_fill(237, 1);
+    TEST_ASSERT_NULL(add(s_node_a, id, 237, 0, &msg_len));
+    TEST_ASSERT_NULL(add(s_node_a, id, 237, 1, &msg_len));
+    const uint8_t *msg = add(s_node_a, id, 237, 2, &msg_len);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL_UINT32(237, msg_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_msg, msg, msg_len);
+}
+
+static void test_out_of_order_with_repeats(void) {
+    static const uint8_t order[] = {3, 0, 3, 2, 0};
+    uint16_t id = s_msg_id++;
+    size_t msg_len = 0;
+
+    message_fill(399, 2);
+    for (size_t i = 0; i < sizeof(order); i++) {
+        TEST_ASSERT_NULL(add(s_node_a, id, 399, order[i], &msg_len));
+    }
+    const uint8_t *msg = add(s_node_a, id, 399, 1, &msg_len);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL_UINT32(399, msg_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_msg, msg, msg_len);
+}
+
+static void test_interleaved_senders(void) {
+    uint16_t id = s_msg_id++;
+    size_t len_a = 0;
+    size_t len_b = 0;
+
+    // Same msg_id from two nodes: two messages, one slot each
+    message_fill(300, 3);
+    TEST_ASSERT_NULL(add(s_node_a, id, 300, 0, &len_a));
+    TEST_ASSERT_NULL(add(s_node_b, id, 300, 2, &len_b));
+    TEST_ASSERT_NULL(add(s_node_a, id, 300, 1, &len_a));
+    TEST_ASSERT_NULL(add(s_node_b, id, 300, 0, &len_b));
+    TEST_ASSERT_NOT_NULL(add(s_node_a, id, 300, 2, &len_a));
+    TEST_ASSERT_EQUAL_UINT32(300, len_a);
+    const uint8_t *msg = add(s_node_b, id, 300, 1, &len_b);
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL_UINT32(300, len_b);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_msg, msg, len_b);
+}
+
+static void test_invalid_fragments(void) {
+    espnow_frag_stats_t before;
+    espnow_frag_stats_t after;
+    uint16_t id = s_msg_id++;
+    size_t msg_len = 0;
+
+    espnow_frag_get_stats(&before);
+    message_fill(250, 4);
+    espnow_data_v2_t hdr = {
+        .type = ESPNOW_DATA_UNICAST | ESPNOW_DATA_EXT,
+        .version = ESPNOW_HDR_V2,
+        .flags = ESPNOW_FLAG_FRAGMENT,
+        .msg_id = id,
+        .frag_idx = 3,
+        .frag_count = 3,
+    };
+    // Index past the count
+    TEST_ASSERT_NULL(espnow_frag_add(s_node_a, &hdr, s_msg, FRAG_LEN, &msg_len));
+    // A middle fragment of a different length than the first
+    TEST_ASSERT_NULL(add(s_node_a, id, 250, 0, &msg_len));
+    hdr.frag_idx = 1;
+    TEST_ASSERT_NULL(espnow_frag_add(s_node_a, &hdr, s_msg, FRAG_LEN - 1, &msg_len));
+    // The message was dropped, so its remaining fragments never complete it
+    TEST_ASSERT_NULL(add(s_node_a, id, 250, 1, &msg_len));
+    TEST_ASSERT_NULL(add(s_node_a, id, 250, 2, &msg_len));
+    espnow_frag_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(before.rx_invalid + 2, after.rx_invalid);
+}
+
+static void test_timeout(void) {
+    espnow_frag_stats_t before;
+    espnow_frag_stats_t after;
+    uint16_t id = s_msg_id++;
+    size_t msg_len = 0;
+
+    espnow_frag_get_stats(&before);
+    message_fill(150, 5);
+    TEST_ASSERT_NULL(add(s_node_a, id, 150, 0, &msg_len));
+    vTaskDelay(pdMS_TO_TICKS(ESPNOW_FRAG_TIMEOUT_MS + 20));
+    TEST_ASSERT_NULL(add(s_node_a, id, 150, 1, &msg_len));
+    espnow_frag_get_stats(&after);
+    TEST_ASSERT_GREATER_THAN_UINT32(before.rx_timeouts, after.rx_timeouts);
+}
+
+#endif // CONFIG_GATEWAY_FRAGMENTATION
+
+void test_espnow_frag_run(void) {
+#if CONFIG_GATEWAY_FRAGMENTATION
+    RUN_TEST(test_in_order);
+    RUN_TEST(test_out_of_order_with_repeats);
+    RUN_TEST(test_interleaved_senders);
+    RUN_TEST(test_invalid_fragments);
+    RUN_TEST(test_timeout);
+#endif
+}
@@ -0,0 +1,112 @@
+// espnow_gateway/host/test/main/test_espnow_seq.c
+// espnow_seq: duplicate suppression inside the window, late frames,
+// wrap-around of the 16-bit sequence, restarts after a large jump and
+// eviction from a full node table.
+
+#include <string.h>
+#include "unity.h"
+#include "esp_now.h"
+#include "espnow_seq.h"
+#include "test_gateway.h"
+
+static void node_mac(uint32_t n, uint8_t *mac) {
+    static const uint8_t base[ESP_NOW_ETH_ALEN] = {0x02, 0x5E, 0x00, 0x00, 0x00, 0x00};
+
+    memcpy(mac, base, ESP_NOW_ETH_ALEN);
+    mac[4] = n >> 8;
+    mac[5] = n & 0xFF;
+}
+
+static void test_init(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, espnow_seq_init());
+}
+
+static void test_duplicates(void) {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    espnow_seq_stats_t before;
+    espnow_seq_stats_t after;
+
+    espnow_seq_get_stats(&before);
+    node_mac(1, mac);
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 100));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 100));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 101));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 100));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 101));
+    espnow_seq_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(before.duplicates + 3, after.duplicates);
+}
+
+static void test_late_frames(void) {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    node_mac(2, mac);
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 10));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 15));
+    // Frames that were overtaken count once, then as duplicates
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 12));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 11));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 12));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 10));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 13));
+}
+
+static void test_wrap_around(void) {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    node_mac(3, mac);
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 65534));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 65535));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 0));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 1));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 65535));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 0));
+}
+
+static void test_restart(void) {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t top = 1000;
+
+    node_mac(4, mac);
+    for (uint16_t s = top - 5; s <= top; s++) {
+        TEST_ASSERT_TRUE(espnow_seq_check(mac, s));
+    }
+    // A jump past ESPNOW_SEQ_MAX_GAP starts a new window; the old numbers
+    // are not in it, so a node that rebooted is not mistaken for duplicates
+    uint16_t restart = top + ESPNOW_SEQ_MAX_GAP + 1;
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, restart));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, restart));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, restart + 1));
+    // Going back by more than the window is a restart as well
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 7));
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 8));
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 7));
+}
+
+static void test_eviction(void) {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    espnow_seq_stats_t stats;
+
+    // Fresh nodes only, so the table ends up full of them
+    for (uint32_t n = 0; n < ESPNOW_SEQ_PEERS + 4; n++) {
+        node_mac(0x100 + n, mac);
+        TEST_ASSERT_TRUE(espnow_seq_check(mac, 1));
+    }
+    espnow_seq_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(ESPNOW_SEQ_PEERS, stats.tracked);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(4, stats.evictions);
+    // The most recent node is still known, the first one was evicted
+    node_mac(0x100 + ESPNOW_SEQ_PEERS + 3, mac);
+    TEST_ASSERT_FALSE(espnow_seq_check(mac, 1));
+    node_mac(0x100, mac);
+    TEST_ASSERT_TRUE(espnow_seq_check(mac, 1));
+}
+
+void test_espnow_seq_run(void) {
+    RUN_TEST(test_init);
+    RUN_TEST(test_duplicates);
+    RUN_TEST(test_late_frames);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_restart);
+    RUN_TEST(test_eviction);
+}
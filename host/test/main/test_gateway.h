@@ -0,0 +1,23 @@
+/* Gateway Test Header File
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef TEST_GATEWAY_H
+#define TEST_GATEWAY_H
+
+/* Global Functions. Each runs the Unity tests of one module with RUN_TEST,
+   between UNITY_BEGIN and UNITY_END in test_main.c. */
+void test_json_scan_run(void);
+void test_host_proto_run(void);
+void test_espnow_seq_run(void);
+void test_spsc_ring_run(void);
+void test_espnow_frag_run(void);
+void test_node_register_run(void);
+void test_nvs_helper_run(void);
+
+#endif // TEST_GATEWAY_H
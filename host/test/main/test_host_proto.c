@@ -0,0 +1,121 @@
+// espnow_gateway/host/test/main/test_host_proto.c
+// host_proto_decode_frame: COBS decoding of binary host frames, including
+// zero bytes and runs longer than one COBS block, and rejection of damaged
+// frames. Frames are built with a plain reference encoder.
+
+#include <string.h>
+#include "unity.h"
+#include "esp_crc.h"
+#include "host_proto.h"
+#include "test_gateway.h"
+
+#define FRAME_PAYLOAD_MAX         600
+
+static uint8_t s_raw[HOST_FRAME_HDR_LEN + FRAME_PAYLOAD_MAX + HOST_FRAME_CRC_LEN];
+static uint8_t s_enc[sizeof(s_raw) + sizeof(s_raw) / 254 + 2];
+
+static size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t code_at = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+            continue;
+        }
+        out[o++] = in[i];
+        if (++code == 0xFF) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+/* COBS encoded frame of type with payload, into s_enc. */
+static size_t frame_build(uint8_t type, const uint8_t *mac, const uint8_t *payload, size_t len) {
+    s_raw[0] = type;
+    s_raw[1] = len & 0xFF;
+    s_raw[2] = len >> 8;
+    memcpy(&s_raw[3], mac, 6);
+    memcpy(&s_raw[HOST_FRAME_HDR_LEN], payload, len);
+    uint16_t crc = esp_crc16_le(UINT16_MAX, s_raw, HOST_FRAME_HDR_LEN + len);
+    s_raw[HOST_FRAME_HDR_LEN + len] = crc & 0xFF;
+    s_raw[HOST_FRAME_HDR_LEN + len + 1] = crc >> 8;
+    return cobs_encode(s_raw, HOST_FRAME_HDR_LEN + len + HOST_FRAME_CRC_LEN, s_enc);
+}
+
+static void roundtrip(const uint8_t *payload, size_t len) {
+    static const uint8_t mac[6] = {0x02, 0x00, 0xAB, 0x00, 0xCD, 0x01};
+    size_t enc_len = frame_build(HOST_FRAME_CMD_JSON, mac, payload, len);
+    host_frame_t frame;
+
+    TEST_ASSERT_NULL(memchr(s_enc, HOST_FRAME_DELIMITER, enc_len));
+    TEST_ASSERT_EQUAL(ESP_OK, host_proto_decode_frame(s_enc, enc_len, &frame));
+    TEST_ASSERT_EQUAL_UINT8(HOST_FRAME_CMD_JSON, frame.type);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(mac, frame.mac, 6);
+    TEST_ASSERT_EQUAL_UINT32(len, frame.len);
+    if (len > 0) {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, frame.payload, len);
+    }
+}
+
+static void test_decode_text(void) {
+    const char *json = "{\"type\":\"get_stats\"}";
+
+    roundtrip((const uint8_t *)json, strlen(json));
+    roundtrip((const uint8_t *)"", 0);
+}
+
+static void test_decode_zeros_and_long_runs(void) {
+    static uint8_t payload[FRAME_PAYLOAD_MAX];
+
+    memset(payload, 0, sizeof(payload));
+    roundtrip(payload, sizeof(payload));
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i % 255 + 1);
+    }
+    // Non-zero runs ending just before, on and just after a 254 byte COBS block
+    for (size_t len = 240; len < 270; len++) {
+        roundtrip(payload, len);
+    }
+    roundtrip(payload, sizeof(payload));
+    payload[253] = 0;
+    payload[508] = 0;
+    roundtrip(payload, sizeof(payload));
+}
+
+static void test_reject_damaged(void) {
+    const char *json = "{\"type\":\"get_config\"}";
+    host_frame_t frame;
+    host_proto_stats_t before;
+    host_proto_stats_t after;
+    size_t enc_len;
+
+    host_proto_get_stats(&before);
+
+    enc_len = frame_build(HOST_FRAME_CMD_JSON, (const uint8_t *)"\0\0\0\0\0\0", (const uint8_t *)json, strlen(json));
+    s_enc[enc_len - 3] ^= 0x01;
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, host_proto_decode_frame(s_enc, enc_len, &frame));
+
+    enc_len = frame_build(HOST_FRAME_CMD_JSON, (const uint8_t *)"\0\0\0\0\0\0", (const uint8_t *)json, strlen(json));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, host_proto_decode_frame(s_enc, enc_len - 1, &frame));
+
+    // A COBS code running past the end of the frame
+    s_enc[0] = 0xFE;
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, host_proto_decode_frame(s_enc, 10, &frame));
+
+    host_proto_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(before.bad_frames_rx + 3, after.bad_frames_rx);
+}
+
+void test_host_proto_run(void) {
+    RUN_TEST(test_decode_text);
+    RUN_TEST(test_decode_zeros_and_long_runs);
+    RUN_TEST(test_reject_damaged);
+}
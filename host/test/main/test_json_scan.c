@@ -0,0 +1,108 @@
+// espnow_gateway/host/test/main/test_json_scan.c
+// json_scan: object validation, the single_line flag, member lookup and the
+// span helpers used by the host command parser.
+
+#include <string.h>
+#include "unity.h"
+#include "json_scan.h"
+#include "test_gateway.h"
+
+static bool scan(const char *json, bool *single_line) {
+    return json_scan_object(json, strlen(json), single_line);
+}
+
+static void test_valid_objects(void) {
+    bool single_line;
+
+    TEST_ASSERT_TRUE(scan("{}", NULL));
+    TEST_ASSERT_TRUE(scan("{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"x\\\"y\"},\"e\":-1.5e3}", &single_line));
+    TEST_ASSERT_TRUE(single_line);
+    TEST_ASSERT_TRUE(scan("{\"n\":[0,-0,10,-1.25,0.5e-3,2E+10,1e9],\"s\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00aF\"}", NULL));
+    TEST_ASSERT_TRUE(scan("{\"a\":\r\n1}", &single_line));
+    TEST_ASSERT_FALSE(single_line);
+}
+
+static void test_invalid_objects(void) {
+    static const char *const bad[] = {
+        "", "[]", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1}x", "{a:1}", "{\"a\":tru}",
+        "{\"a\":\"unterminated}", "{\"a\":[1,2}",
+        "{\"a\":[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]}",
+        // Numbers outside the RFC 8259 grammar
+        "{\"a\":1.2.3}", "{\"a\":1e}", "{\"a\":1-2}", "{\"a\":0123}", "{\"a\":-}", "{\"a\":.5}",
+        "{\"a\":1.}", "{\"a\":+1}", "{\"a\":1e+}", "{\"a\":-01}",
+        // Escapes other than \" \\ \/ \b \f \n \r \t and \u with four hex digits
+        "{\"a\":\"\\q\"}", "{\"a\":\"\\u12\"}", "{\"a\":\"\\u12g4\"}", "{\"a\":\"\\x41\"}",
+    };
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        TEST_ASSERT_FALSE_MESSAGE(scan(bad[i], NULL), bad[i]);
+    }
+}
+
+static void test_trim(void) {
+    const char padded[] = "{\"a\":1} \r\n\0\0";
+
+    TEST_ASSERT_EQUAL_UINT32(7, json_scan_trim(padded, sizeof(padded) - 1));
+    TEST_ASSERT_EQUAL_UINT32(0, json_scan_trim("  ", 2));
+}
+
+static void test_get_member(void) {
+    const char *json = "{\"type\":\"sensor\",\"nested\":{\"type\":\"inner\"},\"n\":42}";
+    json_span_t span;
+    json_span_t raw;
+
+    TEST_ASSERT_TRUE(json_scan_get_member(json, strlen(json), "type", &span));
+    TEST_ASSERT_EQUAL(JSON_SPAN_STRING, span.type);
+    TEST_ASSERT_TRUE(json_span_equals(&span, "sensor"));
+    TEST_ASSERT_FALSE(json_span_equals(&span, "sens"));
+    json_span_raw(&span, &raw);
+    TEST_ASSERT_EQUAL_STRING_LEN("\"sensor\"", raw.ptr, raw.len);
+
+    TEST_ASSERT_TRUE(json_scan_get_member(json, strlen(json), "nested", &span));
+    TEST_ASSERT_EQUAL(JSON_SPAN_OBJECT, span.type);
+    TEST_ASSERT_FALSE(json_scan_get_member(json, strlen(json), "inner", &span));
+}
+
+static void test_members_and_numbers(void) {
+    static const char *const keys[] = { "id", "mac", "big", "neg" };
+    const char *json = "{\"mac\":\"AA:BB:CC:DD:EE:FF\",\"id\":4294967295,\"big\":4294967296,\"neg\":-1}";
+    json_span_t spans[4];
+    uint32_t v;
+
+    TEST_ASSERT_TRUE(json_scan_members(json, strlen(json), keys, spans, 4));
+    TEST_ASSERT_TRUE(json_span_to_u32(&spans[0], &v));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, v);
+    TEST_ASSERT_TRUE(json_span_equals(&spans[1], "AA:BB:CC:DD:EE:FF"));
+    TEST_ASSERT_FALSE(json_span_to_u32(&spans[2], &v));
+    TEST_ASSERT_FALSE(json_span_to_u32(&spans[3], &v));
+
+    TEST_ASSERT_TRUE(json_scan_members("{\"x\":1}", 7, keys, spans, 4));
+    TEST_ASSERT_EQUAL(JSON_SPAN_NONE, spans[0].type);
+    TEST_ASSERT_FALSE(json_scan_members("{\"id\":1", 7, keys, spans, 4));
+}
+
+static void test_array_next(void) {
+    const char *json = "{\"targets\":[\"a\",{\"b\":[1]},3]}";
+    json_span_t array;
+    json_span_t item;
+    size_t pos = 0;
+
+    TEST_ASSERT_TRUE(json_scan_get_member(json, strlen(json), "targets", &array));
+    TEST_ASSERT_EQUAL(JSON_SPAN_ARRAY, array.type);
+    TEST_ASSERT_TRUE(json_span_array_next(&array, &pos, &item));
+    TEST_ASSERT_TRUE(json_span_equals(&item, "a"));
+    TEST_ASSERT_TRUE(json_span_array_next(&array, &pos, &item));
+    TEST_ASSERT_EQUAL(JSON_SPAN_OBJECT, item.type);
+    TEST_ASSERT_TRUE(json_span_array_next(&array, &pos, &item));
+    TEST_ASSERT_EQUAL(JSON_SPAN_NUMBER, item.type);
+    TEST_ASSERT_FALSE(json_span_array_next(&array, &pos, &item));
+}
+
+void test_json_scan_run(void) {
+    RUN_TEST(test_valid_objects);
+    RUN_TEST(test_invalid_objects);
+    RUN_TEST(test_trim);
+    RUN_TEST(test_get_member);
+    RUN_TEST(test_members_and_numbers);
+    RUN_TEST(test_array_next);
+}
@@ -0,0 +1,21 @@
+// espnow_gateway/host/test/main/test_main.c
+// Unit tests of the gateway_core modules, run on the ESP-IDF linux target.
+// Each module's tests live in test_<module>.c and are listed in
+// test_gateway.h. The program exits with the number of failed tests, so CI
+// can use the exit status.
+
+#include <stdlib.h>
+#include "unity.h"
+#include "test_gateway.h"
+
+void app_main(void) {
+    UNITY_BEGIN();
+    test_json_scan_run();
+    test_host_proto_run();
+    test_espnow_seq_run();
+    test_spsc_ring_run();
+    test_espnow_frag_run();
+    test_node_register_run();
+    test_nvs_helper_run();
+    exit(UNITY_END());
+}
@@ -0,0 +1,159 @@
+// espnow_gateway/host/test/main/test_node_register.c
+// node_register: more nodes than the register cache holds all get their
+// register_ack by unicast, none is lost to an eviction, and with peer
+// encryption the ack goes out plain and the peer is back on the LMK after.
+// Runs the whole core on the mock driver, like the host build.
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_crc.h"
+#include "esp_now_mock.h"
+#include "unity.h"
+#include "espnow_example.h"
+#include "gateway_core.h"
+#include "nvs_helper.h"
+#include "node_register.h"
+#include "test_gateway.h"
+
+#if CONFIG_GATEWAY_REGISTER_PACING
+
+#define REG_NODES                 (NODE_REGISTER_NODES * 2)
+#define REG_BATCH                 4       // Requests per tick, well inside the control queue.
+#define REG_ROUND_MS              (NODE_REGISTER_JITTER_MS + REG_NODES * NODE_REGISTER_SPACING_MS + 500)
+#define REG_ROUNDS_MAX            4
+
+static const uint8_t s_own_mac[ESP_NOW_ETH_ALEN] = ESP_NOW_MOCK_OWN_MAC;
+static volatile bool s_acked[REG_NODES];
+static volatile uint32_t s_broadcast_acks;
+static volatile uint32_t s_encrypted_acks;
+
+static void node_mac(int k, uint8_t *mac) {
+    const uint8_t base[ESP_NOW_ETH_ALEN] = {0x02, 0xBB, 0x00, 0x00, (uint8_t)(k >> 8), (uint8_t)k};
+    memcpy(mac, base, ESP_NOW_ETH_ALEN);
+}
+
+static bool frame_has(const uint8_t *data, size_t len, const char *text) {
+    size_t text_len = strlen(text);
+
+    for (size_t i = 0; i + text_len <= len; i++) {
+        if (memcmp(data + i, text, text_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Runs in espnow_task, right before the frame goes on the simulated air. */
+static void ack_hook(const uint8_t *dest, const uint8_t *data, size_t len) {
+    esp_now_peer_info_t peer;
+
+    if (!frame_has(data, len, "register_ack")) {
+        return;
+    }
+    if (IS_BROADCAST_ADDR(dest)) {
+        s_broadcast_acks++;
+        return;
+    }
+    if (esp_now_get_peer(dest, &peer) == ESP_OK && peer.encrypt) {
+        s_encrypted_acks++;
+    }
+    int k = (dest[4] << 8) | dest[5];
+    if (dest[1] == 0xBB && k < REG_NODES) {
+        s_acked[k] = true;
+    }
+}
+
+static void send_register(int k) {
+    static uint8_t frame[128];
+    espnow_data_t *hdr = (espnow_data_t *)frame;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+
+    node_mac(k, mac);
+    int n = snprintf((char *)hdr->payload, sizeof(frame) - sizeof(*hdr),
+                     "{\"type\":\"register\",\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\"}",
+                     mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    size_t len = sizeof(*hdr) + n;
+    hdr->type = ESPNOW_DATA_BROADCAST;
+    hdr->crc = 0;
+    hdr->crc = esp_crc16_le(UINT16_MAX, frame, len);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_now_mock_inject(mac, frame, len, -50));
+}
+
+/* Register the nodes not acked yet, a few per tick like a crowd rebooting. */
+static void register_missing(void) {
+    for (int k = 0; k < REG_NODES; k++) {
+        if (!s_acked[k]) {
+            send_register(k);
+            if (k % REG_BATCH == REG_BATCH - 1) {
+                vTaskDelay(1);
+            }
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(REG_ROUND_MS));
+}
+
+static int acked_count(void) {
+    int count = 0;
+    for (int k = 0; k < REG_NODES; k++) {
+        count += s_acked[k];
+    }
+    return count;
+}
+
+static void test_more_nodes_than_cache(void) {
+    node_register_stats_t before;
+    node_register_stats_t after;
+    int rounds = 1;
+
+    node_register_get_stats(&before);
+    register_missing();
+    node_register_get_stats(&after);
+
+    // Acks go out far slower than the requests come in, so the cache fills
+    // up with pending acks. Every node then either got its ack or was turned
+    // away; none lost a pending ack to a newcomer.
+    TEST_ASSERT_GREATER_THAN_UINT32(0, after.rate_limited - before.rate_limited);
+    TEST_ASSERT_EQUAL_INT(REG_NODES, acked_count() + (int)(after.rate_limited - before.rate_limited));
+
+    // The nodes turned away retry and get theirs.
+    while (acked_count() < REG_NODES && rounds < REG_ROUNDS_MAX) {
+        register_missing();
+        rounds++;
+    }
+    TEST_ASSERT_EQUAL_INT(REG_NODES, acked_count());
+    TEST_ASSERT_EQUAL_UINT32(0, s_broadcast_acks);
+    TEST_ASSERT_EQUAL_UINT32(0, s_encrypted_acks);
+}
+
+static void test_peers_encrypted_after_ack(void) {
+#if CONFIG_GATEWAY_PEER_ENCRYPT
+    esp_now_peer_info_t peer;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int resident = 0;
+
+    for (int k = 0; k < REG_NODES; k++) {
+        node_mac(k, mac);
+        if (esp_now_get_peer(mac, &peer) == ESP_OK) {
+            TEST_ASSERT_TRUE(peer.encrypt);
+            resident++;
+        }
+    }
+    TEST_ASSERT_GREATER_THAN_INT(0, resident);
+#else
+    TEST_IGNORE_MESSAGE("needs CONFIG_GATEWAY_PEER_ENCRYPT");
+#endif
+}
+
+#endif // CONFIG_GATEWAY_REGISTER_PACING
+
+void test_node_register_run(void) {
+#if CONFIG_GATEWAY_REGISTER_PACING
+    nvs_init();
+    esp_now_mock_set_tx_hook(ack_hook);
+    TEST_ASSERT_EQUAL(ESP_OK, gateway_core_init(s_own_mac));
+    RUN_TEST(test_more_nodes_than_cache);
+    RUN_TEST(test_peers_encrypted_after_ack);
+#endif
+}
@@ -0,0 +1,155 @@
+// espnow_gateway/host/test/main/test_nvs_helper.c
+// nvs_helper: loading the version 2 peer list, migrating the version 1 list,
+// records grown by newer firmware, and lists that cannot be read, which must
+// survive the next flush untouched.
+
+#include <string.h>
+#include <stdlib.h>
+#include "nvs.h"
+#include "unity.h"
+#include "nvs_helper.h"
+#include "test_gateway.h"
+
+#define TEST_NVS_NAMESPACE        "peer_storage"
+#define TEST_PEER_MAC_KEY         "peer_macs"
+#define TEST_PEER_LIST_KEY        "peer_list"
+
+static nvs_handle_t s_nvs;
+static uint8_t s_macs[MAX_PEERS][6];
+static uint8_t s_loaded[MAX_PEERS][6];
+
+static void mac_fill(int count, uint8_t salt) {
+    for (int i = 0; i < count; i++) {
+        const uint8_t mac[6] = {0x02, 0xA5, salt, 0x00, (uint8_t)(i >> 8), (uint8_t)i};
+        memcpy(s_macs[i], mac, 6);
+    }
+}
+
+/* Version 2 list of count records of record_size bytes, MAC first and the
+   rest filled with a pattern newer firmware might have stored. */
+static size_t list_write(uint8_t version, uint8_t record_size, int count) {
+    size_t len = 4 + (size_t)count * record_size;
+    uint8_t *blob = malloc(len);
+
+    TEST_ASSERT_NOT_NULL(blob);
+    blob[0] = version;
+    blob[1] = record_size;
+    blob[2] = count & 0xFF;
+    blob[3] = count >> 8;
+    for (int i = 0; i < count; i++) {
+        uint8_t *rec = blob + 4 + (size_t)i * record_size;
+        memset(rec, 0xEE, record_size);
+        memcpy(rec, s_macs[i], 6);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(s_nvs, TEST_PEER_LIST_KEY, blob, len));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_commit(s_nvs));
+    free(blob);
+    return len;
+}
+
+static size_t loaded_count(void) {
+    size_t count = MAX_PEERS;
+    nvs_get_all_peers(s_loaded, &count);
+    return count;
+}
+
+/* Start from an empty store; this also stops any flush still pending. */
+static void store_reset(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_erase_peer_mac());
+}
+
+static void test_load(void) {
+    store_reset();
+    mac_fill(3, 1);
+    list_write(2, 8, 3);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL_UINT32(3, loaded_count());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_macs, s_loaded, 3 * 6);
+}
+
+static void test_grown_record(void) {
+    size_t len;
+
+    // Longer records than the gateway keeps itself, and more bytes than one
+    // full list in its own format
+    store_reset();
+    mac_fill(MAX_PEERS, 2);
+    list_write(2, 16, MAX_PEERS);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL_UINT32(MAX_PEERS, loaded_count());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_macs, s_loaded, MAX_PEERS * 6);
+
+    // Nothing new, so the list is not rewritten
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_flush_peers());
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(s_nvs, TEST_PEER_LIST_KEY, NULL, &len));
+    TEST_ASSERT_EQUAL_UINT32(4 + MAX_PEERS * 16, len);
+}
+
+static void test_migration(void) {
+    size_t len = 0;
+
+    store_reset();
+    mac_fill(5, 3);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(s_nvs, TEST_PEER_MAC_KEY, s_macs, 5 * 6));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_commit(s_nvs));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL_UINT32(5, loaded_count());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_macs, s_loaded, 5 * 6);
+
+    // The first flush writes the version 2 list and drops the old key
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_flush_peers());
+    TEST_ASSERT_EQUAL(ESP_ERR_NVS_NOT_FOUND, nvs_get_blob(s_nvs, TEST_PEER_MAC_KEY, NULL, &len));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(s_nvs, TEST_PEER_LIST_KEY, NULL, &len));
+    TEST_ASSERT_EQUAL_UINT32(4 + 5 * 8, len);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL_UINT32(5, loaded_count());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(s_macs, s_loaded, 5 * 6);
+}
+
+/* The list in flash is kept as it is, however many peers register. */
+static void check_kept(size_t len) {
+    const uint8_t mac[6] = {0x02, 0xA5, 0xFF, 0x00, 0x00, 0x01};
+    size_t now = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_store_peer_mac(mac));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, nvs_flush_peers());
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(s_nvs, TEST_PEER_LIST_KEY, NULL, &now));
+    TEST_ASSERT_EQUAL_UINT32(len, now);
+}
+
+static void test_unknown_version(void) {
+    store_reset();
+    mac_fill(4, 4);
+    size_t len = list_write(3, 8, 4);
+    // A version 1 list must not be taken instead
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(s_nvs, TEST_PEER_MAC_KEY, s_macs, 6));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL_UINT32(0, loaded_count());
+    check_kept(len);
+    store_reset();
+}
+
+static void test_invalid_list(void) {
+    store_reset();
+    mac_fill(4, 5);
+    size_t len = list_write(2, 8, 4);
+    uint8_t blob[4 + 4 * 8];
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_get_blob(s_nvs, TEST_PEER_LIST_KEY, blob, &len));
+    blob[2] = 9; // More records than the blob holds
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_set_blob(s_nvs, TEST_PEER_LIST_KEY, blob, len));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL_UINT32(0, loaded_count());
+    check_kept(len);
+    store_reset();
+}
+
+void test_nvs_helper_run(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_init());
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open(TEST_NVS_NAMESPACE, NVS_READWRITE, &s_nvs));
+    RUN_TEST(test_load);
+    RUN_TEST(test_grown_record);
+    RUN_TEST(test_migration);
+    RUN_TEST(test_unknown_version);
+    RUN_TEST(test_invalid_list);
+    nvs_close(s_nvs);
+}
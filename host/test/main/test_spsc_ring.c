@@ -0,0 +1,142 @@
+// espnow_gateway/host/test/main/test_spsc_ring.c
+// spsc_ring: record order and contents, full and empty rings, wrap-around,
+// and one producer task racing the consumer.
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "unity.h"
+#include "spsc_ring.h"
+#include "test_gateway.h"
+
+#define RING_RECORDS              8
+#define RING_RECORD_MAX           40
+#define STRESS_RECORDS            100000
+
+static uint8_t s_buf[SPSC_RING_SIZE(RING_RECORDS, RING_RECORD_MAX)] __attribute__((aligned(4)));
+static spsc_ring_t s_ring;
+static SemaphoreHandle_t s_done;
+
+/* Record i is len(i) bytes of (i + k) & 0xFF, so a consumer can check it. */
+static size_t record_len(uint32_t i) {
+    return 1 + (i * 7) % RING_RECORD_MAX;
+}
+
+static void record_fill(uint8_t *p, uint32_t i) {
+    size_t len = record_len(i);
+    for (size_t k = 0; k < len; k++) {
+        p[k] = (uint8_t)(i + k);
+    }
+}
+
+static void record_check(const uint8_t *p, size_t len, uint32_t i) {
+    TEST_ASSERT_EQUAL_UINT32(record_len(i), len);
+    for (size_t k = 0; k < len; k++) {
+        TEST_ASSERT_EQUAL_UINT8((uint8_t)(i + k), p[k]);
+    }
+}
+
+static void test_empty_and_uncommitted(void) {
+    size_t len;
+
+    spsc_ring_init(&s_ring, s_buf, sizeof(s_buf));
+    TEST_ASSERT_NULL(spsc_ring_peek(&s_ring, &len));
+    TEST_ASSERT_NOT_NULL(spsc_ring_acquire(&s_ring, 10));
+    TEST_ASSERT_NULL(spsc_ring_peek(&s_ring, &len));
+    TEST_ASSERT_EQUAL_UINT32(0, spsc_ring_used(&s_ring));
+}
+
+static void test_fifo_until_full(void) {
+    uint32_t count = 0;
+    size_t len;
+    uint8_t *p;
+
+    spsc_ring_init(&s_ring, s_buf, sizeof(s_buf));
+    while ((p = spsc_ring_acquire(&s_ring, record_len(count))) != NULL) {
+        record_fill(p, count);
+        spsc_ring_commit(&s_ring, p);
+        count++;
+        TEST_ASSERT_LESS_THAN_UINT32(RING_RECORDS * 4, count);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(RING_RECORDS, count);
+    for (uint32_t i = 0; i < count; i++) {
+        p = spsc_ring_peek(&s_ring, &len);
+        TEST_ASSERT_NOT_NULL(p);
+        TEST_ASSERT_TRUE(spsc_ring_contains(&s_ring, p));
+        record_check(p, len, i);
+        spsc_ring_release(&s_ring, p);
+    }
+    TEST_ASSERT_NULL(spsc_ring_peek(&s_ring, &len));
+    TEST_ASSERT_EQUAL_UINT32(0, spsc_ring_used(&s_ring));
+}
+
+/* Keep a few records queued while the positions walk round the buffer many times. */
+static void test_wrap_around(void) {
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+    size_t len;
+    uint8_t *p;
+
+    spsc_ring_init(&s_ring, s_buf, sizeof(s_buf));
+    while (next_out < 5000) {
+        while (next_in - next_out < 3) {
+            p = spsc_ring_acquire(&s_ring, record_len(next_in));
+            TEST_ASSERT_NOT_NULL(p);
+            record_fill(p, next_in);
+            spsc_ring_commit(&s_ring, p);
+            next_in++;
+        }
+        p = spsc_ring_peek(&s_ring, &len);
+        TEST_ASSERT_NOT_NULL(p);
+        record_check(p, len, next_out);
+        spsc_ring_release(&s_ring, p);
+        next_out++;
+    }
+}
+
+static void producer_task(void *arg) {
+    uint8_t *p;
+
+    for (uint32_t i = 0; i < STRESS_RECORDS; i++) {
+        while ((p = spsc_ring_acquire(&s_ring, record_len(i))) == NULL) {
+            taskYIELD();
+        }
+        record_fill(p, i);
+        spsc_ring_commit(&s_ring, p);
+    }
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+static void test_producer_task(void) {
+    uint32_t next = 0;
+    size_t len;
+    uint8_t *p;
+
+    spsc_ring_init(&s_ring, s_buf, sizeof(s_buf));
+    s_done = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(s_done);
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(producer_task, "ring_producer", 4096, NULL,
+                                          uxTaskPriorityGet(NULL), NULL));
+    while (next < STRESS_RECORDS) {
+        p = spsc_ring_peek(&s_ring, &len);
+        if (p == NULL) {
+            taskYIELD();
+            continue;
+        }
+        record_check(p, len, next);
+        spsc_ring_release(&s_ring, p);
+        next++;
+    }
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(s_done, pdMS_TO_TICKS(1000)));
+    TEST_ASSERT_NULL(spsc_ring_peek(&s_ring, &len));
+    vSemaphoreDelete(s_done);
+}
+
+void test_spsc_ring_run(void) {
+    RUN_TEST(test_empty_and_uncommitted);
+    RUN_TEST(test_fifo_until_full);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_producer_task);
+}
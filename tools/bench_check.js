@@ -0,0 +1,103 @@
+#!/usr/bin/env node
+// bench_check.js
+// Check a bench_report line from the host build against pass/fail thresholds,
+// for CI runs of the benchmark (see "Benchmark" in README.md):
+//
+//     GATEWAY_BENCH=1 BENCH_NODES=64 BENCH_RATE=5 BENCH_SECONDS=10 \
+//         ./build/EspnowGatewayHost.elf | node ../tools/bench_check.js
+//
+// The report is the last line of stdin starting with {"type":"bench_report".
+// Each failed threshold is printed and the exit status is 1; a missing or
+// unparsable report exits with 2. Thresholds, all optional:
+//
+//     --max-lost N          JSON messages with no host line (default 0)
+//     --max-inject-fail N   frames the mock driver refused (default 0)
+//     --max-dropped N       drops summed over all reported queues (default 0)
+//     --min-throughput R    host lines per second, as a fraction of
+//                           nodes * rate_hz (default 0.8)
+//     --max-p99-us N        p99 inject-to-output latency (default 20000)
+
+'use strict';
+
+const LIMITS = {
+    'max-lost': 0,
+    'max-inject-fail': 0,
+    'max-dropped': 0,
+    'min-throughput': 0.8,
+    'max-p99-us': 20000,
+};
+
+function parseArgs(argv) {
+    const limits = Object.assign({}, LIMITS);
+    for (let i = 0; i < argv.length; i++) {
+        const name = argv[i].replace(/^--/, '');
+        const value = Number(argv[i + 1]);
+        if (!(name in limits) || !argv[i].startsWith('--') || Number.isNaN(value)) {
+            throw new Error(`bad argument ${argv[i]}`);
+        }
+        limits[name] = value;
+        i++;
+    }
+    return limits;
+}
+
+// Messages for every threshold the report misses; empty if it passes.
+function checkReport(report, limits) {
+    const failures = [];
+    const dropped = Object.values(report.queues || {}).reduce((sum, q) => sum + (q.dropped || 0), 0);
+    const expected = report.nodes * report.rate_hz;
+    const p99 = report.latency_us ? report.latency_us.p99 : null;
+
+    if (report.lost > limits['max-lost']) {
+        failures.push(`lost ${report.lost} > ${limits['max-lost']}`);
+    }
+    if (report.inject_fail > limits['max-inject-fail']) {
+        failures.push(`inject_fail ${report.inject_fail} > ${limits['max-inject-fail']}`);
+    }
+    if (dropped > limits['max-dropped']) {
+        failures.push(`queue drops ${dropped} > ${limits['max-dropped']}`);
+    }
+    if (report.throughput_eps < expected * limits['min-throughput']) {
+        failures.push(`throughput_eps ${report.throughput_eps} < ${limits['min-throughput']} * ${expected}`);
+    }
+    if (p99 !== null && p99 > limits['max-p99-us']) {
+        failures.push(`latency p99 ${p99} us > ${limits['max-p99-us']}`);
+    }
+    return failures;
+}
+
+function main() {
+    let limits;
+    try {
+        limits = parseArgs(process.argv.slice(2));
+    } catch (err) {
+        console.error(err.message);
+        process.exit(2);
+    }
+
+    const input = require('fs').readFileSync(0, 'latin1');
+    const line = input.split(/\r?\n/).filter((l) => l.startsWith('{"type":"bench_report"')).pop();
+    let report;
+    try {
+        report = JSON.parse(line);
+    } catch (err) {
+        console.error('no bench_report line in the input');
+        process.exit(2);
+    }
+
+    const failures = checkReport(report, limits);
+    for (const f of failures) {
+        console.error(`FAIL ${f}`);
+    }
+    if (failures.length === 0) {
+        console.log(`PASS ${report.nodes} nodes at ${report.rate_hz} Hz: ${report.throughput_eps} lines/s, ` +
+                    `p99 ${report.latency_us ? report.latency_us.p99 : '-'} us, nothing lost`);
+    }
+    process.exit(failures.length ? 1 : 0);
+}
+
+if (require.main === module) {
+    main();
+}
+
+module.exports = { LIMITS, checkReport };
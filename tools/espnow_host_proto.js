@@ -0,0 +1,232 @@
+// espnow_host_proto.js
+// Reference host-side codec for the gateway binary host protocol (main/host_proto.h).
+//
+// Wire format: every frame is COBS encoded and surrounded by 0x00 delimiters.
+// Decoded frame: type(1) | len(2, LE) | mac(6) | payload(len) | crc16(2, LE)
+// crc16 is the ESP-IDF esp_crc16_le(UINT16_MAX, ...) value over type..payload:
+// reflected CCITT polynomial 0x8408, register starts at 0x0000, result inverted.
+//
+// Node-RED usage: set the serial port node to split input on the character
+// \u0000 and deliver binary buffers, load this file through
+// functionGlobalContext (settings.js: espnowProto: require('./espnow_host_proto.js'))
+// and in a function node:
+//
+//     const proto = global.get('espnowProto');
+//     const m = proto.decodeFrame(msg.payload);
+//     if (!m) return null;              // empty or corrupt frame
+//     msg.payload = m.json;             // same text the gateway sends in JSON mode
+//     return msg;
+//
+// Commands go the other way with proto.encodeCommand({type: 'get_config', mac: '...'}).
+// Switch the gateway into binary mode by sending, in JSON mode,
+//     {"type":"set_protocol","protocol":"binary"}
+// and wait for {"type":"protocol_ack","protocol":"binary"} before sending frames.
+
+'use strict';
+
+const FRAME = {
+    NODE_JSON: 0x01,
+    NODE_SENSOR: 0x02,
+    NODE_HEARTBEAT: 0x03,
+    STATUS_JSON: 0x10,
+    TRACE: 0x11,
+    CMD_JSON: 0x20,
+    OTA_CHUNK: 0x21,
+};
+
+const HDR_LEN = 9;
+const CRC_LEN = 2;
+const TRACE_RECORD_LEN = 32;
+
+function crc16(buf, crc = 0xffff) {
+    crc = ~crc & 0xffff;
+    for (const b of buf) {
+        crc ^= b;
+        for (let i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >>> 1) ^ 0x8408 : crc >>> 1;
+        }
+    }
+    return ~crc & 0xffff;
+}
+
+function cobsDecode(buf) {
+    const out = Buffer.alloc(buf.length);
+    let i = 0;
+    let o = 0;
+    while (i < buf.length) {
+        const code = buf[i++];
+        if (code === 0 || i + code - 1 > buf.length) {
+            return null;
+        }
+        for (let k = 1; k < code; k++) {
+            out[o++] = buf[i++];
+        }
+        if (code !== 0xff && i < buf.length) {
+            out[o++] = 0;
+        }
+    }
+    return out.subarray(0, o);
+}
+
+function cobsEncode(buf) {
+    const out = Buffer.alloc(buf.length + Math.ceil(buf.length / 254) + 1);
+    let codePos = 0;
+    let o = 1;
+    let code = 1;
+    for (const b of buf) {
+        if (b === 0) {
+            out[codePos] = code;
+            codePos = o++;
+            code = 1;
+            continue;
+        }
+        out[o++] = b;
+        if (++code === 0xff) {
+            out[codePos] = code;
+            codePos = o++;
+            code = 1;
+        }
+    }
+    out[codePos] = code;
+    return out.subarray(0, o);
+}
+
+function macToStr(mac) {
+    return Array.from(mac, (b) => b.toString(16).toUpperCase().padStart(2, '0')).join(':');
+}
+
+function macFromStr(str) {
+    const mac = Buffer.alloc(6);
+    if (str) {
+        str.split(':').slice(0, 6).forEach((h, i) => { mac[i] = parseInt(h, 16) || 0; });
+    }
+    return mac;
+}
+
+// Packed gateway_trace_record_t records -> the get_trace line of JSON mode.
+function traceToJson(payload) {
+    const stage = (v) => (v === 0xffffffff ? 'null' : String(v));
+    const entries = [];
+    for (let off = 0; off + TRACE_RECORD_LEN <= payload.length; off += TRACE_RECORD_LEN) {
+        const r = payload.subarray(off, off + TRACE_RECORD_LEN);
+        entries.push(`{"id":${r.readUInt32LE(0)},"mac":"${macToStr(r.subarray(4, 10))}","len":${r.readUInt16LE(10)}` +
+                     `,"rx_us":${r.readBigInt64LE(12)},"dequeue_us":${stage(r.readUInt32LE(20))}` +
+                     `,"parse_us":${stage(r.readUInt32LE(24))},"write_us":${stage(r.readUInt32LE(28))}}`);
+    }
+    return `{"type":"trace","entries":[${entries.join(',')}]}`;
+}
+
+// Rebuild the JSON text the gateway would have sent in JSON mode.
+function frameToJson(type, mac, payload) {
+    switch (type) {
+        case FRAME.NODE_SENSOR:
+            return `{"type":"sensor","payload":{"mac":"${macToStr(mac)}","status":${payload[0] ? 'true' : 'false'}}}`;
+        case FRAME.NODE_HEARTBEAT:
+            return `{"type":"heartbeat","payload":{"mac":"${macToStr(mac)}"}}`;
+        case FRAME.TRACE:
+            return traceToJson(payload);
+        default:
+            return payload.toString('utf8');
+    }
+}
+
+// Decode one frame (delimiters already stripped). Returns null for empty or bad frames.
+function decodeFrame(encoded) {
+    if (!encoded || encoded.length === 0) {
+        return null;
+    }
+    const raw = cobsDecode(Buffer.from(encoded));
+    if (!raw || raw.length < HDR_LEN + CRC_LEN) {
+        return null;
+    }
+    const len = raw.readUInt16LE(1);
+    if (len + HDR_LEN + CRC_LEN !== raw.length) {
+        return null;
+    }
+    if (crc16(raw.subarray(0, HDR_LEN + len)) !== raw.readUInt16LE(HDR_LEN + len)) {
+        return null;
+    }
+    const type = raw[0];
+    const mac = raw.subarray(3, 9);
+    const payload = raw.subarray(HDR_LEN, HDR_LEN + len);
+    return { type, mac: macToStr(mac), payload, json: frameToJson(type, mac, payload) };
+}
+
+// Split a byte stream into frames. Calls onMessage(decoded) for every valid frame.
+class FrameSplitter {
+    constructor(onMessage) {
+        this.onMessage = onMessage;
+        this.pending = Buffer.alloc(0);
+        this.badFrames = 0;
+    }
+
+    push(chunk) {
+        let data = Buffer.concat([this.pending, chunk]);
+        let idx;
+        while ((idx = data.indexOf(0)) >= 0) {
+            const frame = data.subarray(0, idx);
+            data = data.subarray(idx + 1);
+            if (frame.length === 0) {
+                continue;
+            }
+            const msg = decodeFrame(frame);
+            if (msg) {
+                this.onMessage(msg);
+            } else {
+                this.badFrames++;
+            }
+        }
+        this.pending = Buffer.from(data);
+    }
+}
+
+function encodeFrame(type, mac, payload) {
+    const raw = Buffer.alloc(HDR_LEN + payload.length + CRC_LEN);
+    raw[0] = type;
+    raw.writeUInt16LE(payload.length, 1);
+    mac.copy(raw, 3);
+    payload.copy(raw, HDR_LEN);
+    raw.writeUInt16LE(crc16(raw.subarray(0, HDR_LEN + payload.length)), HDR_LEN + payload.length);
+    return Buffer.concat([Buffer.from([0]), cobsEncode(raw), Buffer.from([0])]);
+}
+
+// Encode a host command (object or JSON string) as a ready-to-write frame.
+function encodeCommand(cmd) {
+    const text = typeof cmd === 'string' ? cmd : JSON.stringify(cmd);
+    const mac = macFromStr(typeof cmd === 'string' ? null : cmd.mac);
+    return encodeFrame(FRAME.CMD_JSON, mac, Buffer.from(text, 'utf8'));
+}
+
+// IEEE CRC-32 (zlib), as expected in the crc32 field of ota_begin.
+function crc32(buf, crc = 0) {
+    crc = ~crc >>> 0;
+    for (const b of buf) {
+        crc ^= b;
+        for (let i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >>> 1) ^ 0xedb88320 : crc >>> 1;
+        }
+    }
+    return ~crc >>> 0;
+}
+
+// Encode chunk index of an ota_begin session; send it only within the last ota_credit.
+function encodeOtaChunk(session, index, data) {
+    const payload = Buffer.alloc(6 + data.length);
+    payload.writeUInt16LE(session, 0);
+    payload.writeUInt32LE(index, 2);
+    data.copy(payload, 6);
+    return encodeFrame(FRAME.OTA_CHUNK, Buffer.alloc(6), payload);
+}
+
+module.exports = {
+    FRAME,
+    crc16,
+    crc32,
+    cobsDecode,
+    cobsEncode,
+    decodeFrame,
+    encodeFrame,
+    encodeCommand,
+    encodeOtaChunk,
+    FrameSplitter,
+};